@@ -0,0 +1,11 @@
+// Per-frame values, see FrameUniforms in UniformBlocks.h. Shared by every
+// shader that reads the Frame block.
+layout(std140) uniform Frame
+{
+    vec4 EyePosW;   // Eye position in world space.
+    vec4 LightPosW; // Light's position in world space.
+    vec4 LightColor; // Light's diffuse and specular contribution.(1,1,1,1)
+    vec4 Ambient; // Global ambient contribution.
+    vec4 LutScaleBias; // Maps [0,1] onto the first and last texel centers of a LUT layer.
+    mat4 ViewProjectionMatrix;
+};
@@ -0,0 +1,48 @@
+#version 330 core
+
+in vec4 v2f_positionW; // Position in world space.
+in vec4 v2f_normalW; // Surface normal in world space.
+in vec2 v2f_texcoord;
+flat in uvec2 v2f_material; // Material index, texture layer.
+
+#include "common/frame.glsl"
+
+// Same layout as MaterialUniforms in UniformBlocks.h.
+struct MaterialData
+{
+    vec4 emissive;
+    vec4 diffuse;
+    vec4 specular;
+    float shininess;
+    int lutLayer;
+    float lutWarpExponent;
+};
+
+// MAX_INSTANCE_MATERIALS entries.
+layout(std140) uniform MaterialTable
+{
+    MaterialData materials[16];
+};
+
+uniform sampler2DArray diffuseArraySampler; // One layer per body texture.
+
+layout (location=0) out vec4 out_color;
+
+void main()
+{
+    MaterialData material = materials[v2f_material.x];
+
+    vec4 N = normalize(v2f_normalW);
+    vec4 L = normalize(LightPosW - v2f_positionW);
+    vec4 V = normalize(EyePosW - v2f_positionW);
+    vec4 H = normalize(L + V);
+
+    float NdotL = max( dot( N, L ), 0.0 );
+    float NdotH = max( dot( N, H ), 0.0 );
+
+    // Blinn-Phong.
+    vec4 Diffuse = NdotL*material.diffuse;
+    vec4 Specular = pow( NdotH, material.shininess )*material.specular;
+    vec4 texel = texture( diffuseArraySampler, vec3(v2f_texcoord, float(v2f_material.y)) );
+    out_color = ( material.emissive + Ambient + (Diffuse + Specular)*LightColor ) * texel;
+}
@@ -0,0 +1,31 @@
+#version 330 core
+
+layout(location=0) in vec3 in_position;
+layout(location=2) in vec3 in_normal;
+layout(location=8) in vec2 in_texcoord;
+
+// Per-instance world transform (first three rows) and material, see
+// InstanceData in Instancing.h.
+layout(location=11) in vec4 in_instanceRow0;
+layout(location=12) in vec4 in_instanceRow1;
+layout(location=13) in vec4 in_instanceRow2;
+layout(location=14) in uvec2 in_instanceMaterial; // Material index, texture layer.
+
+out vec4 v2f_positionW; // Position in world space.
+out vec4 v2f_normalW; // Surface normal in world space.
+out vec2 v2f_texcoord;
+flat out uvec2 v2f_material;
+
+#include "common/frame.glsl"
+
+void main()
+{
+    // Rows of a 3x4 matrix; the transpose makes them columns.
+    mat4 model = transpose( mat4( in_instanceRow0, in_instanceRow1, in_instanceRow2, vec4(0, 0, 0, 1) ) );
+
+    v2f_positionW = model * vec4(in_position, 1);
+    v2f_normalW = model * vec4(in_normal, 0); // Instances are scaled uniformly.
+    v2f_texcoord = in_texcoord;
+    v2f_material = in_instanceMaterial;
+    gl_Position = ViewProjectionMatrix * v2f_positionW;
+}
@@ -1,58 +1,64 @@
 #version 330 core
 
+// Compile-time switches, defined by ShaderPermutations (see main.cpp):
+// SHADING_MODEL  0 Phong, 1 Blinn Phong, 2 Blinn Phong with the single
+//                material LUTs (the ones baked at the raised shininess when
+//                NORMAL_MAP is set), 3 Blinn Phong with the per-material LUT
+//                array.
+// NORMAL_MAP     1 to take the normal from normalMapSampler.
+// NORMAL_MAP_SHININESS_SCALE  Shininess factor with the normal map, shared
+//                with the LUT bakers.
+
 in vec4 v2f_positionW; // Position in world space.
 in vec4 v2f_normalW; // Surface normal in world space.
 in vec2 v2f_texcoord;
+#if NORMAL_MAP
+in vec4 v2f_tangentW; // Tangent in world space, bitangent sign in w.
+#endif
 
-uniform vec4 EyePosW;   // Eye position in world space.
-uniform vec4 LightPosW; // Light's position in world space.
-uniform vec4 LightColor; // Light's diffuse and specular contribution.(1,1,1,1)
-
-uniform vec4 MaterialEmissive;
-uniform vec4 MaterialDiffuse;
-uniform vec4 MaterialSpecular;
-uniform float MaterialShininess;
-uniform int shaderType;
-uniform bool enableEarthNormalMap;
+#include "common/frame.glsl"
 
-uniform vec4 Ambient; // Global ambient contribution.
+// Per-material values, see MaterialUniforms in UniformBlocks.h.
+layout(std140) uniform Material
+{
+    vec4 MaterialEmissive;
+    vec4 MaterialDiffuse;
+    vec4 MaterialSpecular;
+    float MaterialShininess;
+    int LutLayer;
+    float LutWarpExponent; // The layer is indexed by pow(N.H, LutWarpExponent).
+};
 
 uniform sampler2D diffuseSampler;
+#if SHADING_MODEL == 2
 uniform sampler2D lutDiffuseSampler;
 uniform sampler2D lutSpecularSampler;
+#elif SHADING_MODEL == 3
+uniform sampler2DArray lutArraySampler; // One compact LUT layer per material and normal map state.
+#endif
+#if NORMAL_MAP
 uniform sampler2D normalMapSampler;
+#endif
 float shininess;
 
 layout (location=0) out vec4 out_color;
 
-mat4 rotationX( in float angle ) {
-	return mat4(	1.0,		0,			0,			0,
-			 		0, 	cos(angle),	-sin(angle),		0,
-					0, 	sin(angle),	 cos(angle),		0,
-					0, 			0,			  0, 		1);
-}
-
-mat4 rotationY( in float angle ) {
-	return mat4(	cos(angle),		0,		sin(angle),	0,
-			 				0,		1.0,			 0,	0,
-					-sin(angle),	0,		cos(angle),	0,
-							0, 		0,				0,	1);
-}
-
-mat4 rotationZ( in float angle ) {
-	return mat4(	cos(angle),		-sin(angle),	0,	0,
-			 		sin(angle),		cos(angle),		0,	0,
-							0,				0,		1,	0,
-							0,				0,		0,	1);
-}
-
+#if NORMAL_MAP
 vec4 calculateNormalMapN() {
-	vec4 shift = texture( normalMapSampler, v2f_texcoord )*2.0 -1; //normalize from 0-1 to -1-1
-	//workaround to adjust the normalmap texture to our world coordinate
-	vec4 rotate = rotationX(2.0/180.0)*rotationY(-45.0/180.0)*vec4(normalize(shift.rgb), 1);
-	shininess =  MaterialShininess*30;
-	return normalize(vec4(rotate.rgb,0));
+	vec3 shift = texture( normalMapSampler, v2f_texcoord ).rgb*2.0 - 1.0; //normalize from 0-1 to -1-1
+	// Textures are loaded top row first, so +v runs down the image while the
+	// map's green points up it.
+	shift.y = -shift.y;
+	// Tangent frame of the mesh (see GenerateTangents). As MikkTSpace
+	// expects, the interpolated vectors are used as they are and only the
+	// result is normalized.
+	vec3 N = v2f_normalW.xyz;
+	vec3 T = v2f_tangentW.xyz;
+	vec3 B = (v2f_tangentW.w < 0.0 ? -1.0 : 1.0) * cross(N, T);
+	shininess =  MaterialShininess*NORMAL_MAP_SHININESS_SCALE;
+	return vec4(normalize(mat3(T, B, N)*shift), 0);
 }
+#endif
 
 void main()
 {
@@ -68,33 +74,39 @@ void main()
     vec4 V = normalize( EyePosW - v2f_positionW );
 	
 	// Adjust normal map normal
-	vec4 N = enableEarthNormalMap ? calculateNormalMapN() : normalize(v2f_normalW);
+#if NORMAL_MAP
+	vec4 N = calculateNormalMapN();
+#else
+	vec4 N = normalize(v2f_normalW);
+#endif
 	
 	vec4 Diffuse;
 	vec4 Specular;
-	if (shaderType == 0) {//phong
-		vec4 R = reflect( -L, N );
-		float RdotV = max( dot( R, V ), 0 );
-		Diffuse = NdotL*MaterialDiffuse;
-		Specular = pow( RdotV, shininess)*MaterialSpecular;
-		out_color = ( Emissive + Ambient + (Diffuse + Specular)*LightColor ) * texture( diffuseSampler, v2f_texcoord );
-	}
-	else if(shaderType == 1) {//blinn
-		vec4 H = normalize( L + V );
-		float NdotH = max( dot( N, H ), 0);
-		Diffuse = NdotL*MaterialDiffuse;
-		Specular = pow( NdotH, shininess )*MaterialSpecular;
-		out_color = ( Emissive + Ambient + (Diffuse + Specular)*LightColor ) * texture( diffuseSampler, v2f_texcoord );
-	}
-	else if(shaderType == 2) {//blinn with LUT (not support normal map)
-		vec4 H = normalize( L + V );
-		float NdotH = max( dot( normalize(v2f_normalW), H ), 0);
-		vec2 uv = vec2(NdotL, NdotH);
-		//Diffuse and Specular vector each element range between 0-1
-		Diffuse = texture2D(lutDiffuseSampler, uv);
-		uv = vec2(NdotH, 0);
-		Specular = texture2D(lutSpecularSampler, uv);
-		// out_color vector range 0-1
-		out_color = ( Emissive + Ambient + (Diffuse + Specular)*LightColor ) * texture( diffuseSampler, v2f_texcoord );
-	}
+#if SHADING_MODEL == 0 //phong
+	vec4 R = reflect( -L, N );
+	float RdotV = max( dot( R, V ), 0 );
+	Diffuse = NdotL*MaterialDiffuse;
+	Specular = pow( RdotV, shininess)*MaterialSpecular;
+#else
+	vec4 H = normalize( L + V );
+	float NdotH = max( dot( N, H ), 0);
+#if SHADING_MODEL == 1 //blinn
+	Diffuse = NdotL*MaterialDiffuse;
+	Specular = pow( NdotH, shininess )*MaterialSpecular;
+#elif SHADING_MODEL == 2 //blinn with LUT (baked for a single material)
+	vec2 uv = vec2(NdotL, NdotH);
+	//Diffuse and Specular vector each element range between 0-1
+	Diffuse = texture(lutDiffuseSampler, uv);
+	uv = vec2(NdotH, 0);
+	Specular = texture(lutSpecularSampler, uv);
+#else //blinn with the per-material LUT array
+	// Warp N.H so the texels are spent on the specular peak near N.H=1
+	vec2 uv = vec2(NdotL, pow(NdotH, LutWarpExponent)) * LutScaleBias.xy + LutScaleBias.zw;
+	//r = N.L diffuse term, g = specular term, both unlit
+	vec2 terms = texture(lutArraySampler, vec3(uv, LutLayer)).rg;
+	Diffuse = terms.r*MaterialDiffuse;
+	Specular = terms.g*MaterialSpecular;
+#endif
+#endif
+	out_color = ( Emissive + Ambient + (Diffuse + Specular)*LightColor ) * texture( diffuseSampler, v2f_texcoord );
 }
\ No newline at end of file
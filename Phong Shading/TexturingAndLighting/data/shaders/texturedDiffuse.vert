@@ -1,28 +1,51 @@
 #version 330 core
 
+// Compile-time switches, defined by ShaderPermutations (see main.cpp):
+// BUMP_MAP    1 to displace the surface along the normal by bumpMapSampler.
+// NORMAL_MAP  1 to pass the tangent frame on to the fragment shader.
+
 layout(location=0) in vec3 in_position;
 layout(location=2) in vec3 in_normal;
 layout(location=8) in vec2 in_texcoord;
+#if NORMAL_MAP
+layout(location=6) in vec4 in_tangent; // xyz tangent, w bitangent sign, see GenerateTangents.
+#endif
 
 out vec4 v2f_positionW; // Position in world space.
 out vec4 v2f_normalW; // Surface normal in world space.
 out vec2 v2f_texcoord;
+#if NORMAL_MAP
+out vec4 v2f_tangentW; // Tangent in world space, bitangent sign in w.
+#endif
+
+#include "common/frame.glsl"
 
-// Model, View, Projection matrix.
-uniform mat4 ModelViewProjectionMatrix;
-uniform mat4 ModelMatrix;
+// Per-draw values, see ObjectUniforms in UniformBlocks.h.
+layout(std140) uniform Object
+{
+    mat4 ModelViewProjectionMatrix;
+    mat4 ModelMatrix;
+};
 
+#if BUMP_MAP
 uniform sampler2D bumpMapSampler;
-uniform bool enableEarthBumpMap;
+#endif
 
 void main()
 {
-	vec4 uv = texture2D( bumpMapSampler, in_texcoord );
-	float bump = enableEarthBumpMap ? uv.r*0.15 : 0; //scale=0.15
+#if BUMP_MAP
+	vec4 uv = texture( bumpMapSampler, in_texcoord );
+	float bump = uv.r*0.15; //scale=0.15
 	vec3 bump_in_position = normalize(in_normal) * bump + in_position;
+#else
+	vec3 bump_in_position = in_position;
+#endif
 
     gl_Position = ModelViewProjectionMatrix * vec4(bump_in_position, 1);
     v2f_positionW = ModelMatrix * vec4(bump_in_position, 1); 
     v2f_normalW = ModelMatrix * vec4(in_normal, 0);
     v2f_texcoord = in_texcoord;
+#if NORMAL_MAP
+    v2f_tangentW = vec4((ModelMatrix * vec4(in_tangent.xyz, 0)).xyz, in_tangent.w);
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,71 @@
+/**
+ * Content-addressed on-disk cache of binary blobs.
+ *
+ * Each blob is stored as <directory>/<key><extension> with a small header that
+ * records the key and payload size. Hits are memory-mapped and read in place.
+ * Misses are written to a uniquely named temporary file and renamed into place,
+ * so readers never observe a partially written blob and several processes can
+ * populate the same cache concurrently.
+ */
+#pragma once
+
+#include <MappedFile.h>
+
+#include <cstdint>
+#include <string>
+
+class BlobCache
+{
+public:
+
+    // A blob that is being written. Fill GetPayload() and call Commit() to
+    // publish it; destroying an uncommitted writer discards the blob.
+    class Writer
+    {
+    public:
+        Writer();
+        ~Writer();
+
+        void* GetPayload();
+        size_t GetPayloadSize() const;
+
+        // Publish the blob under its final name. Returns false if the blob could
+        // not be published (another process publishing the same key first is not
+        // an error).
+        bool Commit();
+
+    private:
+        friend class BlobCache;
+
+        Writer( const Writer& );
+        Writer& operator=( const Writer& );
+
+        MappedFile m_File;
+        std::string m_TempPath;
+        std::string m_FinalPath;
+    };
+
+    // An empty directory disables the cache.
+    explicit BlobCache( const std::string& directory = "", const std::string& extension = ".bin" );
+
+    void SetDirectory( const std::string& directory );
+    const std::string& GetDirectory() const;
+    bool IsEnabled() const;
+
+    // Map the blob stored under key. On success the payload starts at
+    // GetPayload( file ) and is GetPayloadSize( file ) bytes long.
+    bool Load( uint64_t key, MappedFile& file ) const;
+
+    // Start writing a blob of payloadSize bytes under key.
+    bool BeginStore( uint64_t key, size_t payloadSize, Writer& writer ) const;
+
+    static const void* GetPayload( const MappedFile& file );
+    static size_t GetPayloadSize( const MappedFile& file );
+
+private:
+
+    std::string GetPath( uint64_t key ) const;
+
+    std::string m_Directory;
+    std::string m_Extension;
+};
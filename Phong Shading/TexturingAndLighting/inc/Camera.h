@@ -2,6 +2,8 @@
  * Basic camera class.
  */
 
+#include <Frustum.h>
+
 class Camera
 {
 public:
@@ -33,8 +35,15 @@ public:
     // Rotate the camera by some amount.
     void Rotate( const glm::quat& rot );
 
-    glm::mat4 GetProjectionMatrix();
-    glm::mat4 GetViewMatrix();
+    const glm::mat4& GetProjectionMatrix() const;
+    const glm::mat4& GetViewMatrix();
+
+    // Projection * view, recomputed only after the view or the projection
+    // changed.
+    const glm::mat4& GetViewProjectionMatrix();
+
+    // World-space view frustum, extracted from the view-projection matrix.
+    const Frustum& GetFrustum();
 
 protected:
 
@@ -50,4 +59,8 @@ protected:
 
 private:
     bool m_ViewDirty;
+    bool m_ViewProjectionDirty;
+    bool m_FrustumDirty;
+    glm::mat4 m_ViewProjectionMatrix;
+    Frustum m_Frustum;
 };
\ No newline at end of file
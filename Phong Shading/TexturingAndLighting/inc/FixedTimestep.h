@@ -0,0 +1,90 @@
+/**
+ * Fixed-timestep simulation clock.
+ *
+ * Wall time from a monotonic clock is accumulated and consumed in whole steps
+ * of a fixed length, so the simulation advances the same way whatever the
+ * frame rate. The time left over is how far the renderer is past the last
+ * simulated state; it interpolates between the previous and the current
+ * state by that fraction of a step.
+ *
+ * Time is counted in integer nanoseconds, so the number of steps depends
+ * only on the total elapsed time and not on how it was split into frames.
+ */
+#pragma once
+
+#include <chrono>
+
+class FixedTimestep
+{
+public:
+
+    typedef std::chrono::nanoseconds Duration;
+
+    // A frame that would need more than maxStepsPerFrame steps (after a
+    // stall, or in a debugger) runs that many and drops the rest.
+    FixedTimestep( Duration step, int maxStepsPerFrame );
+
+    // Start measuring wall time from now, with nothing accumulated.
+    void Reset();
+
+    // Add the wall time since the last call and return the number of steps
+    // to simulate.
+    int Advance();
+
+    // Add an explicit amount of time, for headless runs.
+    int Advance( Duration elapsed );
+
+    // Fraction of a step accumulated but not simulated yet, in [0, 1).
+    float GetAlpha() const;
+
+    float GetStepSeconds() const;
+    uint64_t GetStepCount() const;
+    uint64_t GetDroppedSteps() const;
+
+private:
+
+    Duration m_Step;
+    int m_MaxStepsPerFrame;
+    Duration m_Accumulator;
+    std::chrono::steady_clock::time_point m_Last;
+    uint64_t m_Steps;
+    uint64_t m_Dropped;
+};
+
+// The last two simulation states. Step() keeps the current state as the
+// previous one before advancing it, so rendering can always interpolate
+// between two complete states.
+template<typename State>
+class SimulationStates
+{
+public:
+
+    void Reset( const State& state )
+    {
+        m_Previous = state;
+        m_Current = state;
+    }
+
+    // step( State& ) advances the state by one fixed step.
+    template<typename StepFunction>
+    void Step( StepFunction step )
+    {
+        m_Previous = m_Current;
+        step( m_Current );
+    }
+
+    const State& GetPrevious() const
+    {
+        return m_Previous;
+    }
+
+    const State& GetCurrent() const
+    {
+        return m_Current;
+    }
+
+private:
+
+    State m_Previous;
+    State m_Current;
+};
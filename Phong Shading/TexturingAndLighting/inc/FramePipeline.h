@@ -0,0 +1,185 @@
+/**
+ * Two-stage frame pipeline.
+ *
+ * The build stage turns a snapshot of the frame's input into a packet that
+ * holds everything the submission stage needs: matrices, draw lists, culled
+ * instances and statistics. It runs on a worker thread and touches no GL
+ * state. The submission stage runs on the thread that owns the GL context and
+ * only consumes packets.
+ *
+ * There are two packets. While the caller submits packet N the worker builds
+ * packet N+1 into the other one, so the queue never holds more than one frame
+ * and the latency added is exactly one frame. Acquire() hands out the packet
+ * the worker finished and starts the next build with the given input.
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+struct FramePipelineStatistics
+{
+    bool threaded;
+    double buildMs;         // The build stage, on the worker when threaded.
+    double submitMs;        // The caller's work between two Acquire calls.
+    double waitMs;          // The caller blocked in Acquire for the packet.
+};
+
+template<typename Input, typename Packet>
+class FramePipeline
+{
+public:
+
+    typedef std::function<void( const Input& input, Packet& packet )> BuildFunction;
+
+    FramePipeline()
+        : m_Threaded( false )
+        , m_Started( false )
+        , m_Primed( false )
+        , m_Building( 0 )
+        , m_Pending( false )
+        , m_Quit( false )
+        , m_BuildMs( 0 )
+        , m_Statistics()
+    {}
+
+    ~FramePipeline()
+    {
+        Stop();
+    }
+
+    // Without a worker every packet is built inside Acquire, which is the
+    // old serial frame, for comparison.
+    void Start( const BuildFunction& build, bool threaded )
+    {
+        Stop();
+        m_Build = build;
+        m_Threaded = threaded;
+        m_Started = true;
+        m_Primed = false;
+        m_Quit = false;
+        m_Pending = false;
+        if ( m_Threaded )
+        {
+            m_Worker = std::thread( [this]() { WorkerLoop(); } );
+        }
+    }
+
+    // Wait for the build in flight, if any, and join the worker.
+    void Stop()
+    {
+        if ( m_Worker.joinable() )
+        {
+            {
+                std::lock_guard<std::mutex> lock( m_Mutex );
+                m_Quit = true;
+            }
+            m_Wake.notify_one();
+            m_Worker.join();
+        }
+        m_Started = false;
+    }
+
+    bool IsStarted() const
+    {
+        return m_Started;
+    }
+
+    // The packet to submit this frame. next is the input for the following
+    // packet. The first call has nothing in flight and builds inline. The
+    // returned packet stays valid until the next call.
+    const Packet& Acquire( const Input& next )
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        m_Statistics.threaded = m_Threaded;
+        m_Statistics.submitMs = m_Primed ? std::chrono::duration<double, std::milli>( start - m_LastAcquire ).count() : 0.0;
+
+        int ready = 0;
+        if ( !m_Threaded || !m_Primed )
+        {
+            m_Build( next, m_Packets[0] );
+            m_Statistics.buildMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+            m_Statistics.waitMs = m_Statistics.buildMs;
+            m_Primed = true;
+        }
+        else
+        {
+            std::unique_lock<std::mutex> lock( m_Mutex );
+            m_Done.wait( lock, [this]() { return !m_Pending; } );
+            ready = m_Building;
+            m_Statistics.buildMs = m_BuildMs;
+            m_Statistics.waitMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+        }
+
+        if ( m_Threaded )
+        {
+            {
+                std::lock_guard<std::mutex> lock( m_Mutex );
+                m_Input = next;
+                m_Building = 1 - ready;
+                m_Pending = true;
+            }
+            m_Wake.notify_one();
+        }
+
+        m_LastAcquire = std::chrono::steady_clock::now();
+        return m_Packets[ready];
+    }
+
+    const FramePipelineStatistics& GetStatistics() const
+    {
+        return m_Statistics;
+    }
+
+private:
+
+    void WorkerLoop()
+    {
+        std::unique_lock<std::mutex> lock( m_Mutex );
+        for ( ;; )
+        {
+            m_Wake.wait( lock, [this]() { return m_Pending || m_Quit; } );
+            if ( m_Pending )
+            {
+                // The caller does not touch the input or this packet until
+                // the build is done.
+                lock.unlock();
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                m_Build( m_Input, m_Packets[m_Building] );
+                double buildMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+                lock.lock();
+
+                m_BuildMs = buildMs;
+                m_Pending = false;
+                m_Done.notify_one();
+            }
+            else
+            {
+                return;
+            }
+        }
+    }
+
+    BuildFunction m_Build;
+    bool m_Threaded;
+    bool m_Started;
+    bool m_Primed;              // A packet has been built.
+
+    Packet m_Packets[2];
+    Input m_Input;              // Input of the build in flight.
+    int m_Building;             // Packet the worker writes.
+    bool m_Pending;             // A build is in flight.
+    bool m_Quit;
+    double m_BuildMs;
+
+    std::thread m_Worker;
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    std::condition_variable m_Done;
+
+    std::chrono::steady_clock::time_point m_LastAcquire;
+    FramePipelineStatistics m_Statistics;
+};
@@ -0,0 +1,66 @@
+/**
+ * View frustum planes for visibility tests.
+ *
+ * Besides the single-object tests, CullSpheres and CullBoxes test whole
+ * arrays of bounding volumes stored as structure-of-arrays, 8 at a time with
+ * AVX or 4 at a time with SSE2, and write the indices of the visible ones.
+ */
+#pragma once
+
+enum FrustumPlane
+{
+    FRUSTUM_LEFT,
+    FRUSTUM_RIGHT,
+    FRUSTUM_BOTTOM,
+    FRUSTUM_TOP,
+    FRUSTUM_NEAR,
+    FRUSTUM_FAR,
+    FRUSTUM_PLANE_COUNT
+};
+
+// Planes are stored as ( normal, distance ) with normals pointing into the
+// frustum, so a point p is inside a plane when dot( normal, p ) + distance >= 0.
+struct Frustum
+{
+    glm::vec4 planes[FRUSTUM_PLANE_COUNT];
+};
+
+// Extract the world-space frustum from a view-projection matrix (or the
+// object-space frustum from a model-view-projection matrix).
+Frustum ExtractFrustum( const glm::mat4& viewProjection );
+
+// True if the sphere is at least partly inside the frustum.
+bool IntersectsSphere( const Frustum& frustum, const glm::vec3& center, float radius );
+
+// False only if the box is entirely outside one of the planes.
+bool IntersectsBox( const Frustum& frustum, const glm::vec3& boxMin, const glm::vec3& boxMax );
+
+// Bounding volumes as structure-of-arrays for the batch culls.
+struct BoundingSpheres
+{
+    std::vector<float> x, y, z, radius;
+
+    void Resize( size_t count );
+    size_t Size() const;
+};
+
+struct BoundingBoxes
+{
+    std::vector<float> minX, minY, minZ;
+    std::vector<float> maxX, maxY, maxZ;
+
+    void Resize( size_t count );
+    size_t Size() const;
+};
+
+// Write the indices of the volumes that are at least partly inside the
+// frustum, in increasing order, to visible and return how many there are.
+// visible must have room for every volume. Boxes are tested conservatively:
+// a box that straddles two planes outside a corner of the frustum is kept.
+size_t CullSpheres( const Frustum& frustum, const BoundingSpheres& spheres, uint32_t* visible );
+size_t CullBoxes( const Frustum& frustum, const BoundingBoxes& boxes, uint32_t* visible );
+
+// Spheres and boxes per second for the batch culls against testing one
+// volume at a time, with their results compared. Does not need a GL
+// context. Returns 0 on success, 1 if the results differ.
+int BenchmarkFrustumCulling( size_t count );
@@ -0,0 +1,35 @@
+/**
+ * 64-bit FNV-1a hashing used to build content keys for the on-disk caches.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+// Hash a block of bytes. Pass a previous result as the seed to chain several
+// inputs into a single key.
+inline uint64_t HashBytes( const void* data, size_t size, uint64_t seed = FNV_OFFSET_BASIS )
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>( data );
+    uint64_t hash = seed;
+    for ( size_t i = 0; i < size; ++i )
+    {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+template<typename T>
+inline uint64_t HashValue( const T& value, uint64_t seed = FNV_OFFSET_BASIS )
+{
+    return HashBytes( &value, sizeof(T), seed );
+}
+
+inline uint64_t HashString( const std::string& str, uint64_t seed = FNV_OFFSET_BASIS )
+{
+    return HashBytes( str.data(), str.size(), seed );
+}
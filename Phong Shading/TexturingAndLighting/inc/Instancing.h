@@ -0,0 +1,99 @@
+/**
+ * Instanced drawing of many spheres through the sphere LOD chain.
+ *
+ * Every body is culled against the frustum and assigned a LOD level on the
+ * CPU, in parallel. The surviving instances are written bucket by bucket (one
+ * bucket per LOD level) into an InstanceBatch, which needs no GL context and
+ * can be built on a worker thread. The renderer uploads a batch into its
+ * instance buffer and draws each non-empty bucket with a single
+ * glDrawElementsInstanced.
+ *
+ * Instances carry a 3x4 world transform, a material index and a texture
+ * array layer; see data/shaders/instanced.vert.
+ */
+#pragma once
+
+#include <Frustum.h>
+
+// Instance attributes. The transform takes three consecutive locations.
+#define INSTANCE_TRANSFORM_ATTRIBUTE 11
+#define INSTANCE_MATERIAL_ATTRIBUTE 14
+
+class Camera;
+class SphereLodChain;
+
+// A sphere to draw instanced.
+struct InstanceBody
+{
+    glm::vec3 position;
+    float radius;
+    glm::quat rotation;
+    GLushort material;      // Index into the material table.
+    GLushort layer;         // Diffuse texture array layer.
+};
+
+// Per-instance vertex data.
+struct InstanceData
+{
+    glm::vec4 rows[3];      // First three rows of the world matrix.
+    GLushort material;
+    GLushort layer;
+};
+
+struct InstanceStatistics
+{
+    size_t instances;
+    size_t visible;
+    size_t draws;
+    size_t triangles;
+    double buildMs;         // Cull, LOD selection and instance fill.
+};
+
+// Visible instances of one frame, bucketed by LOD level.
+struct InstanceBatch
+{
+    std::vector<InstanceData> instances;
+    std::vector<size_t> bucketStarts;   // Per level, plus the total at the end.
+    std::vector<signed char> levels;    // Per body, -1 when culled.
+    InstanceStatistics statistics;      // Draws and triangles are left at 0.
+};
+
+// Cull the bodies, select a level of the chain for each and write the
+// visible ones into batch. The chain must be built. Makes no GL calls.
+void BuildInstanceBatch( const std::vector<InstanceBody>& bodies, const Frustum& frustum, Camera& camera, const SphereLodChain& lod, float pixelError, InstanceBatch& batch );
+
+class InstanceRenderer
+{
+public:
+
+    InstanceRenderer();
+
+    // Copy a batch into the instance buffer.
+    void Upload( const InstanceBatch& batch );
+
+    // One instanced draw per non-empty LOD bucket. The instanced shader must
+    // be bound.
+    void Draw( const SphereLodChain& lod );
+
+    const InstanceStatistics& GetStatistics() const;
+
+    void Destroy();
+
+private:
+
+    GLuint m_InstanceBuffer;
+    size_t m_Capacity;                      // In instances.
+    std::vector<size_t> m_BucketStarts;     // Per level, plus the total at the end.
+    InstanceStatistics m_Statistics;
+};
+
+// Per-instance data for a world matrix whose last row is ( 0, 0, 0, 1 ).
+InstanceData MakeInstanceData( const glm::mat4& model, GLushort material, GLushort layer );
+
+// Point the instance attributes of a vertex array at instanceBuffer,
+// starting at firstInstance, and bind the vertex array.
+void SetInstanceAttributes( GLuint vao, GLuint instanceBuffer, size_t firstInstance );
+
+// A flat ring of bodies around the origin in the y = 0 plane, with random
+// size, spin and one of materialCount materials and layerCount texture layers.
+std::vector<InstanceBody> CreateAsteroidBelt( size_t count, float innerRadius, float outerRadius, int materialCount, int layerCount, unsigned int seed );
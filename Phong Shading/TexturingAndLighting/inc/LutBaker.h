@@ -0,0 +1,49 @@
+/**
+ * Baker for the Blinn-Phong lookup tables used by the "LUT Blinn Phong" shader.
+ *
+ * The diffuse table is width x height RGBA8 indexed by (N.L, N.H): RGB holds the
+ * lit diffuse color and A holds the specular intensity. The specular table is
+ * width x 1 RGBA8 indexed by N.H and holds the lit specular color.
+ */
+#pragma once
+
+#include <cstdint>
+
+// Content key of the tables for the given inputs, used to look them up in the
+// on-disk LUT cache. Changes whenever an input or the baked layout changes.
+uint64_t GetLookupTableKey( int width, int height,
+                            GLfloat specShininess,
+                            const glm::vec4& lightColor,
+                            const glm::vec4& materialDiffuse,
+                            const glm::vec4& materialSpecular );
+
+// Bakes both tables into caller-provided buffers (for example a mapped pixel
+// unpack buffer). dataDiffuse must hold width * height * 4 bytes and
+// dataSpecular must hold width * 4 bytes. Rows are baked in parallel and the
+// result is bit-identical to BakeLookupTableReference.
+void BakeLookupTable( int width, int height,
+                      GLfloat specShininess,
+                      const glm::vec4& lightColor,
+                      const glm::vec4& materialDiffuse,
+                      const glm::vec4& materialSpecular,
+                      GLubyte* dataDiffuse,
+                      GLubyte* dataSpecular );
+
+// The original single-threaded per-texel loop. Kept as the correctness and
+// performance reference for BakeLookupTable.
+void BakeLookupTableReference( int width, int height,
+                               GLfloat specShininess,
+                               const glm::vec4& lightColor,
+                               const glm::vec4& materialDiffuse,
+                               const glm::vec4& materialSpecular,
+                               GLubyte* dataDiffuse,
+                               GLubyte* dataSpecular );
+
+// Bakes the tables with both implementations, verifies the output matches and
+// prints texels per second for each. Does not require an OpenGL context.
+// Returns 0 on success, 1 if the outputs differ.
+int BenchmarkLookupTable( int width, int height,
+                          GLfloat specShininess,
+                          const glm::vec4& lightColor,
+                          const glm::vec4& materialDiffuse,
+                          const glm::vec4& materialSpecular );
@@ -0,0 +1,78 @@
+/**
+ * Error-driven builder for the compact Blinn-Phong lookup table.
+ *
+ * The compact table is indexed by (N.L, pow(N.H, warpExponent)) and stores the
+ * unlit diffuse term in R and the unlit specular term in G; the material and
+ * light colors are applied in the shader. Warping the N.H axis spends the
+ * texels on the specular peak near N.H = 1 instead of on the flat tail.
+ *
+ * ChooseLutLayout searches the table size, storage format and warp exponent and
+ * returns the smallest layout whose reconstruction (including bilinear
+ * filtering and format quantization) stays within a maximum absolute error of
+ * the analytic Blinn-Phong terms.
+ */
+#pragma once
+
+#include <vector>
+
+enum LutFormat
+{
+    LUT_FORMAT_RG8,             // 2 bytes per texel, unorm.
+    LUT_FORMAT_RG16F,           // 4 bytes per texel, half float.
+    LUT_FORMAT_R11F_G11F_B10F,  // 4 bytes per texel, packed small floats (B unused).
+};
+
+struct LutLayout
+{
+    int width;              // Texels along N.L.
+    int height;             // Texels along the warped N.H axis.
+    LutFormat format;
+    float warpExponent;     // v = pow( N.H, warpExponent ).
+    float maxError;         // Measured maximum absolute error.
+};
+
+// Layout shared by all layers of a compact LUT texture array. The layers have
+// one size and format, but each layer keeps its own warp exponent.
+struct LutArrayLayout
+{
+    int width;
+    int height;
+    LutFormat format;
+    std::vector<float> warpExponents;   // One per layer.
+    float maxError;                     // Largest measured error over all layers.
+};
+
+// Pick the layout with the fewest bytes whose error does not exceed maxError.
+// If no candidate meets the bound the most accurate one is returned.
+LutLayout ChooseLutLayout( float shininess, float maxError );
+
+// Pick the array layout with the fewest bytes that keeps every layer (one per
+// shininess value) within maxError.
+LutArrayLayout ChooseLutArrayLayout( const std::vector<float>& shininess, float maxError );
+
+// Maximum absolute error of a layout against the analytic diffuse (N.L) and
+// specular (pow( N.H, shininess )) terms.
+float MeasureLutError( const LutLayout& layout, float shininess );
+
+// Fill data (GetLutByteSize bytes) with the table in the layout's format.
+void BakeCompactLut( const LutLayout& layout, float shininess, void* data );
+
+// Fill data (GetLutArrayByteSize bytes) with one table per layer. Layers are
+// baked in parallel.
+void BakeCompactLutArray( const LutArrayLayout& layout, const std::vector<float>& shininess, void* data );
+
+// The 2D layout of a single array layer.
+LutLayout GetLutArrayLayer( const LutArrayLayout& layout, int layer );
+size_t GetLutArrayByteSize( const LutArrayLayout& layout );
+
+int GetLutBytesPerTexel( LutFormat format );
+size_t GetLutByteSize( const LutLayout& layout );
+const char* GetLutFormatName( LutFormat format );
+
+// glTexImage2D parameters for a format.
+GLenum GetLutInternalFormat( LutFormat format );
+GLenum GetLutPixelFormat( LutFormat format );
+GLenum GetLutPixelType( LutFormat format );
+
+// (scale.xy, bias.xy) that maps [0,1] onto the first and last texel centers.
+glm::vec4 GetLutScaleBias( const LutLayout& layout );
@@ -0,0 +1,40 @@
+/**
+ * Memory-mapped file, either read-only or newly created for writing.
+ */
+#pragma once
+
+#include <string>
+
+class MappedFile
+{
+public:
+
+    MappedFile();
+    ~MappedFile();
+
+    // Map an existing file read-only. Returns false if the file does not exist,
+    // is empty or could not be mapped.
+    bool OpenRead( const std::string& path );
+
+    // Create (or truncate) a file of the given size and map it read-write.
+    bool CreateWrite( const std::string& path, size_t size );
+
+    void Close();
+
+    bool IsOpen() const;
+    const void* GetData() const;
+    void* GetData();
+    size_t GetSize() const;
+
+private:
+
+    MappedFile( const MappedFile& );
+    MappedFile& operator=( const MappedFile& );
+
+    void* m_Data;
+    size_t m_Size;
+
+    // Native handles; HANDLEs on Windows, a file descriptor otherwise.
+    void* m_File;
+    void* m_Mapping;
+};
@@ -0,0 +1,12 @@
+/**
+ * Surface material used by the lighting shaders.
+ */
+#pragma once
+
+struct Material
+{
+    glm::vec4 emissive;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    float shininess;
+};
@@ -0,0 +1,93 @@
+/**
+ * CPU-side mesh data and the GPU vertex layouts it can be uploaded with.
+ */
+#pragma once
+
+#include <vector>
+
+#define POSITION_ATTRIBUTE 0
+#define NORMAL_ATTRIBUTE 2
+#define TANGENT_ATTRIBUTE 6
+#define DIFFUSE_ATTRIBUTE 3
+#define SPECULAR_ATTRIBUTE 4
+#define TEXCOORD0_ATTRIBUTE 8
+#define TEXCOORD1_ATTRIBUTE 9
+#define TEXCOORD2_ATTRIBUTE 10
+
+#define BUFFER_OFFSET(offset) ((void*)(offset))
+#define MEMBER_OFFSET(s,m) ((char*)NULL + (offsetof(s,m)))
+
+// Indexed triangle list with one position, normal and texture coordinate per
+// vertex, and a tangent once GenerateTangents has run.
+struct MeshData
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> textureCoords;
+    std::vector<glm::vec4> tangents;        // xyz tangent, w bitangent sign.
+    std::vector<GLuint> indices;
+};
+
+enum VertexFormat
+{
+    // Four separate float streams: vec3 position, vec3 normal, vec2 UV and
+    // vec4 tangent (48 bytes).
+    VERTEX_FORMAT_SEPARATE,
+    // One interleaved stream of float position, snorm 10:10:10:2 normal,
+    // unorm 16:16 UV and snorm 10:10:10:2 tangent with the bitangent sign in
+    // the 2-bit w (24 bytes).
+    VERTEX_FORMAT_PACKED,
+    // As VERTEX_FORMAT_PACKED with half float positions padded to 4 halves (20 bytes).
+    VERTEX_FORMAT_PACKED_HALF,
+    VERTEX_FORMAT_COUNT
+};
+
+// A mesh uploaded to the GPU.
+struct Mesh
+{
+    GLuint vao;
+    std::vector<GLuint> buffers;
+    GLsizei indexCount;
+    GLenum indexType;           // GL_UNSIGNED_SHORT for the packed formats when the vertex count allows it.
+    VertexFormat format;
+};
+
+// Per-vertex tangents for normal mapping, following MikkTSpace: vertices
+// shared by triangles of opposite UV handedness (mirror seams) are split
+// first, then each triangle's tangent is projected onto every corner's
+// tangent plane, weighted by the corner angle and summed per vertex. The
+// bitangent is not stored; it is w * cross( normal, tangent ), to be rebuilt
+// per pixel from the interpolated, unnormalized vectors. This is a
+// reimplementation, not the reference library, so maps baked with
+// MikkTSpace match up to rounding and its special cases for degenerate
+// triangles. Needs normals and texture coordinates and may append vertices.
+// The mesh builders below call it.
+void GenerateTangents( MeshData& mesh );
+
+// UV sphere around the origin.
+MeshData SolidSphere( float radius, int slices, int stacks );
+
+// Geodesic sphere: an icosahedron with every triangle split into four
+// subdivisions times. Texture coordinates match SolidSphere; vertices on the
+// U seam and at the poles are duplicated so the mapping does not wrap.
+MeshData GeodesicSphere( float radius, int subdivisions );
+
+// Load a Wavefront OBJ file (positions, texture coordinates, normals and
+// polygonal faces). Polygons are triangulated as fans and missing normals are
+// computed from the faces. Returns false if the file could not be read.
+bool LoadObj( const std::string& file, MeshData& mesh );
+
+// Upload a mesh with the given vertex layout. Tangents are generated for the
+// upload if the mesh has none.
+Mesh CreateMesh( const MeshData& data, VertexFormat format );
+void DestroyMesh( Mesh& mesh );
+
+int GetVertexSize( VertexFormat format );
+int GetIndexSize( VertexFormat format, size_t vertexCount );
+const char* GetVertexFormatName( VertexFormat format );
+
+// Parse a name returned by GetVertexFormatName. Returns false if unknown.
+bool ParseVertexFormat( const std::string& name, VertexFormat& format );
+
+// Print the vertex and index bytes the mesh takes in every vertex format.
+void PrintVertexFormatReport( const std::string& name, const MeshData& data );
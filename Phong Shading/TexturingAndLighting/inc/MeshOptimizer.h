@@ -0,0 +1,42 @@
+/**
+ * Index and vertex reordering for generated and imported meshes.
+ *
+ * OptimizeVertexCache reorders triangles for post-transform cache reuse
+ * (Forsyth's linear-speed algorithm), OptimizeOverdraw reorders the resulting
+ * triangle clusters so outward-facing clusters are drawn first, and
+ * OptimizeVertexFetch renumbers vertices in first-use order for fetch
+ * locality. AnalyzeVertexCache simulates a FIFO post-transform cache so the
+ * gains can be measured without a GPU.
+ */
+#pragma once
+
+#include <Mesh.h>
+
+struct VertexCacheStatistics
+{
+    size_t transformedVertices;
+    float acmr;     // Average cache miss ratio: transformed vertices per triangle (0.5 is ideal, 3 is worst).
+    float atvr;     // Average transformed vertex ratio: transformed vertices per unique vertex (1 is ideal).
+};
+
+// Simulate a FIFO post-transform cache of cacheSize entries.
+VertexCacheStatistics AnalyzeVertexCache( const std::vector<GLuint>& indices, size_t vertexCount, int cacheSize );
+
+// Reorder triangles to maximize post-transform cache hits.
+void OptimizeVertexCache( std::vector<GLuint>& indices, size_t vertexCount );
+
+// Reorder cache-optimized triangles in clusters, front-most clusters first.
+// Clusters are split where the simulated cache of cacheSize entries is
+// flushed, so the reordering costs little cache efficiency.
+void OptimizeOverdraw( std::vector<GLuint>& indices, const std::vector<glm::vec3>& positions, int cacheSize );
+
+// Renumber vertices in the order the index buffer first references them.
+// Unreferenced vertices are dropped.
+void OptimizeVertexFetch( MeshData& mesh );
+
+// Run all stages in order.
+void OptimizeMesh( MeshData& mesh, bool optimizeOverdraw = true );
+
+// Print ACMR/ATVR for a mesh before and after OptimizeMesh, and the size of
+// the optimized mesh in every vertex format.
+void PrintMeshOptimizationReport( const std::string& name, const MeshData& mesh );
@@ -0,0 +1,55 @@
+/**
+ * Meshlets: small clusters of triangles that can be culled as a unit.
+ *
+ * BuildMeshlets grows each meshlet from a seed triangle through neighbouring
+ * triangles that stay close to its centre and normal, until the vertex or
+ * triangle limit is reached. It reorders the mesh's indices so every meshlet
+ * is a contiguous index range. Every meshlet stores a bounding sphere and a
+ * normal cone; CullMeshlets rejects meshlets outside the frustum or facing
+ * away from the camera and merges the survivors into ranges for
+ * glMultiDrawElements.
+ */
+#pragma once
+
+#include <Mesh.h>
+#include <Frustum.h>
+
+const int MESHLET_MAX_VERTICES = 64;
+const int MESHLET_MAX_TRIANGLES = 124;
+
+struct Meshlet
+{
+    GLuint firstIndex;
+    GLuint indexCount;
+    glm::vec3 center;       // Bounding sphere.
+    float radius;
+    glm::vec3 coneApex;     // Every triangle faces away from cameras inside the cone
+    glm::vec3 coneAxis;     // behind coneApex around coneAxis.
+    float coneCutoff;       // Sine of the cone's half angle; above 1 if the cone is unusable.
+};
+
+struct MeshletCullStatistics
+{
+    size_t meshlets;
+    size_t frustumCulled;
+    size_t backfaceCulled;
+    size_t trianglesSubmitted;
+};
+
+// Index ranges for glMultiDrawElements.
+struct DrawRanges
+{
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+};
+
+// Split mesh into meshlets, reordering its indices meshlet by meshlet. Seeds
+// are taken in index order, so run OptimizeMesh first to keep the order
+// cache friendly.
+std::vector<Meshlet> BuildMeshlets( MeshData& mesh, int maxVertices = MESHLET_MAX_VERTICES, int maxTriangles = MESHLET_MAX_TRIANGLES );
+
+// Cull meshlets of a mesh drawn with modelMatrix (rotation, translation and
+// uniform scale) and append the visible index ranges to ranges. indexSize is
+// the size in bytes of one index in the uploaded mesh.
+void CullMeshlets( const std::vector<Meshlet>& meshlets, const glm::mat4& modelMatrix, const Frustum& frustum,
+                   const glm::vec3& cameraPosition, int indexSize, DrawRanges& ranges, MeshletCullStatistics& statistics );
@@ -0,0 +1,14 @@
+/**
+ * Minimal fork-join helpers built on std::thread.
+ */
+#pragma once
+
+#include <functional>
+
+// Number of worker threads used by ParallelFor (at least 1).
+int GetWorkerCount();
+
+// Splits [0, count) into contiguous ranges of at least minGrain items and runs
+// func(begin, end) for each range on its own thread. Returns once every range
+// has completed. The calling thread processes the first range itself.
+void ParallelFor( int count, int minGrain, const std::function<void( int begin, int end )>& func );
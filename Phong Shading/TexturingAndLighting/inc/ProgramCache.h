@@ -0,0 +1,67 @@
+/**
+ * On-disk cache of linked shader programs.
+ *
+ * Programs are saved with glGetProgramBinary into a BlobCache and restored
+ * with glProgramBinary. The key combines the hashes of the preprocessed
+ * shaders (see ShaderPreprocessor) with GL_VENDOR, GL_RENDERER and
+ * GL_VERSION, so a driver update or a different GPU never sees another
+ * driver's blobs. A driver may still
+ * reject a blob; Load() then reports a miss and the caller builds the program
+ * from source as usual and stores it again.
+ *
+ * Each blob records how long the program took to build, so a hit can report
+ * the time it saved.
+ */
+#pragma once
+
+#include <BlobCache.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ProgramCacheStatistics
+{
+    size_t hits;
+    size_t misses;          // Rejected blobs included.
+    size_t rejected;        // Blobs the driver refused to load.
+    size_t stores;
+    double loadMs;          // Spent restoring programs.
+    double savedMs;         // Build time recorded with the hits, less loadMs.
+};
+
+class ProgramCache
+{
+public:
+
+    // An empty directory disables the cache.
+    explicit ProgramCache( const std::string& directory = "" );
+
+    // Needs a GL context: reads the driver strings and checks that the driver
+    // has at least one program binary format. The cache stays disabled if it
+    // has none.
+    void SetDirectory( const std::string& directory );
+    const std::string& GetDirectory() const;
+    bool IsEnabled() const;
+
+    // Key of a program built from shaders with the given preprocessor hashes,
+    // in a fixed order, on the current driver.
+    uint64_t MakeKey( const std::vector<uint64_t>& shaderHashes ) const;
+
+    // A linked program restored from the blob stored under key, or 0 on a
+    // miss or when the driver rejects the blob.
+    GLuint Load( uint64_t key );
+
+    // Save a linked program under key. buildMs is its compile and link time.
+    void Store( uint64_t key, GLuint program, double buildMs );
+
+    const ProgramCacheStatistics& GetStatistics() const;
+    void PrintStatistics( std::ostream& out ) const;
+
+private:
+
+    BlobCache m_Blobs;
+    uint64_t m_DriverKey;
+    bool m_Supported;
+    ProgramCacheStatistics m_Statistics;
+};
@@ -0,0 +1,89 @@
+/**
+ * Asynchronous shader program builds.
+ *
+ * Submit() compiles every shader of a program and links it without querying
+ * any status, so the driver is free to work on many programs at once. With
+ * GL_KHR_parallel_shader_compile (or the ARB version) it does so on its own
+ * threads, and Poll() asks GL_COMPLETION_STATUS_KHR which programs are done
+ * without waiting for any of them. Only then are the compile and link
+ * statuses read and the completion callback run.
+ *
+ * Without the extension the driver may still compile in the background, but
+ * there is no way to ask without blocking, so Poll() completes one program
+ * per call and Finish() completes them all.
+ */
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+// One shader stage. The strings are passed to glShaderSource as they are,
+// so a #version line, a block of #defines and the file body can be kept
+// apart.
+struct ShaderSource
+{
+    GLenum type;
+    std::string name;                   // For error messages.
+    std::vector<std::string> strings;
+};
+
+// The result of a build.
+struct ProgramBuild
+{
+    GLuint program;                     // 0 if a shader did not compile or the program did not link.
+    double buildMs;                     // From Submit until the build was found complete.
+};
+
+struct ProgramCompilerStatistics
+{
+    size_t submitted;
+    size_t completed;
+    size_t failed;
+};
+
+class ProgramCompiler
+{
+public:
+
+    typedef std::function<void( const ProgramBuild& build )> CompletionFunction;
+
+    ProgramCompiler();
+
+    // Needs a GL context. Lets the driver use as many compiler threads as it
+    // likes when it supports parallel shader compilation.
+    void Initialize();
+    bool IsParallel() const;
+
+    // Start compiling and linking a program. done runs from Poll() or
+    // Finish(), on the thread that owns the context.
+    void Submit( const std::vector<ShaderSource>& shaders, const CompletionFunction& done );
+
+    // Complete the builds the driver has finished, without blocking.
+    void Poll();
+
+    // Complete every build, waiting where necessary.
+    void Finish();
+
+    size_t GetPendingCount() const;
+    const ProgramCompilerStatistics& GetStatistics() const;
+
+private:
+
+    struct Job
+    {
+        GLuint program;
+        std::vector<GLuint> shaders;
+        std::vector<std::string> names;
+        CompletionFunction done;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    bool IsComplete( const Job& job ) const;
+    void Complete( Job& job );
+
+    bool m_Parallel;
+    std::vector<Job> m_Jobs;
+    ProgramCompilerStatistics m_Statistics;
+};
@@ -0,0 +1,83 @@
+/**
+ * Active uniform table for a linked shader program.
+ *
+ * Reflect enumerates the program's active uniforms (samplers included) once
+ * after linking, so drawing code never calls glGetUniformLocation. Uniforms
+ * are looked up by interned name in a small open-addressing hash table, and
+ * the typed setters keep a shadow copy of every value so uploads of an
+ * unchanged value are skipped. Uniform state belongs to the program, so the
+ * shadow copies stay valid while all uploads go through the same reflection.
+ */
+#pragma once
+
+#include <cstdint>
+
+// A uniform name interned to a small integer; compare names by value.
+typedef uint32_t UniformName;
+
+UniformName InternUniformName( const std::string& name );
+const std::string& GetUniformNameString( UniformName name );
+
+struct UniformStatistics
+{
+    size_t uploads;     // Setter calls that reached GL.
+    size_t skipped;     // Setter calls whose value was already current.
+};
+
+class ProgramReflection
+{
+public:
+
+    ProgramReflection();
+
+    // Enumerate the active uniforms of a linked program.
+    void Reflect( GLuint program );
+
+    GLuint GetProgram() const;
+    size_t GetUniformCount() const;
+
+    // -1 if the program has no active uniform of that name.
+    GLint GetLocation( UniformName name ) const;
+
+    // Set a uniform of the currently bound program. Uniforms that are not
+    // active (optimized away) are ignored.
+    void Set( UniformName name, int value );
+    void Set( UniformName name, float value );
+    void Set( UniformName name, const glm::vec4& value );
+    void Set( UniformName name, const glm::mat4& value );
+
+    // Assign a uniform block to a uniform buffer binding point. Returns false
+    // if the program has no active block of that name.
+    bool BindUniformBlock( const char* name, GLuint binding ) const;
+
+    // Counters shared by every reflected program.
+    static const UniformStatistics& GetStatistics();
+    static void ResetStatistics();
+
+    // Print the uniform table.
+    void Print( std::ostream& out ) const;
+
+private:
+
+    struct Uniform
+    {
+        UniformName name;
+        GLint location;
+        GLenum type;
+        GLint size;
+        uint32_t valueOffset;   // Shadow copy in m_Values.
+        bool valueSet;
+    };
+
+    // Return the uniform if the value differs from its shadow copy and
+    // update the copy; NULL if the upload can be skipped.
+    Uniform* Update( UniformName name, const void* value, size_t size );
+    int FindSlot( UniformName name ) const;
+
+    GLuint m_Program;
+    std::vector<Uniform> m_Uniforms;
+    std::vector<int> m_Slots;           // Indices into m_Uniforms, -1 when empty. Power-of-two size.
+    std::vector<unsigned char> m_Values;
+
+    static UniformStatistics s_Statistics;
+};
@@ -0,0 +1,123 @@
+/**
+ * Sorted, batched submission of draws.
+ *
+ * Draws are submitted in any order with a 64-bit sort key and radix-sorted
+ * once per frame, so draws that share a program, texture set, material and
+ * mesh end up next to each other. Runs of such draws with the same
+ * transform (the meshlet ranges of one object) are merged into one
+ * glMultiDrawElements. Instanced bodies such as the asteroid belt are drawn
+ * outside the queue by an InstanceRenderer (see Instancing.h).
+ *
+ * The queue works on existing programs and vertex arrays. A program is
+ * registered with callbacks that upload its per-material and per-object
+ * values; everything else is bound through the StateCache.
+ *
+ * Key layout, most significant first:
+ *   opaque:       pass (4) | state (36) | depth (24)
+ *   transparent:  pass (4) | inverted depth (24) | state (36)
+ * where state is program (6) | texture set (8) | material (10) | mesh (12).
+ * Opaque draws are grouped by state and go front to back within a group;
+ * transparent draws go strictly back to front and only merge with
+ * neighbours that happen to share their state.
+ */
+#pragma once
+
+#include <functional>
+#include <vector>
+
+enum RenderPass
+{
+    RENDER_PASS_OPAQUE,         // Front to back.
+    RENDER_PASS_TRANSPARENT,    // Back to front.
+    RENDER_PASS_COUNT
+};
+
+struct TextureBinding
+{
+    GLuint unit;
+    GLenum target;
+    GLuint texture;
+};
+
+// One submitted draw.
+struct RenderItem
+{
+    GLuint vao;
+    GLenum indexType;
+    GLsizei indexCount;
+    const void* indexOffset;
+    glm::mat4 model;
+    glm::mat4 modelViewProjection;  // Filled in by Flush.
+    glm::vec4 color;
+    int material;           // Passed to the program's material callback.
+};
+
+// How the queue drives a registered program.
+struct ProgramBinding
+{
+    GLuint program;
+    std::function<void()> bind;                             // After glUseProgram.
+    std::function<void( int material )> setMaterial;
+    std::function<void( const RenderItem& item )> setObject;
+};
+
+struct RenderQueueStatistics
+{
+    size_t items;
+    size_t batches;         // Draw calls issued.
+    size_t multiDrawBatches;
+    size_t stateChanges;    // Program, texture set, material and mesh switches.
+    double sortMs;
+};
+
+class RenderQueue
+{
+public:
+
+    RenderQueue();
+
+    // The matrix Flush multiplies every item's model matrix by.
+    void SetViewProjection( const glm::mat4& viewProjection );
+
+    // Ids are 0-based and limited by the key layout (64 programs, 256
+    // texture sets). Texture set 0 is the empty set.
+    int RegisterProgram( const ProgramBinding& binding );
+    int RegisterTextureSet( const std::vector<TextureBinding>& textures );
+
+    // depth is the view distance; it orders draws inside a pass.
+    void Submit( RenderPass pass, int program, int textureSet, const RenderItem& item, float depth );
+
+    // Sort, batch and draw everything submitted since the last flush.
+    void Flush();
+
+    const RenderQueueStatistics& GetStatistics() const;
+
+    // Pack a sort key. depth is clamped to [0, maxDepth].
+    static uint64_t MakeSortKey( RenderPass pass, int program, int textureSet, int material, int mesh, float depth );
+
+    // Sort ( key, item index ) pairs by key, stable, 8 bits per pass.
+    static void RadixSort( std::vector<uint64_t>& keys, std::vector<uint32_t>& values, std::vector<uint64_t>& scratchKeys, std::vector<uint32_t>& scratchValues );
+
+    void Destroy();
+
+private:
+
+    int GetMeshId( GLuint vao );
+
+    // Draw items [begin, end) of the sorted order, which share a key
+    // prefix and a transform, as one batch.
+    void DrawMulti( size_t begin, size_t end );
+
+    std::vector<ProgramBinding> m_Programs;
+    std::vector<std::vector<TextureBinding> > m_TextureSets;
+    std::vector<GLuint> m_Meshes;           // vao per mesh id
+    std::vector<RenderItem> m_Items;
+    std::vector<uint64_t> m_Keys;
+    std::vector<uint32_t> m_Order;
+    std::vector<uint64_t> m_ScratchKeys;
+    std::vector<uint32_t> m_ScratchOrder;
+    std::vector<GLsizei> m_Counts;
+    std::vector<const void*> m_Offsets;
+    glm::mat4 m_ViewProjection;
+    RenderQueueStatistics m_Statistics;
+};
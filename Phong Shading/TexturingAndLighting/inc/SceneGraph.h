@@ -0,0 +1,78 @@
+/**
+ * Transform hierarchy stored as structure-of-arrays.
+ *
+ * Every node has a parent index, a local translation, rotation and uniform
+ * scale, and cached local and world matrices, each in its own array. A node
+ * can only be created after its parent, so the arrays are always sorted
+ * parent before child and the world matrices are brought up to date with a
+ * single linear pass: a node is recomputed when it was changed or its parent
+ * was recomputed in the same pass. The pass starts at the first changed node
+ * and does nothing when no node changed.
+ *
+ * Local matrices are translate * rotate * scale. An orbit is a rotating pivot
+ * node with the orbiting body as a translated child.
+ */
+#pragma once
+
+typedef int SceneNode;
+const SceneNode SCENE_NODE_NONE = -1;
+
+struct SceneGraphStatistics
+{
+    size_t nodes;
+    size_t localsUpdated;
+    size_t worldsUpdated;
+    double updateMs;
+};
+
+class SceneGraph
+{
+public:
+
+    SceneGraph();
+
+    // parent must be SCENE_NODE_NONE or an existing node.
+    SceneNode CreateNode( SceneNode parent, const glm::vec3& translation = glm::vec3( 0 ), const glm::quat& rotation = glm::quat(), float scale = 1.0f );
+
+    void SetTranslation( SceneNode node, const glm::vec3& translation );
+    void SetRotation( SceneNode node, const glm::quat& rotation );
+    void SetScale( SceneNode node, float scale );
+
+    SceneNode GetParent( SceneNode node ) const;
+    size_t GetNodeCount() const;
+
+    // Recompute the local and world matrices of the changed nodes and their
+    // descendants.
+    void Update();
+
+    // Valid after Update(). The array is indexed by node and only reallocated
+    // by CreateNode.
+    const glm::mat4& GetWorldMatrix( SceneNode node ) const;
+    const glm::mat4* GetWorldMatrices() const;
+
+    const SceneGraphStatistics& GetStatistics() const;
+
+    void Clear();
+
+private:
+
+    void MarkDirty( SceneNode node );
+
+    std::vector<SceneNode> m_Parents;
+    std::vector<glm::vec3> m_Translations;
+    std::vector<glm::quat> m_Rotations;
+    std::vector<float> m_Scales;
+    std::vector<glm::mat4> m_Locals;
+    std::vector<glm::mat4> m_Worlds;
+    std::vector<unsigned char> m_Dirty;     // Local transform changed since the last update.
+    std::vector<unsigned int> m_Updated;    // Pass in which the world matrix was last recomputed.
+    unsigned int m_Pass;
+    size_t m_FirstDirty;
+    SceneGraphStatistics m_Statistics;
+};
+
+// Builds orbital systems of about nodeCount nodes, times full, partial and
+// idle updates and checks the world matrices against recomputing every chain
+// from scratch. Does not need a GL context. Returns 0 on success, 1 if the
+// results differ.
+int BenchmarkSceneGraph( size_t nodeCount );
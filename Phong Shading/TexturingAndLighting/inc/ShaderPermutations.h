@@ -0,0 +1,109 @@
+/**
+ * Compile-time shader permutations.
+ *
+ * A shader pair declares its features as preprocessor switches. Every
+ * variant is compiled with one "#define NAME value" line per feature inserted
+ * after the #version line, so the shaders test features with #if and each
+ * variant contains only the code it needs. A feature of n bits takes values
+ * in [0, 2^n); the values of all features are packed into a ShaderKey.
+ *
+ * Sources come from a ShaderPreprocessor, so the shaders may #include shared
+ * files. Variants are restored from a ProgramCache when one is set, or else
+ * submitted to a ProgramCompiler the first time they are asked for, and kept
+ * until Destroy(). A submitted variant is not ready until the compiler
+ * completes it; callers draw with a fallback variant meanwhile.
+ * PrintReport lists the variants compiled so far with their compile time
+ * and program binary size.
+ */
+#pragma once
+
+#include <ProgramCompiler.h>
+#include <ProgramReflection.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+
+class ProgramCache;
+class ShaderPreprocessor;
+
+typedef uint32_t ShaderKey;
+
+// A #define switch. Undefined features are not allowed in #if, so every
+// feature is always defined, to 0 when it is off.
+struct ShaderFeature
+{
+    std::string name;
+    int bits;
+};
+
+struct ShaderVariant
+{
+    ShaderKey key;
+    bool ready;                 // False while the variant is compiling.
+    GLuint program;             // 0 if the variant failed to compile or link.
+    ProgramReflection reflection;
+    double compileMs;           // From the first request until ready, or restore when cached.
+    bool cached;                // Restored from the program cache.
+    GLint binaryBytes;          // 0 when program binaries are not supported.
+};
+
+class ShaderPermutations
+{
+public:
+
+    // Called once when a variant is ready, with the program bound, to bind its
+    // uniform blocks and set its samplers.
+    typedef std::function<void( ShaderVariant& variant )> SetupFunction;
+
+    ShaderPermutations();
+
+    // Read both sources. Returns false if either file or one of their
+    // includes can not be read. Variants are built by compiler.
+    bool Create( ProgramCompiler& compiler, ShaderPreprocessor& preprocessor, const std::string& vertexFile, const std::string& fragmentFile, const std::vector<ShaderFeature>& features, const SetupFunction& setup );
+
+    // #define lines every variant gets ahead of its feature switches, for
+    // constants the shaders share with the C++ side. Set before the first
+    // GetVariant.
+    void SetSharedDefines( const std::string& defines );
+
+    // Restore variants from cache and store the ones built from source.
+    // NULL, the default, builds every variant.
+    void SetProgramCache( ProgramCache* cache );
+
+    // Key manipulation; does not touch GL.
+    ShaderKey SetFeature( ShaderKey key, int feature, int value ) const;
+    int GetFeature( ShaderKey key, int feature ) const;
+
+    // The #define lines of a variant.
+    std::string GetDefines( ShaderKey key ) const;
+
+    // The variant for key, restored or submitted on first use. Check ready
+    // before using the program.
+    const ShaderVariant& GetVariant( ShaderKey key );
+
+    size_t GetVariantCount() const;
+    size_t GetPendingCount() const;     // Variants still compiling.
+    void PrintReport( std::ostream& out ) const;
+
+    void Destroy();
+
+private:
+
+    void Finalize( ShaderVariant& variant, std::chrono::steady_clock::time_point start );
+
+    ProgramCompiler* m_Compiler;
+    ShaderPreprocessor* m_Preprocessor;
+
+    std::string m_VertexFile;
+    std::string m_FragmentFile;
+    std::vector<ShaderFeature> m_Features;
+    std::vector<int> m_Shifts;      // Bit offset of every feature in a key.
+    std::string m_SharedDefines;
+    SetupFunction m_Setup;
+    ProgramCache* m_Cache;
+    size_t m_PendingCount;
+    std::map<ShaderKey, std::unique_ptr<ShaderVariant>> m_Variants;
+};
@@ -0,0 +1,73 @@
+/**
+ * GLSL preprocessing ahead of the driver: #include and injected #defines.
+ *
+ * #include "file" pastes a file in place, resolved relative to the file that
+ * includes it. A file is pasted once per shader, so shared files need no
+ * include guards. Includes are expanded before the driver sees the source,
+ * so an #include inside a disabled #if block is still pasted.
+ *
+ * Each pasted file gets a source string number in the #line directives, so
+ * the driver reports errors as file:line. ShaderSource::name lists the
+ * numbers of the included files; the shader's own file is 0.
+ *
+ * Files are mapped, copied and hashed the first time they are read. Later
+ * requests reuse the copy and its hash unless the file's size or
+ * modification time changed. The hash of a preprocessed shader chains the
+ * hashes of its files and its defines, so the caches keyed on it never hash
+ * source text again.
+ */
+#pragma once
+
+#include <ProgramCompiler.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+struct ShaderPreprocessorStatistics
+{
+    size_t reads;           // Files mapped and hashed.
+    size_t reuses;          // Requests served from memory.
+    size_t bytesRead;
+};
+
+class ShaderPreprocessor
+{
+public:
+
+    ShaderPreprocessor();
+
+    // Expand file into shader, with defines ("#define NAME value" lines)
+    // inserted after its #version line. hash identifies the result. Returns
+    // false, after printing why, if the file or one of its includes can not
+    // be read.
+    bool Preprocess( GLenum type, const std::string& file, const std::string& defines, ShaderSource& shader, uint64_t& hash );
+
+    const ShaderPreprocessorStatistics& GetStatistics() const;
+    void PrintStatistics( std::ostream& out ) const;
+
+private:
+
+    struct SourceFile
+    {
+        uint64_t size;
+        int64_t modified;
+        std::string text;
+        uint64_t hash;
+    };
+
+    // Everything pasted into one shader so far.
+    struct Expansion
+    {
+        std::vector<std::string> files;     // Index is the source string number.
+        std::string text;
+        uint64_t hash;
+    };
+
+    const SourceFile* GetFile( const std::string& path );
+    bool Expand( const std::string& path, const std::string& text, size_t begin, int firstLine, Expansion& expansion );
+
+    std::map<std::string, SourceFile> m_Files;
+    ShaderPreprocessorStatistics m_Statistics;
+};
@@ -0,0 +1,109 @@
+/**
+ * Retained-mode versions of the freeglut solid primitives.
+ *
+ * glutSolidSphere and friends rebuild their geometry with immediate-mode calls
+ * (and recompute their sin/cos tables) on every call. ShapeLibrary generates a
+ * shape the first time it is drawn with a given set of parameters, appends it
+ * to one shared vertex/index buffer pair and remembers where it went. Every
+ * later draw with the same parameters is a single glDrawElements.
+ *
+ * Shapes use the freeglut conventions (z is the axis of the sphere, cone,
+ * cylinder and torus; the cone and cylinder sit on z = 0). Vertices carry a
+ * float position and a snorm 10:10:10:2 normal, so draw them with a shader
+ * that reads POSITION_ATTRIBUTE and optionally NORMAL_ATTRIBUTE.
+ */
+#pragma once
+
+#include <Mesh.h>
+
+#include <map>
+#include <unordered_map>
+
+class ShapeLibrary
+{
+public:
+
+    struct Statistics
+    {
+        size_t shapes;          // Distinct shapes generated.
+        size_t draws;
+        size_t cacheMisses;     // Draws that had to generate their shape.
+        size_t arenaGrowths;    // Times the shared buffers were reallocated.
+        size_t vertexBytes;
+        size_t indexBytes;
+    };
+
+    ShapeLibrary();
+
+    void DrawSphere( float radius, int slices, int stacks );
+    void DrawCone( float base, float height, int slices, int stacks );
+    void DrawCylinder( float radius, float height, int slices, int stacks );
+    void DrawTorus( float innerRadius, float outerRadius, int sides, int rings );
+    void DrawCube( float size );
+    void DrawTetrahedron();
+    void DrawOctahedron();
+    void DrawDodecahedron();
+    void DrawIcosahedron();
+    void DrawRhombicDodecahedron();
+    void DrawSierpinskiSponge( int levels, const glm::vec3& offset, float scale );
+
+    const Statistics& GetStatistics() const;
+
+    // Release the GL objects. The library can be used again afterwards.
+    void Destroy();
+
+private:
+
+    enum ShapeType
+    {
+        SHAPE_SPHERE,
+        SHAPE_CONE,
+        SHAPE_CYLINDER,
+        SHAPE_TORUS,
+        SHAPE_CUBE,
+        SHAPE_TETRAHEDRON,
+        SHAPE_OCTAHEDRON,
+        SHAPE_DODECAHEDRON,
+        SHAPE_ICOSAHEDRON,
+        SHAPE_RHOMBIC_DODECAHEDRON,
+        SHAPE_SIERPINSKI_SPONGE
+    };
+
+    // Where a shape lives in the shared index buffer. Indices are stored
+    // relative to the start of the vertex buffer.
+    struct Range
+    {
+        GLsizei indexCount;
+        size_t firstIndex;
+    };
+
+    uint64_t GetKey( ShapeType type, float p0 = 0, float p1 = 0, float p2 = 0, float p3 = 0, float p4 = 0 ) const;
+
+    // Draw the shape stored under key, or generate it with generate() first.
+    template<typename Generator>
+    void Draw( uint64_t key, Generator generate );
+
+    Range Append( const MeshData& data );
+    void Reserve( size_t vertexCount, size_t indexCount );
+
+    // cos/sin of n + 1 evenly spaced angles around the circle; the last entry
+    // repeats the first. A negative n walks the circle backwards.
+    const std::vector<glm::vec2>& GetCircleTable( int n );
+
+    MeshData GenerateSphere( float radius, int slices, int stacks );
+    MeshData GenerateCone( float base, float height, int slices, int stacks );
+    MeshData GenerateCylinder( float radius, float height, int slices, int stacks );
+    MeshData GenerateTorus( float innerRadius, float outerRadius, int sides, int rings );
+
+    GLuint m_vao;
+    GLuint m_VertexBuffer;
+    GLuint m_IndexBuffer;
+    size_t m_VertexCount;
+    size_t m_VertexCapacity;
+    size_t m_IndexCount;
+    size_t m_IndexCapacity;
+
+    std::unordered_map<uint64_t, Range> m_Shapes;
+    std::map<int, std::vector<glm::vec2>> m_CircleTables;
+    Statistics m_Statistics;
+};
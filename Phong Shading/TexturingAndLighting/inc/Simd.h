@@ -0,0 +1,22 @@
+/**
+ * Compile-time SIMD feature selection.
+ *
+ * MSVC does not define __SSE2__/__AVX__ the way gcc and clang do, so the
+ * instruction sets are derived from the target architecture here and the
+ * rest of the code only tests SIMD_SSE2 and SIMD_AVX.
+ */
+#pragma once
+
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#define SIMD_SSE2 1
+#include <emmintrin.h>
+#else
+#define SIMD_SSE2 0
+#endif
+
+#if defined(__AVX__)
+#define SIMD_AVX 1
+#include <immintrin.h>
+#else
+#define SIMD_AVX 0
+#endif
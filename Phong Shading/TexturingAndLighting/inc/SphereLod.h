@@ -0,0 +1,72 @@
+/**
+ * Level-of-detail chain for sphere meshes with screen-space-error selection.
+ *
+ * The chain holds geodesic and UV spheres sorted from coarsest to finest.
+ * Each level stores its geometric error on the unit sphere: the largest
+ * distance between a triangle and the true surface. The selector projects
+ * that error to pixels and picks the cheapest level below a pixel threshold.
+ */
+#pragma once
+
+#include <Meshlet.h>
+
+class Camera;
+
+struct LodStatistics
+{
+    size_t objects;
+    size_t trianglesDrawn;
+    size_t trianglesBaseline;  // What the fixed 32x32 UV sphere would have drawn.
+};
+
+// Triangles saved compared with the fixed sphere; negative when close-ups refine past it.
+inline long long GetTrianglesSaved( const LodStatistics& statistics )
+{
+    return (long long)statistics.trianglesBaseline - (long long)statistics.trianglesDrawn;
+}
+
+class SphereLodChain
+{
+public:
+
+    struct Level
+    {
+        Mesh mesh;
+        std::vector<Meshlet> meshlets;
+        std::string name;
+        size_t triangleCount;
+        float geometricError;   // On the unit sphere.
+    };
+
+    SphereLodChain();
+
+    // Generate, optimize and upload the levels. Levels that are neither
+    // cheaper nor more accurate than another level are dropped.
+    void Build( VertexFormat format );
+    bool IsBuilt() const;
+
+    int GetLevelCount() const;
+    const Level& GetLevel( int level ) const;
+
+    // Pick a level for an object. pixelsPerUnit is the projected size in pixels
+    // of one object-space unit (see GetPixelsPerUnit). Refining happens as soon
+    // as the current level exceeds pixelThreshold; coarsening only once the
+    // coarser level is below pixelThreshold * ( 1 - hysteresis ), so objects
+    // near a switching distance do not pop back and forth.
+    int SelectLevel( float pixelsPerUnit, int currentLevel, float pixelThreshold, float hysteresis ) const;
+
+    // Account for drawing level in the per-frame statistics.
+    void CountDraw( int level, LodStatistics& statistics ) const;
+
+    // Largest distance between a triangle plane and the unit sphere.
+    static float ComputeGeometricError( const MeshData& unitSphere );
+
+private:
+
+    std::vector<Level> m_Levels;
+    size_t m_BaselineTriangleCount;
+};
+
+// Projected size in pixels of one unit of object-space length for an object
+// with the given world scale at distance from the camera.
+float GetPixelsPerUnit( Camera& camera, float scale, float distance );
@@ -0,0 +1,133 @@
+/**
+ * Shadow copy of the GL binding state that drops redundant calls.
+ *
+ * The frame binds the same program, textures and vertex arrays every frame,
+ * and most of those binds do not change anything. StateCache remembers what
+ * it last set and only forwards calls that change the state. Everything
+ * starts out unknown, so the first call for each binding is always issued.
+ *
+ * The cache only knows about calls made through it. Code that binds objects
+ * directly (SOIL, the LUT upload) must run before the first frame or be
+ * followed by Invalidate(). Deleting a bound object resets its binding to 0,
+ * so the Forget* functions must be called when buffers, vertex arrays,
+ * textures or programs are deleted.
+ *
+ * In validation mode every elided call is checked against glGet* first, and
+ * Validate() compares the whole shadow state.
+ */
+#pragma once
+
+struct StateCacheStatistics
+{
+    size_t issued;      // Calls forwarded to GL.
+    size_t elided;      // Calls dropped because the state was already set.
+    size_t mismatches;  // Shadow state that differed from GL (validation mode).
+};
+
+class StateCache
+{
+public:
+
+    static const int MAX_TEXTURE_UNITS = 16;
+
+    StateCache();
+
+    // Forget everything; the next call for every binding is issued.
+    void Invalidate();
+
+    void UseProgram( GLuint program );
+    void BindVertexArray( GLuint vao );
+
+    // GL_ELEMENT_ARRAY_BUFFER is part of the vertex array state and is
+    // forgotten whenever the vertex array changes.
+    void BindBuffer( GLenum target, GLuint buffer );
+    void BindBufferRange( GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size );
+
+    void ActiveTexture( GLuint unit );
+    // Bind to the active unit.
+    void BindTexture( GLenum target, GLuint texture );
+    // Bind to a unit, switching the active unit only when the binding changes.
+    void BindTexture( GLuint unit, GLenum target, GLuint texture );
+    void BindSampler( GLuint unit, GLuint sampler );
+
+    void Enable( GLenum capability );
+    void Disable( GLenum capability );
+
+    // Reset shadow bindings of deleted objects to 0, as GL does.
+    void ForgetProgram( GLuint program );
+    void ForgetVertexArray( GLuint vao );
+    void ForgetBuffer( GLuint buffer );
+    void ForgetTexture( GLuint texture );
+
+    // Check elided calls and Validate() against the real GL state.
+    void SetValidation( bool enabled );
+    bool IsValidating() const;
+
+    // Compare every known binding with glGet*; returns false on a mismatch.
+    bool Validate();
+
+    const StateCacheStatistics& GetStatistics() const;
+    void ResetStatistics();
+
+private:
+
+    enum BufferTarget
+    {
+        BUFFER_ARRAY,
+        BUFFER_ELEMENT_ARRAY,
+        BUFFER_UNIFORM,
+        BUFFER_COPY_READ,
+        BUFFER_COPY_WRITE,
+        BUFFER_PIXEL_PACK,
+        BUFFER_PIXEL_UNPACK,
+        BUFFER_TARGET_COUNT
+    };
+
+    enum TextureTarget
+    {
+        TEXTURE_1D,
+        TEXTURE_2D,
+        TEXTURE_3D,
+        TEXTURE_2D_ARRAY,
+        TEXTURE_CUBE_MAP,
+        TEXTURE_TARGET_COUNT
+    };
+
+    enum Capability
+    {
+        CAPABILITY_DEPTH_TEST,
+        CAPABILITY_CULL_FACE,
+        CAPABILITY_BLEND,
+        CAPABILITY_SCISSOR_TEST,
+        CAPABILITY_STENCIL_TEST,
+        CAPABILITY_POLYGON_OFFSET_FILL,
+        CAPABILITY_COUNT
+    };
+
+    // Index into the shadow arrays, -1 for enums that are not tracked.
+    static int GetBufferTarget( GLenum target );
+    static int GetTextureTarget( GLenum target );
+    static int GetCapability( GLenum capability );
+
+    // Record an elided call; in validation mode compare the shadow value
+    // with glGet and return false if they differ, so the call is issued.
+    bool Elide( GLenum binding, GLuint expected );
+    bool ElideUnitBinding( GLuint unit, GLenum binding, GLuint expected );
+    bool ElideCapability( GLenum capability, bool expected );
+    bool Check( const char* what, GLint actual, GLint expected );
+
+    void SetCapability( GLenum capability, bool enabled );
+
+    GLuint m_Program;
+    GLuint m_VertexArray;
+    GLuint m_Buffers[BUFFER_TARGET_COUNT];
+    GLuint m_ActiveUnit;
+    GLuint m_Textures[MAX_TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+    GLuint m_Samplers[MAX_TEXTURE_UNITS];
+    int m_Capabilities[CAPABILITY_COUNT];   // 0, 1 or UNKNOWN
+    bool m_Validate;
+    StateCacheStatistics m_Statistics;
+};
+
+// The cache for the window's context.
+StateCache& GetStateCache();
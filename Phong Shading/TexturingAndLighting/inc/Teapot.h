@@ -0,0 +1,61 @@
+/**
+ * CPU tessellation of Newell's teapot.
+ *
+ * freeglut's fghTeapot feeds the ten teapot patches to GL evaluators and
+ * mirrors them on every call. Here the 32 mirrored bicubic Bezier patches are
+ * built once and evaluated on the CPU into a uniform grid per patch. Every
+ * patch uses the same density, so the edges shared by neighbouring patches are
+ * sampled at the same parameters; the tessellated vertices are then welded so
+ * the mesh is watertight and smooth across patch boundaries.
+ *
+ * The mesh matches glutSolidTeapot( 1 ): y up, centred on the origin.
+ */
+#pragma once
+
+#include <Mesh.h>
+
+#include <map>
+
+// Bicubic Bezier patch; points[v * 4 + u].
+struct BezierPatch
+{
+    glm::vec3 points[16];
+};
+
+const int TEAPOT_PATCH_COUNT = 32;
+const int TEAPOT_MAX_SEGMENTS = 64;
+
+// The 32 teapot patches in the glutSolidTeapot( 1 ) frame.
+const std::vector<BezierPatch>& GetTeapotPatches();
+
+// Segments per patch edge so the tessellation is within maxError units of the
+// true surface everywhere. The result is rounded up to one of a few fixed
+// densities so the mesh cache holds only a handful of meshes.
+int ChooseTeapotSegments( float maxError );
+
+// Evaluate ( segments + 1 )^2 positions and unit normals per patch into
+// consecutive per-patch grids (u fastest). Uses SSE where available.
+void TessellatePatches( const BezierPatch* patches, int patchCount, int segments, glm::vec3* positions, glm::vec3* normals );
+
+// Scalar version of TessellatePatches used to check it.
+void TessellatePatchesReference( const BezierPatch* patches, int patchCount, int segments, glm::vec3* positions, glm::vec3* normals );
+
+// Tessellate and weld the whole teapot. Texture coordinates are the patch
+// parameters, as in fghTeapot.
+MeshData TessellateTeapot( int segments );
+
+// Tessellation throughput with and without SIMD. Does not need a GL context.
+int BenchmarkTeapot();
+
+// Uploaded teapot meshes by density and vertex format.
+class TeapotCache
+{
+public:
+
+    const Mesh& GetMesh( int segments, VertexFormat format );
+    void Destroy();
+
+private:
+
+    std::map<std::pair<int, int>, Mesh> m_Meshes;
+};
@@ -0,0 +1,21 @@
+/**
+ * Batched matrix products.
+ *
+ * Multiplies one matrix (usually the camera's view-projection) by many model
+ * matrices with SSE, keeping the left matrix in registers. Source and
+ * destination are strided, so the models can be read from and the results
+ * written straight into interleaved arrays such as RenderItems,
+ * ObjectUniforms blocks or a mapped instance buffer. Falls back to glm::mat4
+ * when the target has no SSE2 (see Simd.h).
+ */
+#pragma once
+
+// For i in [0, count): the matrix at destination + i * destinationStride
+// becomes left * the matrix at models + i * modelStride. Strides are in
+// bytes; neither side needs to be aligned.
+void MultiplyMatrices( const glm::mat4& left, const void* models, size_t modelStride, size_t count, void* destination, size_t destinationStride );
+
+// Model-view-projection throughput for the per-object scalar path, the
+// cached view-projection and the batch. Does not need a GL context. Returns
+// 0 on success, 1 if the results differ.
+int BenchmarkTransformBatch( size_t count );
@@ -0,0 +1,55 @@
+/**
+ * std140 uniform blocks shared by the C++ code and texturedDiffuse.vert/frag.
+ *
+ * The layouts must match the blocks declared in the shaders member for member.
+ * Every member is a vec4, a mat4 or a group of four scalars, so the std140
+ * rules add no hidden padding and the C++ structs can be copied as they are.
+ */
+#pragma once
+
+// Uniform buffer binding points.
+enum UniformBlockBinding
+{
+    UNIFORM_BLOCK_FRAME = 0,
+    UNIFORM_BLOCK_MATERIAL = 1,
+    UNIFORM_BLOCK_OBJECT = 2,
+    UNIFORM_BLOCK_MATERIAL_TABLE = 3
+};
+
+// Size of the material table read by the instanced shader.
+const int MAX_INSTANCE_MATERIALS = 16;
+
+// Written once per frame.
+struct FrameUniforms
+{
+    glm::vec4 eyePosW;          // Eye position in world space.
+    glm::vec4 lightPosW;        // Light's position in world space.
+    glm::vec4 lightColor;       // Light's diffuse and specular contribution.
+    glm::vec4 ambient;          // Global ambient contribution.
+    glm::vec4 lutScaleBias;     // Maps [0,1] onto the first and last texel centers of a LUT layer.
+    glm::mat4 viewProjection;
+};
+
+// Written once per frame for every material that is drawn, or as an array of
+// MAX_INSTANCE_MATERIALS for the instanced shader.
+struct MaterialUniforms
+{
+    glm::vec4 emissive;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    float shininess;
+    GLint lutLayer;
+    float lutWarpExponent;      // The layer is indexed by pow(N.H, lutWarpExponent).
+    float padding;
+};
+
+// Written for every draw.
+struct ObjectUniforms
+{
+    glm::mat4 modelViewProjection;
+    glm::mat4 model;
+};
+
+static_assert( sizeof(FrameUniforms) == 144, "FrameUniforms does not match the std140 layout" );
+static_assert( sizeof(MaterialUniforms) == 64, "MaterialUniforms does not match the std140 layout" );
+static_assert( sizeof(ObjectUniforms) == 128, "ObjectUniforms does not match the std140 layout" );
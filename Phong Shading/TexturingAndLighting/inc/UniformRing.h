@@ -0,0 +1,68 @@
+/**
+ * Per-frame ring of uniform block data.
+ *
+ * One buffer object is split into three regions, one per frame in flight.
+ * Blocks written during a frame are appended to the current region and bound
+ * with glBindBufferRange, so a draw costs one bind instead of a glUniform call
+ * per value. At the end of the frame a fence is inserted; the region is only
+ * written again once that fence has signalled, three frames later.
+ *
+ * With GL 4.4 or ARB_buffer_storage the buffer is mapped once, persistently
+ * and coherently, and blocks are written straight into it. Otherwise every
+ * block is uploaded with glBufferSubData, which still avoids per-uniform calls.
+ */
+#pragma once
+
+const int UNIFORM_RING_FRAMES = 3;
+
+struct UniformRingStatistics
+{
+    size_t blocks;          // Blocks written this frame.
+    size_t bytes;           // Bytes used in this frame's region, alignment included.
+    size_t overflows;       // Blocks that did not fit in the region.
+    double fenceWaitMs;     // Time spent waiting for the region to be released.
+};
+
+class UniformRing
+{
+public:
+
+    UniformRing();
+
+    // Allocate the buffer with regionSize bytes per frame.
+    void Create( size_t regionSize );
+    void Destroy();
+
+    bool IsCreated() const;
+    bool IsPersistent() const;
+
+    // Wait until the GPU has finished with the next region and start
+    // writing into it.
+    void BeginFrame();
+
+    // Fence the region written this frame.
+    void EndFrame();
+
+    // Copy a block into the ring and bind it to a uniform buffer binding
+    // point. Returns false if the region is full.
+    bool Bind( GLuint binding, const void* data, size_t size );
+
+    template<typename Block>
+    bool Bind( GLuint binding, const Block& block )
+    {
+        return Bind( binding, &block, sizeof(Block) );
+    }
+
+    const UniformRingStatistics& GetStatistics() const;
+
+private:
+
+    GLuint m_Buffer;
+    unsigned char* m_Mapped;    // Persistent mapping, NULL without buffer storage.
+    size_t m_RegionSize;
+    size_t m_Alignment;         // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    int m_Frame;                // Region being written.
+    size_t m_Offset;            // Write position inside the region.
+    GLsync m_Fences[UNIFORM_RING_FRAMES];
+    UniformRingStatistics m_Statistics;
+};
@@ -0,0 +1,200 @@
+#include <TextureAndLightingPCH.h>
+#include <BlobCache.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const uint32_t BLOB_MAGIC = 0x424C4F42; // "BLOB"
+    const uint32_t BLOB_VERSION = 1;
+
+    struct BlobHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint64_t payloadSize;
+        uint64_t reserved;
+    };
+
+    int GetProcessId()
+    {
+#ifdef _WIN32
+        return (int)GetCurrentProcessId();
+#else
+        return (int)getpid();
+#endif
+    }
+
+    void MakeDirectory( const std::string& directory )
+    {
+#ifdef _WIN32
+        CreateDirectoryA( directory.c_str(), NULL );
+#else
+        mkdir( directory.c_str(), 0755 );
+#endif
+    }
+
+    // Atomically replace dst with src.
+    bool ReplaceFile( const std::string& src, const std::string& dst )
+    {
+#ifdef _WIN32
+        return MoveFileExA( src.c_str(), dst.c_str(), MOVEFILE_REPLACE_EXISTING ) != 0;
+#else
+        return rename( src.c_str(), dst.c_str() ) == 0;
+#endif
+    }
+
+    bool FileExists( const std::string& path )
+    {
+#ifdef _WIN32
+        return GetFileAttributesA( path.c_str() ) != INVALID_FILE_ATTRIBUTES;
+#else
+        struct stat st;
+        return stat( path.c_str(), &st ) == 0;
+#endif
+    }
+}
+
+BlobCache::Writer::Writer()
+{}
+
+BlobCache::Writer::~Writer()
+{
+    if ( m_File.IsOpen() )
+    {
+        m_File.Close();
+        remove( m_TempPath.c_str() );
+    }
+}
+
+void* BlobCache::Writer::GetPayload()
+{
+    return static_cast<char*>( m_File.GetData() ) + sizeof(BlobHeader);
+}
+
+size_t BlobCache::Writer::GetPayloadSize() const
+{
+    return m_File.GetSize() - sizeof(BlobHeader);
+}
+
+bool BlobCache::Writer::Commit()
+{
+    if ( !m_File.IsOpen() )
+    {
+        return false;
+    }
+    m_File.Close();
+
+    if ( ReplaceFile( m_TempPath, m_FinalPath ) )
+    {
+        return true;
+    }
+
+    // On Windows the rename fails while another process has the published blob
+    // mapped. Its content is identical to ours, so keeping it is fine.
+    remove( m_TempPath.c_str() );
+    return FileExists( m_FinalPath );
+}
+
+BlobCache::BlobCache( const std::string& directory, const std::string& extension )
+    : m_Extension( extension )
+{
+    SetDirectory( directory );
+}
+
+void BlobCache::SetDirectory( const std::string& directory )
+{
+    m_Directory = directory;
+    if ( !m_Directory.empty() )
+    {
+        MakeDirectory( m_Directory );
+    }
+}
+
+const std::string& BlobCache::GetDirectory() const
+{
+    return m_Directory;
+}
+
+bool BlobCache::IsEnabled() const
+{
+    return !m_Directory.empty();
+}
+
+bool BlobCache::Load( uint64_t key, MappedFile& file ) const
+{
+    if ( !IsEnabled() || !file.OpenRead( GetPath( key ) ) )
+    {
+        return false;
+    }
+
+    const BlobHeader* header = static_cast<const BlobHeader*>( file.GetData() );
+    if ( file.GetSize() < sizeof(BlobHeader) ||
+         header->magic != BLOB_MAGIC ||
+         header->version != BLOB_VERSION ||
+         header->key != key ||
+         header->payloadSize != file.GetSize() - sizeof(BlobHeader) )
+    {
+        file.Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool BlobCache::BeginStore( uint64_t key, size_t payloadSize, Writer& writer ) const
+{
+    if ( !IsEnabled() )
+    {
+        return false;
+    }
+
+    static std::atomic<int> s_TempCounter( 0 );
+
+    std::ostringstream tempPath;
+    tempPath << GetPath( key ) << ".tmp." << GetProcessId() << "." << s_TempCounter++;
+
+    writer.m_FinalPath = GetPath( key );
+    writer.m_TempPath = tempPath.str();
+    if ( !writer.m_File.CreateWrite( writer.m_TempPath, sizeof(BlobHeader) + payloadSize ) )
+    {
+        return false;
+    }
+
+    BlobHeader* header = static_cast<BlobHeader*>( writer.m_File.GetData() );
+    header->magic = BLOB_MAGIC;
+    header->version = BLOB_VERSION;
+    header->key = key;
+    header->payloadSize = payloadSize;
+    header->reserved = 0;
+
+    return true;
+}
+
+const void* BlobCache::GetPayload( const MappedFile& file )
+{
+    return static_cast<const char*>( file.GetData() ) + sizeof(BlobHeader);
+}
+
+size_t BlobCache::GetPayloadSize( const MappedFile& file )
+{
+    return file.GetSize() - sizeof(BlobHeader);
+}
+
+std::string BlobCache::GetPath( uint64_t key ) const
+{
+    char name[17];
+    snprintf( name, sizeof(name), "%016llx", (unsigned long long)key );
+    return m_Directory + "/" + name + m_Extension;
+}
@@ -8,6 +8,8 @@ Camera::Camera()
     , m_ProjectionMatrix(1)
     , m_ViewMatrix(1)
     , m_ViewDirty(false)
+    , m_ViewProjectionDirty(true)
+    , m_FrustumDirty(true)
 {}
 
 Camera::Camera( int screenWidth, int screenHeight )
@@ -17,6 +19,8 @@ Camera::Camera( int screenWidth, int screenHeight )
     , m_ProjectionMatrix(1)
     , m_ViewMatrix(1)
     , m_ViewDirty( false )
+    , m_ViewProjectionDirty( true )
+    , m_FrustumDirty( true )
 {
 
 }
@@ -35,6 +39,7 @@ glm::vec4 Camera::GetViewport() const
 void Camera::SetProjectionRH( float fov, float aspectRatio, float zNear, float zFar )
 {
     m_ProjectionMatrix = glm::perspective( glm::radians(fov), aspectRatio, zNear, zFar );
+    m_ViewProjectionDirty = true;
 }
 
 void Camera::ApplyViewMatrix()
@@ -93,12 +98,12 @@ void Camera::Rotate( const glm::quat& rot )
     m_ViewDirty = true;
 }
 
-glm::mat4 Camera::GetProjectionMatrix()
+const glm::mat4& Camera::GetProjectionMatrix() const
 {
     return m_ProjectionMatrix;
 }
 
-glm::mat4 Camera::GetViewMatrix()
+const glm::mat4& Camera::GetViewMatrix()
 {
     UpdateViewMatrix();
     return m_ViewMatrix;
@@ -116,5 +121,29 @@ void Camera::UpdateViewMatrix()
         m_ViewMatrix = rotate * translate;
 
         m_ViewDirty = false;
+        m_ViewProjectionDirty = true;
     }
 }
+
+const glm::mat4& Camera::GetViewProjectionMatrix()
+{
+    UpdateViewMatrix();
+    if ( m_ViewProjectionDirty )
+    {
+        m_ViewProjectionMatrix = m_ProjectionMatrix * m_ViewMatrix;
+        m_ViewProjectionDirty = false;
+        m_FrustumDirty = true;
+    }
+    return m_ViewProjectionMatrix;
+}
+
+const Frustum& Camera::GetFrustum()
+{
+    const glm::mat4& viewProjection = GetViewProjectionMatrix();
+    if ( m_FrustumDirty )
+    {
+        m_Frustum = ExtractFrustum( viewProjection );
+        m_FrustumDirty = false;
+    }
+    return m_Frustum;
+}
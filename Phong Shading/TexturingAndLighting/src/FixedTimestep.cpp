@@ -0,0 +1,61 @@
+#include <TextureAndLightingPCH.h>
+#include <FixedTimestep.h>
+
+FixedTimestep::FixedTimestep( Duration step, int maxStepsPerFrame )
+    : m_Step( step )
+    , m_MaxStepsPerFrame( maxStepsPerFrame )
+    , m_Accumulator( 0 )
+    , m_Last( std::chrono::steady_clock::now() )
+    , m_Steps( 0 )
+    , m_Dropped( 0 )
+{}
+
+void FixedTimestep::Reset()
+{
+    m_Accumulator = Duration( 0 );
+    m_Last = std::chrono::steady_clock::now();
+}
+
+int FixedTimestep::Advance()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    Duration elapsed = std::chrono::duration_cast<Duration>( now - m_Last );
+    m_Last = now;
+    return Advance( elapsed );
+}
+
+int FixedTimestep::Advance( Duration elapsed )
+{
+    m_Accumulator += elapsed;
+
+    int64_t steps = m_Accumulator / m_Step;
+    m_Accumulator -= steps * m_Step;
+    if ( steps > m_MaxStepsPerFrame )
+    {
+        m_Dropped += steps - m_MaxStepsPerFrame;
+        steps = m_MaxStepsPerFrame;
+    }
+
+    m_Steps += steps;
+    return (int)steps;
+}
+
+float FixedTimestep::GetAlpha() const
+{
+    return (float)m_Accumulator.count() / (float)m_Step.count();
+}
+
+float FixedTimestep::GetStepSeconds() const
+{
+    return std::chrono::duration<float>( m_Step ).count();
+}
+
+uint64_t FixedTimestep::GetStepCount() const
+{
+    return m_Steps;
+}
+
+uint64_t FixedTimestep::GetDroppedSteps() const
+{
+    return m_Dropped;
+}
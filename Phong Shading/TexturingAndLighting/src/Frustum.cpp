@@ -0,0 +1,316 @@
+#include <TextureAndLightingPCH.h>
+#include <Frustum.h>
+#include <Simd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+Frustum ExtractFrustum( const glm::mat4& viewProjection )
+{
+    // Gribb and Hartmann: each clip plane is the fourth row of the matrix
+    // plus or minus one of the other rows. glm matrices are column major.
+    glm::vec4 rows[4];
+    for ( int i = 0; i < 4; ++i )
+    {
+        rows[i] = glm::vec4( viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i] );
+    }
+
+    Frustum frustum;
+    frustum.planes[FRUSTUM_LEFT] = rows[3] + rows[0];
+    frustum.planes[FRUSTUM_RIGHT] = rows[3] - rows[0];
+    frustum.planes[FRUSTUM_BOTTOM] = rows[3] + rows[1];
+    frustum.planes[FRUSTUM_TOP] = rows[3] - rows[1];
+    frustum.planes[FRUSTUM_NEAR] = rows[3] + rows[2];
+    frustum.planes[FRUSTUM_FAR] = rows[3] - rows[2];
+
+    for ( glm::vec4& plane : frustum.planes )
+    {
+        plane /= glm::length( glm::vec3( plane ) );
+    }
+    return frustum;
+}
+
+bool IntersectsSphere( const Frustum& frustum, const glm::vec3& center, float radius )
+{
+    for ( const glm::vec4& plane : frustum.planes )
+    {
+        if ( glm::dot( glm::vec3( plane ), center ) + plane.w < -radius )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool IntersectsBox( const Frustum& frustum, const glm::vec3& boxMin, const glm::vec3& boxMax )
+{
+    for ( const glm::vec4& plane : frustum.planes )
+    {
+        // The corner farthest along the plane normal.
+        glm::vec3 corner( plane.x >= 0.0f ? boxMax.x : boxMin.x,
+                          plane.y >= 0.0f ? boxMax.y : boxMin.y,
+                          plane.z >= 0.0f ? boxMax.z : boxMin.z );
+        if ( glm::dot( glm::vec3( plane ), corner ) + plane.w < 0.0f )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void BoundingSpheres::Resize( size_t count )
+{
+    x.resize( count );
+    y.resize( count );
+    z.resize( count );
+    radius.resize( count );
+}
+
+size_t BoundingSpheres::Size() const
+{
+    return radius.size();
+}
+
+void BoundingBoxes::Resize( size_t count )
+{
+    minX.resize( count );
+    minY.resize( count );
+    minZ.resize( count );
+    maxX.resize( count );
+    maxY.resize( count );
+    maxZ.resize( count );
+}
+
+size_t BoundingBoxes::Size() const
+{
+    return minX.size();
+}
+
+namespace
+{
+    // Append the lanes set in mask. Every lane is written and the count only
+    // advances past the visible ones, so there is no branch per lane; the
+    // writes stay inside visible because count never exceeds the index.
+    inline size_t AppendVisible( int mask, int lanes, size_t first, uint32_t* visible, size_t count )
+    {
+        for ( int lane = 0; lane < lanes; ++lane )
+        {
+            visible[count] = (uint32_t)( first + lane );
+            count += ( mask >> lane ) & 1;
+        }
+        return count;
+    }
+
+    // Per plane, the box bounds that form the corner farthest along the
+    // normal. The sign of a normal is the same for every box, so the choice
+    // is made once per cull instead of once per box.
+    void SelectBoxCorners( const Frustum& frustum, const BoundingBoxes& boxes, const float* corners[FRUSTUM_PLANE_COUNT][3] )
+    {
+        for ( int p = 0; p < FRUSTUM_PLANE_COUNT; ++p )
+        {
+            const glm::vec4& plane = frustum.planes[p];
+            corners[p][0] = plane.x >= 0.0f ? boxes.maxX.data() : boxes.minX.data();
+            corners[p][1] = plane.y >= 0.0f ? boxes.maxY.data() : boxes.minY.data();
+            corners[p][2] = plane.z >= 0.0f ? boxes.maxZ.data() : boxes.minZ.data();
+        }
+    }
+}
+
+size_t CullSpheres( const Frustum& frustum, const BoundingSpheres& spheres, uint32_t* visible )
+{
+    const size_t count = spheres.Size();
+    const float* x = spheres.x.data();
+    const float* y = spheres.y.data();
+    const float* z = spheres.z.data();
+    const float* radius = spheres.radius.data();
+    const glm::vec4* planes = frustum.planes;
+
+    size_t visibleCount = 0;
+    size_t i = 0;
+
+    // The distances are summed in the same order as IntersectsSphere, so
+    // every path gives the same result.
+#if SIMD_AVX
+    for ( ; i + 8 <= count; i += 8 )
+    {
+        __m256 cx = _mm256_loadu_ps( x + i );
+        __m256 cy = _mm256_loadu_ps( y + i );
+        __m256 cz = _mm256_loadu_ps( z + i );
+        __m256 negativeRadius = _mm256_sub_ps( _mm256_setzero_ps(), _mm256_loadu_ps( radius + i ) );
+
+        __m256 inside = _mm256_cmp_ps( _mm256_setzero_ps(), _mm256_setzero_ps(), _CMP_EQ_OQ );
+        for ( int p = 0; p < FRUSTUM_PLANE_COUNT; ++p )
+        {
+            __m256 distance = _mm256_mul_ps( _mm256_set1_ps( planes[p].x ), cx );
+            distance = _mm256_add_ps( distance, _mm256_mul_ps( _mm256_set1_ps( planes[p].y ), cy ) );
+            distance = _mm256_add_ps( distance, _mm256_mul_ps( _mm256_set1_ps( planes[p].z ), cz ) );
+            distance = _mm256_add_ps( distance, _mm256_set1_ps( planes[p].w ) );
+            inside = _mm256_and_ps( inside, _mm256_cmp_ps( distance, negativeRadius, _CMP_GE_OQ ) );
+        }
+        visibleCount = AppendVisible( _mm256_movemask_ps( inside ), 8, i, visible, visibleCount );
+    }
+#endif
+#if SIMD_SSE2
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        __m128 cx = _mm_loadu_ps( x + i );
+        __m128 cy = _mm_loadu_ps( y + i );
+        __m128 cz = _mm_loadu_ps( z + i );
+        __m128 negativeRadius = _mm_sub_ps( _mm_setzero_ps(), _mm_loadu_ps( radius + i ) );
+
+        __m128 inside = _mm_cmpeq_ps( _mm_setzero_ps(), _mm_setzero_ps() );
+        for ( int p = 0; p < FRUSTUM_PLANE_COUNT; ++p )
+        {
+            __m128 distance = _mm_mul_ps( _mm_set1_ps( planes[p].x ), cx );
+            distance = _mm_add_ps( distance, _mm_mul_ps( _mm_set1_ps( planes[p].y ), cy ) );
+            distance = _mm_add_ps( distance, _mm_mul_ps( _mm_set1_ps( planes[p].z ), cz ) );
+            distance = _mm_add_ps( distance, _mm_set1_ps( planes[p].w ) );
+            inside = _mm_and_ps( inside, _mm_cmpge_ps( distance, negativeRadius ) );
+        }
+        visibleCount = AppendVisible( _mm_movemask_ps( inside ), 4, i, visible, visibleCount );
+    }
+#endif
+    for ( ; i < count; ++i )
+    {
+        visible[visibleCount] = (uint32_t)i;
+        visibleCount += IntersectsSphere( frustum, glm::vec3( x[i], y[i], z[i] ), radius[i] ) ? 1 : 0;
+    }
+    return visibleCount;
+}
+
+size_t CullBoxes( const Frustum& frustum, const BoundingBoxes& boxes, uint32_t* visible )
+{
+    const size_t count = boxes.Size();
+    const glm::vec4* planes = frustum.planes;
+    const float* corners[FRUSTUM_PLANE_COUNT][3];
+    SelectBoxCorners( frustum, boxes, corners );
+
+    size_t visibleCount = 0;
+    size_t i = 0;
+
+#if SIMD_AVX
+    for ( ; i + 8 <= count; i += 8 )
+    {
+        __m256 inside = _mm256_cmp_ps( _mm256_setzero_ps(), _mm256_setzero_ps(), _CMP_EQ_OQ );
+        for ( int p = 0; p < FRUSTUM_PLANE_COUNT; ++p )
+        {
+            __m256 distance = _mm256_mul_ps( _mm256_set1_ps( planes[p].x ), _mm256_loadu_ps( corners[p][0] + i ) );
+            distance = _mm256_add_ps( distance, _mm256_mul_ps( _mm256_set1_ps( planes[p].y ), _mm256_loadu_ps( corners[p][1] + i ) ) );
+            distance = _mm256_add_ps( distance, _mm256_mul_ps( _mm256_set1_ps( planes[p].z ), _mm256_loadu_ps( corners[p][2] + i ) ) );
+            distance = _mm256_add_ps( distance, _mm256_set1_ps( planes[p].w ) );
+            inside = _mm256_and_ps( inside, _mm256_cmp_ps( distance, _mm256_setzero_ps(), _CMP_GE_OQ ) );
+        }
+        visibleCount = AppendVisible( _mm256_movemask_ps( inside ), 8, i, visible, visibleCount );
+    }
+#endif
+#if SIMD_SSE2
+    for ( ; i + 4 <= count; i += 4 )
+    {
+        __m128 inside = _mm_cmpeq_ps( _mm_setzero_ps(), _mm_setzero_ps() );
+        for ( int p = 0; p < FRUSTUM_PLANE_COUNT; ++p )
+        {
+            __m128 distance = _mm_mul_ps( _mm_set1_ps( planes[p].x ), _mm_loadu_ps( corners[p][0] + i ) );
+            distance = _mm_add_ps( distance, _mm_mul_ps( _mm_set1_ps( planes[p].y ), _mm_loadu_ps( corners[p][1] + i ) ) );
+            distance = _mm_add_ps( distance, _mm_mul_ps( _mm_set1_ps( planes[p].z ), _mm_loadu_ps( corners[p][2] + i ) ) );
+            distance = _mm_add_ps( distance, _mm_set1_ps( planes[p].w ) );
+            inside = _mm_and_ps( inside, _mm_cmpge_ps( distance, _mm_setzero_ps() ) );
+        }
+        visibleCount = AppendVisible( _mm_movemask_ps( inside ), 4, i, visible, visibleCount );
+    }
+#endif
+    for ( ; i < count; ++i )
+    {
+        glm::vec3 boxMin( boxes.minX[i], boxes.minY[i], boxes.minZ[i] );
+        glm::vec3 boxMax( boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i] );
+        visible[visibleCount] = (uint32_t)i;
+        visibleCount += IntersectsBox( frustum, boxMin, boxMax ) ? 1 : 0;
+    }
+    return visibleCount;
+}
+
+int BenchmarkFrustumCulling( size_t count )
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    // A 60 degree camera at the origin looking down -z, and volumes scattered
+    // through a cube around it; about a tenth of them end up visible.
+    glm::mat4 viewProjection = glm::perspective( glm::radians( 60.0f ), 16.0f / 9.0f, 0.1f, 500.0f ) *
+                               glm::lookAt( glm::vec3( 0 ), glm::vec3( 0, 0, -1 ), glm::vec3( 0, 1, 0 ) );
+    Frustum frustum = ExtractFrustum( viewProjection );
+
+    std::mt19937 random( 1 );
+    std::uniform_real_distribution<float> position( -500.0f, 500.0f );
+    std::uniform_real_distribution<float> size( 0.1f, 5.0f );
+
+    BoundingSpheres spheres;
+    BoundingBoxes boxes;
+    spheres.Resize( count );
+    boxes.Resize( count );
+    for ( size_t i = 0; i < count; ++i )
+    {
+        spheres.x[i] = position( random );
+        spheres.y[i] = position( random );
+        spheres.z[i] = position( random );
+        spheres.radius[i] = size( random );
+
+        glm::vec3 extent( size( random ), size( random ), size( random ) );
+        glm::vec3 center( position( random ), position( random ), position( random ) );
+        boxes.minX[i] = center.x - extent.x;
+        boxes.minY[i] = center.y - extent.y;
+        boxes.minZ[i] = center.z - extent.z;
+        boxes.maxX[i] = center.x + extent.x;
+        boxes.maxY[i] = center.y + extent.y;
+        boxes.maxZ[i] = center.z + extent.z;
+    }
+
+    std::cout << "Frustum culling (" << count << " volumes, "
+              << ( SIMD_AVX ? "AVX" : SIMD_SSE2 ? "SSE2" : "scalar" ) << ")" << std::endl;
+
+    // Enough iterations for roughly 50M volumes.
+    int iterations = (int)std::max<size_t>( 1, 50000000 / std::max<size_t>( count, 1 ) );
+    std::vector<uint32_t> referenceVisible( count ), visible( count );
+    bool matches = true;
+
+    for ( int kind = 0; kind < 2; ++kind )
+    {
+        bool testSpheres = ( kind == 0 );
+
+        size_t referenceCount = 0;
+        Clock::time_point start = Clock::now();
+        for ( int iteration = 0; iteration < iterations; ++iteration )
+        {
+            referenceCount = 0;
+            for ( size_t i = 0; i < count; ++i )
+            {
+                bool inside = testSpheres
+                    ? IntersectsSphere( frustum, glm::vec3( spheres.x[i], spheres.y[i], spheres.z[i] ), spheres.radius[i] )
+                    : IntersectsBox( frustum, glm::vec3( boxes.minX[i], boxes.minY[i], boxes.minZ[i] ), glm::vec3( boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i] ) );
+                if ( inside )
+                {
+                    referenceVisible[referenceCount++] = (uint32_t)i;
+                }
+            }
+        }
+        double referenceSeconds = std::chrono::duration<double>( Clock::now() - start ).count();
+
+        size_t visibleCount = 0;
+        start = Clock::now();
+        for ( int iteration = 0; iteration < iterations; ++iteration )
+        {
+            visibleCount = testSpheres ? CullSpheres( frustum, spheres, visible.data() ) : CullBoxes( frustum, boxes, visible.data() );
+        }
+        double seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+
+        bool same = visibleCount == referenceCount && std::equal( visible.begin(), visible.begin() + visibleCount, referenceVisible.begin() );
+        matches = matches && same;
+
+        double volumes = (double)count * iterations;
+        std::cout << "  " << ( testSpheres ? "spheres" : "boxes" ) << ": one at a time "
+                  << volumes / referenceSeconds / 1.0e6 << " M/s; batch "
+                  << volumes / seconds / 1.0e6 << " M/s (" << referenceSeconds / seconds << "x); "
+                  << visibleCount << " visible" << ( same ? "" : ", RESULTS DIFFER" ) << std::endl;
+    }
+
+    return matches ? 0 : 1;
+}
@@ -0,0 +1,265 @@
+#include <TextureAndLightingPCH.h>
+#include <Instancing.h>
+#include <Camera.h>
+#include <Parallel.h>
+#include <SphereLod.h>
+#include <StateCache.h>
+
+#include <chrono>
+#include <cstring>
+#include <random>
+
+namespace
+{
+    // Bodies per task. Chunks are fixed so the count and fill passes agree
+    // on which instances each chunk writes.
+    const int INSTANCE_CHUNK_SIZE = 16384;
+
+    InstanceData MakeInstance( const InstanceBody& body )
+    {
+        glm::mat3 rotationScale = glm::mat3_cast( body.rotation ) * body.radius;
+
+        InstanceData instance;
+        for ( int row = 0; row < 3; ++row )
+        {
+            instance.rows[row] = glm::vec4( rotationScale[0][row], rotationScale[1][row], rotationScale[2][row], body.position[row] );
+        }
+        instance.material = body.material;
+        instance.layer = body.layer;
+        return instance;
+    }
+}
+
+void BuildInstanceBatch( const std::vector<InstanceBody>& bodies, const Frustum& frustum, Camera& camera, const SphereLodChain& lod, float pixelError, InstanceBatch& batch )
+{
+    auto start = std::chrono::steady_clock::now();
+
+    int bodyCount = (int)bodies.size();
+    int levelCount = lod.GetLevelCount();
+    int chunkCount = ( bodyCount + INSTANCE_CHUNK_SIZE - 1 ) / INSTANCE_CHUNK_SIZE;
+
+    glm::vec3 eye = camera.GetPosition();
+    float pixelsPerUnitAtUnitDistance = GetPixelsPerUnit( camera, 1.0f, 1.0f );
+
+    // Pass 1: cull, select a level and count the instances of every chunk
+    // in every bucket.
+    std::vector<signed char>& levels = batch.levels;
+    levels.resize( bodies.size() );
+    std::vector<size_t> offsets( (size_t)chunkCount * levelCount, 0 );
+    ParallelFor( chunkCount, 1, [&]( int chunkBegin, int chunkEnd )
+    {
+        for ( int chunk = chunkBegin; chunk < chunkEnd; ++chunk )
+        {
+            size_t* counts = &offsets[(size_t)chunk * levelCount];
+            int end = std::min( bodyCount, ( chunk + 1 ) * INSTANCE_CHUNK_SIZE );
+            for ( int i = chunk * INSTANCE_CHUNK_SIZE; i < end; ++i )
+            {
+                const InstanceBody& body = bodies[i];
+                if ( !IntersectsSphere( frustum, body.position, body.radius ) )
+                {
+                    levels[i] = -1;
+                    continue;
+                }
+
+                float distance = std::max( glm::length( body.position - eye ), 1e-4f );
+                int level = lod.SelectLevel( pixelsPerUnitAtUnitDistance * body.radius / distance, 0, pixelError, 0.0f );
+                levels[i] = (signed char)level;
+                ++counts[level];
+            }
+        }
+    } );
+
+    // Buckets are laid out by level; inside a bucket, by chunk. Turn the
+    // counts into write offsets.
+    batch.bucketStarts.assign( levelCount + 1, 0 );
+    size_t visible = 0;
+    for ( int level = 0; level < levelCount; ++level )
+    {
+        batch.bucketStarts[level] = visible;
+        for ( int chunk = 0; chunk < chunkCount; ++chunk )
+        {
+            size_t& offset = offsets[(size_t)chunk * levelCount + level];
+            size_t count = offset;
+            offset = visible;
+            visible += count;
+        }
+    }
+    batch.bucketStarts[levelCount] = visible;
+
+    // Pass 2: write every visible instance at its bucket offset. The vector
+    // only grows, so a steady frame does not allocate.
+    if ( batch.instances.size() < visible )
+    {
+        batch.instances.resize( visible );
+    }
+    InstanceData* instances = batch.instances.data();
+    ParallelFor( chunkCount, 1, [&]( int chunkBegin, int chunkEnd )
+    {
+        for ( int chunk = chunkBegin; chunk < chunkEnd; ++chunk )
+        {
+            size_t* next = &offsets[(size_t)chunk * levelCount];
+            int end = std::min( bodyCount, ( chunk + 1 ) * INSTANCE_CHUNK_SIZE );
+            for ( int i = chunk * INSTANCE_CHUNK_SIZE; i < end; ++i )
+            {
+                int level = levels[i];
+                if ( level >= 0 )
+                {
+                    instances[next[level]++] = MakeInstance( bodies[i] );
+                }
+            }
+        }
+    } );
+
+    batch.statistics = InstanceStatistics();
+    batch.statistics.instances = bodies.size();
+    batch.statistics.visible = visible;
+    batch.statistics.buildMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+InstanceRenderer::InstanceRenderer()
+    : m_InstanceBuffer( 0 )
+    , m_Capacity( 0 )
+    , m_Statistics()
+{}
+
+void InstanceRenderer::Upload( const InstanceBatch& batch )
+{
+    m_BucketStarts = batch.bucketStarts;
+    m_Statistics = batch.statistics;
+
+    size_t visible = batch.statistics.visible;
+    if ( visible == 0 )
+    {
+        return;
+    }
+
+    StateCache& state = GetStateCache();
+    if ( m_InstanceBuffer == 0 )
+    {
+        glGenBuffers( 1, &m_InstanceBuffer );
+    }
+    state.BindBuffer( GL_ARRAY_BUFFER, m_InstanceBuffer );
+    if ( visible > m_Capacity )
+    {
+        m_Capacity = std::max( visible, m_Capacity * 2 );
+        glBufferData( GL_ARRAY_BUFFER, m_Capacity * sizeof(InstanceData), NULL, GL_STREAM_DRAW );
+    }
+
+    // Invalidating lets the driver hand out fresh storage while last
+    // frame's instances are still being drawn.
+    void* instances = glMapBufferRange( GL_ARRAY_BUFFER, 0, visible * sizeof(InstanceData), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT );
+    if ( instances != NULL )
+    {
+        memcpy( instances, batch.instances.data(), visible * sizeof(InstanceData) );
+        glUnmapBuffer( GL_ARRAY_BUFFER );
+    }
+    else
+    {
+        m_BucketStarts.assign( m_BucketStarts.size(), 0 );
+        m_Statistics.visible = 0;
+    }
+    state.BindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+InstanceData MakeInstanceData( const glm::mat4& model, GLushort material, GLushort layer )
+{
+    InstanceData instance;
+    for ( int row = 0; row < 3; ++row )
+    {
+        instance.rows[row] = glm::vec4( model[0][row], model[1][row], model[2][row], model[3][row] );
+    }
+    instance.material = material;
+    instance.layer = layer;
+    return instance;
+}
+
+void SetInstanceAttributes( GLuint vao, GLuint instanceBuffer, size_t firstInstance )
+{
+    StateCache& state = GetStateCache();
+    state.BindVertexArray( vao );
+    state.BindBuffer( GL_ARRAY_BUFFER, instanceBuffer );
+
+    size_t base = firstInstance * sizeof(InstanceData);
+    for ( int row = 0; row < 3; ++row )
+    {
+        GLuint location = INSTANCE_TRANSFORM_ATTRIBUTE + row;
+        glVertexAttribPointer( location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), BUFFER_OFFSET( base + offsetof(InstanceData, rows) + row * sizeof(glm::vec4) ) );
+        glEnableVertexAttribArray( location );
+        glVertexAttribDivisor( location, 1 );
+    }
+    glVertexAttribIPointer( INSTANCE_MATERIAL_ATTRIBUTE, 2, GL_UNSIGNED_SHORT, sizeof(InstanceData), BUFFER_OFFSET( base + offsetof(InstanceData, material) ) );
+    glEnableVertexAttribArray( INSTANCE_MATERIAL_ATTRIBUTE );
+    glVertexAttribDivisor( INSTANCE_MATERIAL_ATTRIBUTE, 1 );
+}
+
+void InstanceRenderer::Draw( const SphereLodChain& lod )
+{
+    if ( m_BucketStarts.size() != (size_t)lod.GetLevelCount() + 1 )
+    {
+        return;
+    }
+
+    for ( int level = 0; level < lod.GetLevelCount(); ++level )
+    {
+        size_t first = m_BucketStarts[level];
+        size_t count = m_BucketStarts[level + 1] - first;
+        if ( count == 0 )
+        {
+            continue;
+        }
+
+        const SphereLodChain::Level& bucket = lod.GetLevel( level );
+        SetInstanceAttributes( bucket.mesh.vao, m_InstanceBuffer, first );
+        glDrawElementsInstanced( GL_TRIANGLES, bucket.mesh.indexCount, bucket.mesh.indexType, BUFFER_OFFSET(0), (GLsizei)count );
+
+        ++m_Statistics.draws;
+        m_Statistics.triangles += count * bucket.triangleCount;
+    }
+}
+
+const InstanceStatistics& InstanceRenderer::GetStatistics() const
+{
+    return m_Statistics;
+}
+
+void InstanceRenderer::Destroy()
+{
+    GetStateCache().ForgetBuffer( m_InstanceBuffer );
+    glDeleteBuffers( 1, &m_InstanceBuffer );
+    m_InstanceBuffer = 0;
+    m_Capacity = 0;
+    m_BucketStarts.clear();
+}
+
+std::vector<InstanceBody> CreateAsteroidBelt( size_t count, float innerRadius, float outerRadius, int materialCount, int layerCount, unsigned int seed )
+{
+    const float _2pi = 2.0f * 3.1415926535897932384626433832795f;
+
+    std::mt19937 random( seed );
+    std::uniform_real_distribution<float> unit( 0.0f, 1.0f );
+    std::uniform_real_distribution<float> signedUnit( -1.0f, 1.0f );
+
+    float thickness = 0.05f * ( outerRadius - innerRadius );
+
+    std::vector<InstanceBody> bodies( count );
+    for ( InstanceBody& body : bodies )
+    {
+        // Uniform over the ring's area.
+        float r = std::sqrt( glm::mix( innerRadius * innerRadius, outerRadius * outerRadius, unit( random ) ) );
+        float angle = _2pi * unit( random );
+        body.position = glm::vec3( r * std::cos( angle ), thickness * signedUnit( random ), r * std::sin( angle ) );
+
+        // Mostly small rocks with a few large ones.
+        float size = unit( random );
+        body.radius = 0.05f + 0.45f * size * size * size;
+
+        glm::vec3 axis( signedUnit( random ), signedUnit( random ), signedUnit( random ) );
+        float axisLength = glm::length( axis );
+        axis = axisLength > 1e-3f ? axis / axisLength : glm::vec3( 0, 1, 0 );
+        body.rotation = glm::angleAxis( _2pi * unit( random ), axis );
+
+        body.material = (GLushort)( random() % materialCount );
+        body.layer = (GLushort)( random() % layerCount );
+    }
+    return bodies;
+}
@@ -0,0 +1,202 @@
+#include <TextureAndLightingPCH.h>
+#include <LutBaker.h>
+#include <Hash.h>
+#include <Parallel.h>
+#include <Simd.h>
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace
+{
+    // Bump whenever the baked table layout or math changes so stale cache
+    // entries are no longer hit.
+    const uint32_t LUT_LAYOUT_VERSION = 1;
+
+    // Clamp to the byte range and round half away from zero, exactly like the
+    // original loop did through round( std::min( 255.0f, value ) ).
+    inline GLubyte QuantizeChannel( float value )
+    {
+        return (GLubyte)round( std::min( 255.0f, value ) );
+    }
+
+    inline GLuint PackRGBA( GLubyte r, GLubyte g, GLubyte b, GLubyte a )
+    {
+        return (GLuint)r | ( (GLuint)g << 8 ) | ( (GLuint)b << 16 ) | ( (GLuint)a << 24 );
+    }
+
+    // dst[x] = rgb[x] | alpha for one row of width texels.
+    void ComposeRow( GLuint* dst, const GLuint* rgb, GLuint alpha, int width )
+    {
+        int x = 0;
+#if SIMD_AVX
+        const __m256 alpha8 = _mm256_castsi256_ps( _mm256_set1_epi32( (int)alpha ) );
+        for ( ; x + 8 <= width; x += 8 )
+        {
+            __m256 texels = _mm256_loadu_ps( reinterpret_cast<const float*>( rgb + x ) );
+            _mm256_storeu_ps( reinterpret_cast<float*>( dst + x ), _mm256_or_ps( texels, alpha8 ) );
+        }
+#endif
+#if SIMD_SSE2
+        const __m128i alpha4 = _mm_set1_epi32( (int)alpha );
+        for ( ; x + 4 <= width; x += 4 )
+        {
+            __m128i texels = _mm_loadu_si128( reinterpret_cast<const __m128i*>( rgb + x ) );
+            _mm_storeu_si128( reinterpret_cast<__m128i*>( dst + x ), _mm_or_si128( texels, alpha4 ) );
+        }
+#endif
+        for ( ; x < width; ++x )
+        {
+            dst[x] = rgb[x] | alpha;
+        }
+    }
+}
+
+uint64_t GetLookupTableKey( int width, int height,
+                            GLfloat specShininess,
+                            const glm::vec4& lightColor,
+                            const glm::vec4& materialDiffuse,
+                            const glm::vec4& materialSpecular )
+{
+    uint64_t key = HashValue( LUT_LAYOUT_VERSION );
+    key = HashValue( width, key );
+    key = HashValue( height, key );
+    key = HashValue( specShininess, key );
+    key = HashBytes( glm::value_ptr( lightColor ), sizeof(glm::vec4), key );
+    key = HashBytes( glm::value_ptr( materialDiffuse ), sizeof(glm::vec4), key );
+    key = HashBytes( glm::value_ptr( materialSpecular ), sizeof(glm::vec4), key );
+    return key;
+}
+
+void BakeLookupTable( int width, int height,
+                      GLfloat specShininess,
+                      const glm::vec4& lightColor,
+                      const glm::vec4& materialDiffuse,
+                      const glm::vec4& materialSpecular,
+                      GLubyte* dataDiffuse,
+                      GLubyte* dataSpecular )
+{
+    // The diffuse table is separable: RGB only depends on N.L (the column) and
+    // alpha only depends on N.H (the row). Evaluate each axis once with the same
+    // expressions as the reference loop, so every texel is bit-identical, and
+    // then the per-texel work reduces to a single OR.
+    std::vector<GLuint> diffuseRow( width );
+    for ( int x = 0; x < width; ++x )
+    {
+        float nl = x / float(width);
+        glm::vec4 resultDiffuse = nl*lightColor*materialDiffuse*255.0f;
+        diffuseRow[x] = PackRGBA( QuantizeChannel( resultDiffuse.r ),
+                                  QuantizeChannel( resultDiffuse.g ),
+                                  QuantizeChannel( resultDiffuse.b ), 0 );
+    }
+
+    std::vector<GLuint> specularAlpha( height );
+    for ( int y = 0; y < height; ++y )
+    {
+        float nh = y / float(height);
+        float spec = powf( nh, specShininess );
+        specularAlpha[y] = PackRGBA( 0, 0, 0, QuantizeChannel( spec*255.0f ) );
+    }
+
+    GLuint* diffuseTexels = reinterpret_cast<GLuint*>( dataDiffuse );
+    ParallelFor( height, 64, [&]( int begin, int end )
+    {
+        for ( int y = begin; y < end; ++y )
+        {
+            ComposeRow( diffuseTexels + (size_t)y * width, diffuseRow.data(), specularAlpha[y], width );
+        }
+    } );
+
+    for ( int x = 0, idx = 0; x < width; ++x, idx += 4 )
+    {
+        float vx = x / float(width);
+        float spec = powf( vx, specShininess );
+        glm::vec4 resultSpecular = spec*lightColor*materialSpecular*255.0f;
+        dataSpecular[idx + 0] = QuantizeChannel( resultSpecular.r );
+        dataSpecular[idx + 1] = QuantizeChannel( resultSpecular.g );
+        dataSpecular[idx + 2] = QuantizeChannel( resultSpecular.b );
+        dataSpecular[idx + 3] = QuantizeChannel( resultSpecular.a );
+    }
+}
+
+void BakeLookupTableReference( int width, int height,
+                               GLfloat specShininess,
+                               const glm::vec4& lightColor,
+                               const glm::vec4& materialDiffuse,
+                               const glm::vec4& materialSpecular,
+                               GLubyte* dataDiffuse,
+                               GLubyte* dataSpecular )
+{
+    for ( int y = 0, idx = 0; y < height; ++y )
+    {
+        for ( int x = 0; x < width; ++x, idx += 4 )
+        {
+            float vx = x / float(width);
+            float vy = y / float(height);
+            float nl = vx;
+            float nh = vy;
+            float spec = powf( nh, specShininess );
+            glm::vec4 resultDiffuse = nl*lightColor*materialDiffuse*255.0f;
+            dataDiffuse[idx + 0] = round( std::min( 255.0f, resultDiffuse.r ) );
+            dataDiffuse[idx + 1] = round( std::min( 255.0f, resultDiffuse.g ) );
+            dataDiffuse[idx + 2] = round( std::min( 255.0f, resultDiffuse.b ) );
+            dataDiffuse[idx + 3] = round( std::min( 255.0f, spec*255.0f ) );
+        }
+    }
+
+    for ( int x = 0, idx = 0; x < width; ++x, idx += 4 )
+    {
+        float vx = x / float(width);
+        float spec = powf( vx, specShininess );
+        glm::vec4 resultSpecular = spec*lightColor*materialSpecular*255.0f;
+        dataSpecular[idx + 0] = round( std::min( 255.0f, resultSpecular.r ) );
+        dataSpecular[idx + 1] = round( std::min( 255.0f, resultSpecular.g ) );
+        dataSpecular[idx + 2] = round( std::min( 255.0f, resultSpecular.b ) );
+        dataSpecular[idx + 3] = round( std::min( 255.0f, resultSpecular.a ) );
+    }
+}
+
+int BenchmarkLookupTable( int width, int height,
+                          GLfloat specShininess,
+                          const glm::vec4& lightColor,
+                          const glm::vec4& materialDiffuse,
+                          const glm::vec4& materialSpecular )
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    const int iterations = 10;
+
+    std::vector<GLubyte> referenceDiffuse( width * height * 4 );
+    std::vector<GLubyte> referenceSpecular( width * 4 );
+    std::vector<GLubyte> bakedDiffuse( width * height * 4 );
+    std::vector<GLubyte> bakedSpecular( width * 4 );
+
+    Clock::time_point start = Clock::now();
+    for ( int i = 0; i < iterations; ++i )
+    {
+        BakeLookupTableReference( width, height, specShininess, lightColor, materialDiffuse, materialSpecular,
+                                  referenceDiffuse.data(), referenceSpecular.data() );
+    }
+    double referenceSeconds = std::chrono::duration<double>( Clock::now() - start ).count();
+
+    start = Clock::now();
+    for ( int i = 0; i < iterations; ++i )
+    {
+        BakeLookupTable( width, height, specShininess, lightColor, materialDiffuse, materialSpecular,
+                         bakedDiffuse.data(), bakedSpecular.data() );
+    }
+    double bakedSeconds = std::chrono::duration<double>( Clock::now() - start ).count();
+
+    double texels = double(width) * ( height + 1 ) * iterations;
+    bool identical = referenceDiffuse == bakedDiffuse && referenceSpecular == bakedSpecular;
+
+    std::cout << "LUT " << width << "x" << height << " (" << GetWorkerCount() << " threads, "
+              << ( SIMD_AVX ? "AVX" : SIMD_SSE2 ? "SSE2" : "scalar" ) << ")" << std::endl;
+    std::cout << "  reference: " << texels / referenceSeconds / 1.0e6 << " Mtexels/s" << std::endl;
+    std::cout << "  baker:     " << texels / bakedSeconds / 1.0e6 << " Mtexels/s ("
+              << referenceSeconds / bakedSeconds << "x)" << std::endl;
+    std::cout << "  output " << ( identical ? "bit-identical" : "DIFFERS" ) << std::endl;
+
+    return identical ? 0 : 1;
+}
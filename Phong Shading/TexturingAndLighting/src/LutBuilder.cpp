@@ -0,0 +1,361 @@
+#include <TextureAndLightingPCH.h>
+#include <LutBuilder.h>
+#include <Parallel.h>
+
+#include <glm/gtc/packing.hpp>
+
+#include <math.h>
+#include <algorithm>
+
+namespace
+{
+    const int MIN_LUT_SIZE = 2;
+    const int MAX_LUT_SIZE = 1024;
+    const int ERROR_SAMPLES = 8192;
+
+    const LutFormat LUT_FORMATS[] = { LUT_FORMAT_RG8, LUT_FORMAT_RG16F, LUT_FORMAT_R11F_G11F_B10F };
+    const float WARP_EXPONENTS[] = { 1.0f, 2.0f, 4.0f, 8.0f };
+
+    // Round a value through the storage format of the given channel.
+    float Quantize( LutFormat format, float value, int channel )
+    {
+        switch ( format )
+        {
+        case LUT_FORMAT_RG8:
+            return glm::unpackUnorm1x8( glm::packUnorm1x8( value ) );
+        case LUT_FORMAT_RG16F:
+            return glm::unpackHalf1x16( glm::packHalf1x16( value ) );
+        case LUT_FORMAT_R11F_G11F_B10F:
+            return glm::unpackF2x11_1x10( glm::packF2x11_1x10( glm::vec3( value ) ) )[channel];
+        }
+        return value;
+    }
+
+    // The stored term at normalized table coordinate t in [0,1].
+    float DiffuseTerm( float t )
+    {
+        return t;
+    }
+
+    float SpecularTerm( float t, float shininess, float warpExponent )
+    {
+        // t = pow( N.H, warpExponent ) so pow( N.H, shininess ) = pow( t, shininess / warpExponent ).
+        return powf( t, shininess / warpExponent );
+    }
+
+    // Quantized samples of one table axis.
+    std::vector<float> BuildAxis( int size, LutFormat format, int channel, float shininess, float warpExponent )
+    {
+        std::vector<float> samples( size );
+        for ( int i = 0; i < size; ++i )
+        {
+            float t = i / float( size - 1 );
+            float value = ( channel == 0 ) ? DiffuseTerm( t ) : SpecularTerm( t, shininess, warpExponent );
+            samples[i] = Quantize( format, value, channel );
+        }
+        return samples;
+    }
+
+    // Linear filtering between texel centers, as GL_LINEAR does with the
+    // coordinates remapped by GetLutScaleBias.
+    float Reconstruct( const std::vector<float>& samples, float t )
+    {
+        float x = t * ( samples.size() - 1 );
+        int i = std::min( (int)x, (int)samples.size() - 2 );
+        float f = x - i;
+        return samples[i] + ( samples[i + 1] - samples[i] ) * f;
+    }
+
+    // The table is separable: the diffuse term only varies along the width and
+    // the specular term only along the height, so each axis can be measured
+    // on its own.
+    float MeasureDiffuseError( int width, LutFormat format )
+    {
+        std::vector<float> samples = BuildAxis( width, format, 0, 0.0f, 1.0f );
+        float maxError = 0.0f;
+        for ( int i = 0; i <= ERROR_SAMPLES; ++i )
+        {
+            float nl = i / float(ERROR_SAMPLES);
+            maxError = std::max( maxError, fabsf( Reconstruct( samples, nl ) - nl ) );
+        }
+        return maxError;
+    }
+
+    float MeasureSpecularError( int height, LutFormat format, float shininess, float warpExponent )
+    {
+        std::vector<float> samples = BuildAxis( height, format, 1, shininess, warpExponent );
+        float maxError = 0.0f;
+        for ( int i = 0; i <= ERROR_SAMPLES; ++i )
+        {
+            float nh = i / float(ERROR_SAMPLES);
+            float t = powf( nh, warpExponent );
+            maxError = std::max( maxError, fabsf( Reconstruct( samples, t ) - powf( nh, shininess ) ) );
+        }
+        return maxError;
+    }
+
+    // Smallest power-of-two size whose error is within maxError, or 0.
+    template<typename ErrorFunc>
+    int FindSmallestSize( float maxError, ErrorFunc error )
+    {
+        for ( int size = MIN_LUT_SIZE; size <= MAX_LUT_SIZE; size *= 2 )
+        {
+            if ( error( size ) <= maxError )
+            {
+                return size;
+            }
+        }
+        return 0;
+    }
+
+    // Smallest layout in one format whose error is within maxError.
+    bool ChooseLayoutForFormat( LutFormat format, float shininess, float maxError, LutLayout& result )
+    {
+        int width = FindSmallestSize( maxError, [&]( int size ) { return MeasureDiffuseError( size, format ); } );
+        if ( width == 0 )
+        {
+            return false;
+        }
+
+        bool found = false;
+        for ( float warpExponent : WARP_EXPONENTS )
+        {
+            int height = FindSmallestSize( maxError, [&]( int size ) { return MeasureSpecularError( size, format, shininess, warpExponent ); } );
+            if ( height > 0 && ( !found || height < result.height ) )
+            {
+                LutLayout layout = { width, height, format, warpExponent, 0.0f };
+                result = layout;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    // Full-size layout in one format with the warp exponent that minimizes the error.
+    LutLayout GetMostAccurateLayout( LutFormat format, float shininess )
+    {
+        LutLayout best = { MAX_LUT_SIZE, MAX_LUT_SIZE, format, 1.0f, 0.0f };
+        float bestError = -1.0f;
+        for ( float warpExponent : WARP_EXPONENTS )
+        {
+            LutLayout layout = { MAX_LUT_SIZE, MAX_LUT_SIZE, format, warpExponent, 0.0f };
+            float error = std::max( MeasureDiffuseError( layout.width, format ),
+                                    MeasureSpecularError( layout.height, format, shininess, warpExponent ) );
+            if ( bestError < 0.0f || error < bestError )
+            {
+                best = layout;
+                bestError = error;
+            }
+        }
+        return best;
+    }
+}
+
+LutLayout ChooseLutLayout( float shininess, float maxError )
+{
+    LutLayout best = { 0, 0, LUT_FORMAT_RG8, 1.0f, 0.0f };
+    size_t bestBytes = 0;
+
+    for ( LutFormat format : LUT_FORMATS )
+    {
+        LutLayout layout;
+        if ( ChooseLayoutForFormat( format, shininess, maxError, layout ) &&
+             ( bestBytes == 0 || GetLutByteSize( layout ) < bestBytes ) )
+        {
+            best = layout;
+            bestBytes = GetLutByteSize( layout );
+        }
+    }
+
+    if ( bestBytes == 0 )
+    {
+        // Nothing meets the bound; use the most accurate full-size candidate.
+        float bestError = -1.0f;
+        for ( LutFormat format : LUT_FORMATS )
+        {
+            LutLayout layout = GetMostAccurateLayout( format, shininess );
+            float error = MeasureLutError( layout, shininess );
+            if ( bestError < 0.0f || error < bestError )
+            {
+                best = layout;
+                bestError = error;
+            }
+        }
+    }
+
+    best.maxError = MeasureLutError( best, shininess );
+    return best;
+}
+
+LutArrayLayout ChooseLutArrayLayout( const std::vector<float>& shininess, float maxError )
+{
+    LutArrayLayout best;
+    best.width = 0;
+    best.height = 0;
+    best.format = LUT_FORMAT_RG16F;
+    best.maxError = 0.0f;
+    size_t bestBytes = 0;
+
+    // All layers share one size and format; the warp exponent stays per layer.
+    for ( LutFormat format : LUT_FORMATS )
+    {
+        LutArrayLayout candidate;
+        candidate.width = 0;
+        candidate.height = 0;
+        candidate.format = format;
+        candidate.maxError = 0.0f;
+
+        bool valid = true;
+        for ( float layerShininess : shininess )
+        {
+            LutLayout layout;
+            if ( !ChooseLayoutForFormat( format, layerShininess, maxError, layout ) )
+            {
+                valid = false;
+                break;
+            }
+            candidate.width = std::max( candidate.width, layout.width );
+            candidate.height = std::max( candidate.height, layout.height );
+            candidate.warpExponents.push_back( layout.warpExponent );
+        }
+
+        if ( valid && ( bestBytes == 0 || GetLutArrayByteSize( candidate ) < bestBytes ) )
+        {
+            best = candidate;
+            bestBytes = GetLutArrayByteSize( candidate );
+        }
+    }
+
+    if ( bestBytes == 0 )
+    {
+        // Nothing meets the bound; use the most precise format at full size.
+        best.width = MAX_LUT_SIZE;
+        best.height = MAX_LUT_SIZE;
+        best.format = LUT_FORMAT_RG16F;
+        best.warpExponents.clear();
+        for ( float layerShininess : shininess )
+        {
+            best.warpExponents.push_back( GetMostAccurateLayout( best.format, layerShininess ).warpExponent );
+        }
+    }
+
+    for ( size_t layer = 0; layer < shininess.size(); ++layer )
+    {
+        best.maxError = std::max( best.maxError, MeasureLutError( GetLutArrayLayer( best, (int)layer ), shininess[layer] ) );
+    }
+    return best;
+}
+
+float MeasureLutError( const LutLayout& layout, float shininess )
+{
+    return std::max( MeasureDiffuseError( layout.width, layout.format ),
+                     MeasureSpecularError( layout.height, layout.format, shininess, layout.warpExponent ) );
+}
+
+void BakeCompactLut( const LutLayout& layout, float shininess, void* data )
+{
+    for ( int y = 0; y < layout.height; ++y )
+    {
+        float spec = SpecularTerm( y / float( layout.height - 1 ), shininess, layout.warpExponent );
+
+        for ( int x = 0; x < layout.width; ++x )
+        {
+            float diffuse = DiffuseTerm( x / float( layout.width - 1 ) );
+            int idx = y * layout.width + x;
+
+            switch ( layout.format )
+            {
+            case LUT_FORMAT_RG8:
+                static_cast<glm::uint16*>( data )[idx] = glm::packUnorm2x8( glm::vec2( diffuse, spec ) );
+                break;
+            case LUT_FORMAT_RG16F:
+                static_cast<glm::uint16*>( data )[idx * 2 + 0] = glm::packHalf1x16( diffuse );
+                static_cast<glm::uint16*>( data )[idx * 2 + 1] = glm::packHalf1x16( spec );
+                break;
+            case LUT_FORMAT_R11F_G11F_B10F:
+                static_cast<glm::uint32*>( data )[idx] = glm::packF2x11_1x10( glm::vec3( diffuse, spec, 0.0f ) );
+                break;
+            }
+        }
+    }
+}
+
+void BakeCompactLutArray( const LutArrayLayout& layout, const std::vector<float>& shininess, void* data )
+{
+    size_t layerSize = GetLutByteSize( GetLutArrayLayer( layout, 0 ) );
+    ParallelFor( (int)shininess.size(), 1, [&]( int begin, int end )
+    {
+        for ( int layer = begin; layer < end; ++layer )
+        {
+            BakeCompactLut( GetLutArrayLayer( layout, layer ), shininess[layer],
+                            static_cast<char*>( data ) + layerSize * layer );
+        }
+    } );
+}
+
+LutLayout GetLutArrayLayer( const LutArrayLayout& layout, int layer )
+{
+    LutLayout result = { layout.width, layout.height, layout.format, layout.warpExponents[layer], layout.maxError };
+    return result;
+}
+
+size_t GetLutArrayByteSize( const LutArrayLayout& layout )
+{
+    return (size_t)layout.width * layout.height * GetLutBytesPerTexel( layout.format ) * layout.warpExponents.size();
+}
+
+int GetLutBytesPerTexel( LutFormat format )
+{
+    return ( format == LUT_FORMAT_RG8 ) ? 2 : 4;
+}
+
+size_t GetLutByteSize( const LutLayout& layout )
+{
+    return (size_t)layout.width * layout.height * GetLutBytesPerTexel( layout.format );
+}
+
+const char* GetLutFormatName( LutFormat format )
+{
+    switch ( format )
+    {
+    case LUT_FORMAT_RG8: return "RG8";
+    case LUT_FORMAT_RG16F: return "RG16F";
+    case LUT_FORMAT_R11F_G11F_B10F: return "R11F_G11F_B10F";
+    }
+    return "unknown";
+}
+
+GLenum GetLutInternalFormat( LutFormat format )
+{
+    switch ( format )
+    {
+    case LUT_FORMAT_RG8: return GL_RG8;
+    case LUT_FORMAT_RG16F: return GL_RG16F;
+    case LUT_FORMAT_R11F_G11F_B10F: return GL_R11F_G11F_B10F;
+    }
+    return GL_RG8;
+}
+
+GLenum GetLutPixelFormat( LutFormat format )
+{
+    return ( format == LUT_FORMAT_R11F_G11F_B10F ) ? GL_RGB : GL_RG;
+}
+
+GLenum GetLutPixelType( LutFormat format )
+{
+    switch ( format )
+    {
+    case LUT_FORMAT_RG8: return GL_UNSIGNED_BYTE;
+    case LUT_FORMAT_RG16F: return GL_HALF_FLOAT;
+    case LUT_FORMAT_R11F_G11F_B10F: return GL_UNSIGNED_INT_10F_11F_11F_REV;
+    }
+    return GL_UNSIGNED_BYTE;
+}
+
+glm::vec4 GetLutScaleBias( const LutLayout& layout )
+{
+    return glm::vec4( ( layout.width - 1 ) / float( layout.width ),
+                      ( layout.height - 1 ) / float( layout.height ),
+                      0.5f / layout.width,
+                      0.5f / layout.height );
+}
@@ -0,0 +1,189 @@
+#include <TextureAndLightingPCH.h>
+#include <MappedFile.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+    : m_Data( NULL )
+    , m_Size( 0 )
+    , m_File( NULL )
+    , m_Mapping( NULL )
+{}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::OpenRead( const std::string& path )
+{
+    Close();
+
+    HANDLE file = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+    if ( file == INVALID_HANDLE_VALUE )
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if ( !GetFileSizeEx( file, &size ) || size.QuadPart == 0 )
+    {
+        CloseHandle( file );
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+    void* data = mapping ? MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) : NULL;
+    if ( !data )
+    {
+        if ( mapping ) CloseHandle( mapping );
+        CloseHandle( file );
+        return false;
+    }
+
+    m_File = file;
+    m_Mapping = mapping;
+    m_Data = data;
+    m_Size = (size_t)size.QuadPart;
+    return true;
+}
+
+bool MappedFile::CreateWrite( const std::string& path, size_t size )
+{
+    Close();
+
+    HANDLE file = CreateFileA( path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                               CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+    if ( file == INVALID_HANDLE_VALUE )
+    {
+        return false;
+    }
+
+    ULARGE_INTEGER mappingSize;
+    mappingSize.QuadPart = size;
+    HANDLE mapping = CreateFileMappingA( file, NULL, PAGE_READWRITE, mappingSize.HighPart, mappingSize.LowPart, NULL );
+    void* data = mapping ? MapViewOfFile( mapping, FILE_MAP_WRITE, 0, 0, size ) : NULL;
+    if ( !data )
+    {
+        if ( mapping ) CloseHandle( mapping );
+        CloseHandle( file );
+        return false;
+    }
+
+    m_File = file;
+    m_Mapping = mapping;
+    m_Data = data;
+    m_Size = size;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if ( m_Data ) UnmapViewOfFile( m_Data );
+    if ( m_Mapping ) CloseHandle( m_Mapping );
+    if ( m_File ) CloseHandle( m_File );
+
+    m_Data = NULL;
+    m_Mapping = NULL;
+    m_File = NULL;
+    m_Size = 0;
+}
+
+#else
+
+bool MappedFile::OpenRead( const std::string& path )
+{
+    Close();
+
+    int fd = open( path.c_str(), O_RDONLY );
+    if ( fd < 0 )
+    {
+        return false;
+    }
+
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 || st.st_size == 0 )
+    {
+        close( fd );
+        return false;
+    }
+
+    void* data = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( data == MAP_FAILED )
+    {
+        return false;
+    }
+
+    m_Data = data;
+    m_Size = (size_t)st.st_size;
+    return true;
+}
+
+bool MappedFile::CreateWrite( const std::string& path, size_t size )
+{
+    Close();
+
+    int fd = open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+    if ( fd < 0 )
+    {
+        return false;
+    }
+
+    if ( ftruncate( fd, (off_t)size ) != 0 )
+    {
+        close( fd );
+        return false;
+    }
+
+    void* data = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( data == MAP_FAILED )
+    {
+        return false;
+    }
+
+    m_Data = data;
+    m_Size = size;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if ( m_Data ) munmap( m_Data, m_Size );
+
+    m_Data = NULL;
+    m_Size = 0;
+}
+
+#endif
+
+bool MappedFile::IsOpen() const
+{
+    return m_Data != NULL;
+}
+
+const void* MappedFile::GetData() const
+{
+    return m_Data;
+}
+
+void* MappedFile::GetData()
+{
+    return m_Data;
+}
+
+size_t MappedFile::GetSize() const
+{
+    return m_Size;
+}
@@ -0,0 +1,642 @@
+#include <TextureAndLightingPCH.h>
+#include <Mesh.h>
+#include <StateCache.h>
+
+#include <glm/gtc/packing.hpp>
+
+#include <map>
+#include <sstream>
+
+namespace
+{
+    struct PackedVertex
+    {
+        glm::vec3 position;
+        glm::uint32 normal;         // packSnorm3x10_1x2
+        glm::uint32 textureCoord;   // packUnorm2x16
+        glm::uint32 tangent;        // packSnorm3x10_1x2, bitangent sign in w
+    };
+
+    struct PackedHalfVertex
+    {
+        glm::uint16 position[4];    // packHalf1x16, w unused
+        glm::uint32 normal;
+        glm::uint32 textureCoord;
+        glm::uint32 tangent;
+    };
+
+    struct IVec3Less
+    {
+        bool operator()( const glm::ivec3& a, const glm::ivec3& b ) const
+        {
+            return a.x != b.x ? a.x < b.x : a.y != b.y ? a.y < b.y : a.z < b.z;
+        }
+    };
+
+    GLuint CreateBuffer( GLenum target, size_t size, const void* data )
+    {
+        GLuint buffer;
+        glGenBuffers( 1, &buffer );
+        GetStateCache().BindBuffer( target, buffer );
+        glBufferData( target, size, data, GL_STATIC_DRAW );
+        return buffer;
+    }
+
+    // The normal, texture coordinate and tangent attributes shared by both
+    // packed layouts.
+    template<typename Vertex>
+    void SetPackedAttributes()
+    {
+        glVertexAttribPointer( NORMAL_ATTRIBUTE, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(Vertex), MEMBER_OFFSET(Vertex, normal) );
+        glEnableVertexAttribArray( NORMAL_ATTRIBUTE );
+
+        glVertexAttribPointer( TEXCOORD0_ATTRIBUTE, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(Vertex), MEMBER_OFFSET(Vertex, textureCoord) );
+        glEnableVertexAttribArray( TEXCOORD0_ATTRIBUTE );
+
+        glVertexAttribPointer( TANGENT_ATTRIBUTE, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(Vertex), MEMBER_OFFSET(Vertex, tangent) );
+        glEnableVertexAttribArray( TANGENT_ATTRIBUTE );
+    }
+
+    // Any unit vector perpendicular to n.
+    glm::vec3 GetPerpendicular( const glm::vec3& n )
+    {
+        glm::vec3 axis = ( std::abs( n.x ) < 0.9f ) ? glm::vec3( 1, 0, 0 ) : glm::vec3( 0, 1, 0 );
+        return glm::normalize( glm::cross( n, axis ) );
+    }
+}
+
+void GenerateTangents( MeshData& mesh )
+{
+    using namespace glm;
+
+    // The UV handedness of every triangle: +1, -1, or 0 when it has no area
+    // (collapsed poles, whose vertices differ by rounding only) or no UV
+    // area (unmapped faces) and so no gradient to contribute.
+    size_t triangleCount = mesh.indices.size() / 3;
+    std::vector<float> orientations( triangleCount, 0.0f );
+    for ( size_t f = 0; f < triangleCount; ++f )
+    {
+        const GLuint* triangle = &mesh.indices[f * 3];
+        vec3 e1 = mesh.positions[triangle[1]] - mesh.positions[triangle[0]];
+        vec3 e2 = mesh.positions[triangle[2]] - mesh.positions[triangle[0]];
+        vec2 d1 = mesh.textureCoords[triangle[1]] - mesh.textureCoords[triangle[0]];
+        vec2 d2 = mesh.textureCoords[triangle[2]] - mesh.textureCoords[triangle[0]];
+        float determinant = d1.x * d2.y - d2.x * d1.y;
+        if ( length( cross( e1, e2 ) ) > 1e-6f * length( e1 ) * length( e2 ) && std::abs( determinant ) >= 1e-12f )
+        {
+            orientations[f] = ( determinant > 0.0f ) ? 1.0f : -1.0f;
+        }
+    }
+
+    // Like MikkTSpace, never average across a mirror seam: a vertex shared
+    // by triangles of both handednesses is split, and the triangles of the
+    // second handedness get the copy.
+    std::vector<float> signs( mesh.positions.size(), 0.0f );
+    std::vector<GLuint> mirrors( mesh.positions.size(), ~0u );
+    for ( size_t f = 0; f < triangleCount; ++f )
+    {
+        if ( orientations[f] == 0.0f )
+        {
+            continue;
+        }
+        for ( int k = 0; k < 3; ++k )
+        {
+            GLuint& index = mesh.indices[f * 3 + k];
+            if ( signs[index] == 0.0f )
+            {
+                signs[index] = orientations[f];
+            }
+            else if ( signs[index] != orientations[f] )
+            {
+                if ( mirrors[index] == ~0u )
+                {
+                    mirrors[index] = (GLuint)mesh.positions.size();
+                    mesh.positions.push_back( mesh.positions[index] );
+                    mesh.normals.push_back( mesh.normals[index] );
+                    mesh.textureCoords.push_back( mesh.textureCoords[index] );
+                    signs.push_back( orientations[f] );
+                    mirrors.push_back( ~0u );
+                }
+                index = mirrors[index];
+            }
+        }
+    }
+
+    // Each triangle's tangent, projected onto the tangent plane of every
+    // corner and weighted by the corner's angle in that plane, so how a
+    // polygon was triangulated does not matter.
+    size_t vertexCount = mesh.positions.size();
+    std::vector<vec3> tangents( vertexCount, vec3( 0.0f ) );
+    for ( size_t f = 0; f < triangleCount; ++f )
+    {
+        if ( orientations[f] == 0.0f )
+        {
+            continue;
+        }
+        const GLuint* triangle = &mesh.indices[f * 3];
+        vec3 e1 = mesh.positions[triangle[1]] - mesh.positions[triangle[0]];
+        vec3 e2 = mesh.positions[triangle[2]] - mesh.positions[triangle[0]];
+        vec2 d1 = mesh.textureCoords[triangle[1]] - mesh.textureCoords[triangle[0]];
+        vec2 d2 = mesh.textureCoords[triangle[2]] - mesh.textureCoords[triangle[0]];
+        vec3 tangent = ( e1 * d2.y - e2 * d1.y ) * orientations[f];
+
+        for ( int k = 0; k < 3; ++k )
+        {
+            const vec3& n = mesh.normals[triangle[k]];
+            const vec3& corner = mesh.positions[triangle[k]];
+            vec3 a = mesh.positions[triangle[( k + 1 ) % 3]] - corner;
+            vec3 b = mesh.positions[triangle[( k + 2 ) % 3]] - corner;
+            a -= n * dot( n, a );
+            b -= n * dot( n, b );
+            vec3 projected = tangent - n * dot( n, tangent );
+            float lengths = length( a ) * length( b );
+            float projectedLength = length( projected );
+            if ( lengths == 0.0f || projectedLength == 0.0f )
+            {
+                continue;
+            }
+            float angle = acos( clamp( dot( a, b ) / lengths, -1.0f, 1.0f ) );
+            tangents[triangle[k]] += projected * ( angle / projectedLength );
+        }
+    }
+
+    mesh.tangents.resize( vertexCount );
+    for ( size_t v = 0; v < vertexCount; ++v )
+    {
+        // Vertices that got no gradient take any tangent, they have no
+        // normal map detail to orient.
+        const vec3& n = mesh.normals[v];
+        vec3 tangent = tangents[v] - n * dot( n, tangents[v] );
+        float tangentLength = length( tangent );
+        tangent = ( tangentLength > 1e-6f ) ? tangent / tangentLength : GetPerpendicular( n );
+        mesh.tangents[v] = vec4( tangent, signs[v] < 0.0f ? -1.0f : 1.0f );
+    }
+}
+
+MeshData SolidSphere( float radius, int slices, int stacks )
+{
+    using namespace glm;
+    using namespace std;
+
+    const float pi = 3.1415926535897932384626433832795f;
+    const float _2pi = 2.0f * pi;
+
+    MeshData mesh;
+
+    for( int i = 0; i <= stacks; ++i )
+    {
+        // V texture coordinate.
+        float V = i / (float)stacks;
+        float phi = V * pi;
+
+        for ( int j = 0; j <= slices; ++j )
+        {
+            // U texture coordinate.
+            float U = j / (float)slices;
+            float theta = U * _2pi;
+
+            float X = cos(theta) * sin(phi);
+            float Y = cos(phi);
+            float Z = sin(theta) * sin(phi);
+
+            mesh.positions.push_back( vec3( X, Y, Z) * radius );
+            mesh.normals.push_back( vec3(X, Y, Z) );
+            mesh.textureCoords.push_back( vec2(U, V) );
+        }
+    }
+
+    // Now generate the index buffer
+    for( int i = 0; i < slices * stacks + slices; ++i )
+    {
+        mesh.indices.push_back( i );
+        mesh.indices.push_back( i + slices + 1  );
+        mesh.indices.push_back( i + slices );
+
+        mesh.indices.push_back( i + slices + 1  );
+        mesh.indices.push_back( i );
+        mesh.indices.push_back( i + 1 );
+    }
+
+    GenerateTangents( mesh );
+    return mesh;
+}
+
+MeshData GeodesicSphere( float radius, int subdivisions )
+{
+    using namespace glm;
+    using namespace std;
+
+    const float pi = 3.1415926535897932384626433832795f;
+    const float _2pi = 2.0f * pi;
+    const float t = ( 1.0f + sqrt( 5.0f ) ) / 2.0f;
+
+    vector<vec3> positions = {
+        vec3( -1,  t,  0 ), vec3(  1,  t,  0 ), vec3( -1, -t,  0 ), vec3(  1, -t,  0 ),
+        vec3(  0, -1,  t ), vec3(  0,  1,  t ), vec3(  0, -1, -t ), vec3(  0,  1, -t ),
+        vec3(  t,  0, -1 ), vec3(  t,  0,  1 ), vec3( -t,  0, -1 ), vec3( -t,  0,  1 ),
+    };
+    for ( vec3& p : positions )
+    {
+        p = normalize( p );
+    }
+
+    // Counter-clockwise seen from outside, like SolidSphere.
+    vector<GLuint> indices = {
+        0, 11, 5,   0, 5, 1,    0, 1, 7,    0, 7, 10,   0, 10, 11,
+        1, 5, 9,    5, 11, 4,   11, 10, 2,  10, 7, 6,   7, 1, 8,
+        3, 9, 4,    3, 4, 2,    3, 2, 6,    3, 6, 8,    3, 8, 9,
+        4, 9, 5,    2, 4, 11,   6, 2, 10,   8, 6, 7,    9, 8, 1,
+    };
+
+    for ( int level = 0; level < subdivisions; ++level )
+    {
+        // Shared midpoints so neighboring triangles stay connected.
+        map<pair<GLuint, GLuint>, GLuint> midpoints;
+        auto midpoint = [&]( GLuint a, GLuint b )
+        {
+            pair<GLuint, GLuint> edge( std::min( a, b ), std::max( a, b ) );
+            auto found = midpoints.find( edge );
+            if ( found != midpoints.end() )
+            {
+                return found->second;
+            }
+            positions.push_back( normalize( positions[a] + positions[b] ) );
+            GLuint index = (GLuint)positions.size() - 1;
+            midpoints[edge] = index;
+            return index;
+        };
+
+        vector<GLuint> subdivided;
+        subdivided.reserve( indices.size() * 4 );
+        for ( size_t i = 0; i < indices.size(); i += 3 )
+        {
+            GLuint a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            GLuint ab = midpoint( a, b ), bc = midpoint( b, c ), ca = midpoint( c, a );
+            GLuint triangles[] = { a, ab, ca,   b, bc, ab,   c, ca, bc,   ab, bc, ca };
+            subdivided.insert( subdivided.end(), triangles, triangles + 12 );
+        }
+        indices.swap( subdivided );
+    }
+
+    MeshData mesh;
+    for ( const vec3& p : positions )
+    {
+        // Same parameterization as SolidSphere: X = cos(theta) sin(phi), Y = cos(phi), Z = sin(theta) sin(phi).
+        float theta = atan2( p.z, p.x );
+        if ( theta < 0.0f )
+        {
+            theta += _2pi;
+        }
+        mesh.positions.push_back( p * radius );
+        mesh.normals.push_back( p );
+        mesh.textureCoords.push_back( vec2( theta / _2pi, acos( clamp( p.y, -1.0f, 1.0f ) ) / pi ) );
+    }
+
+    auto duplicate = [&]( GLuint index, vec2 uv )
+    {
+        mesh.positions.push_back( mesh.positions[index] );
+        mesh.normals.push_back( mesh.normals[index] );
+        mesh.textureCoords.push_back( uv );
+        return (GLuint)mesh.positions.size() - 1;
+    };
+
+    for ( size_t i = 0; i < indices.size(); i += 3 )
+    {
+        GLuint* triangle = &indices[i];
+
+        // Triangles crossing the U seam get copies of their low-U vertices at U + 1.
+        float maxU = std::max( mesh.textureCoords[triangle[0]].x, std::max( mesh.textureCoords[triangle[1]].x, mesh.textureCoords[triangle[2]].x ) );
+        for ( int k = 0; k < 3; ++k )
+        {
+            vec2 uv = mesh.textureCoords[triangle[k]];
+            if ( maxU - uv.x > 0.5f )
+            {
+                triangle[k] = duplicate( triangle[k], vec2( uv.x + 1.0f, uv.y ) );
+            }
+        }
+
+        // Pole vertices take the U of the triangle's other two vertices.
+        for ( int k = 0; k < 3; ++k )
+        {
+            const vec3& n = mesh.normals[triangle[k]];
+            if ( abs( n.x ) < 1e-6f && abs( n.z ) < 1e-6f )
+            {
+                float u = ( mesh.textureCoords[triangle[( k + 1 ) % 3]].x + mesh.textureCoords[triangle[( k + 2 ) % 3]].x ) * 0.5f;
+                triangle[k] = duplicate( triangle[k], vec2( u, mesh.textureCoords[triangle[k]].y ) );
+            }
+        }
+    }
+
+    mesh.indices.swap( indices );
+    GenerateTangents( mesh );
+    return mesh;
+}
+
+bool LoadObj( const std::string& file, MeshData& mesh )
+{
+    std::ifstream ifs( file );
+    if ( !ifs )
+    {
+        std::cerr << "Can not open mesh file: \"" << file << "\"" << std::endl;
+        return false;
+    }
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> textureCoords;
+    std::vector<glm::vec3> normals;
+
+    // OBJ vertices index positions, UVs and normals separately; every distinct
+    // (position, UV, normal) triple becomes one mesh vertex.
+    std::map<glm::ivec3, GLuint, IVec3Less> vertexMap;
+    bool hasNormals = true;
+
+    mesh = MeshData();
+
+    std::string line;
+    while ( std::getline( ifs, line ) )
+    {
+        std::istringstream stream( line );
+        std::string type;
+        stream >> type;
+
+        if ( type == "v" )
+        {
+            glm::vec3 p;
+            stream >> p.x >> p.y >> p.z;
+            positions.push_back( p );
+        }
+        else if ( type == "vt" )
+        {
+            glm::vec2 uv;
+            stream >> uv.x >> uv.y;
+            textureCoords.push_back( uv );
+        }
+        else if ( type == "vn" )
+        {
+            glm::vec3 n;
+            stream >> n.x >> n.y >> n.z;
+            normals.push_back( n );
+        }
+        else if ( type == "f" )
+        {
+            std::vector<GLuint> face;
+            std::string token;
+            while ( stream >> token )
+            {
+                // v, v/vt, v//vn or v/vt/vn with 1-based or negative (relative) indices.
+                glm::ivec3 key( 0, -1, -1 );
+                int* fields[] = { &key.x, &key.y, &key.z };
+                const int counts[] = { (int)positions.size(), (int)textureCoords.size(), (int)normals.size() };
+                size_t start = 0;
+                for ( int f = 0; f < 3 && start <= token.size(); ++f )
+                {
+                    size_t slash = token.find( '/', start );
+                    std::string field = token.substr( start, slash == std::string::npos ? std::string::npos : slash - start );
+                    if ( !field.empty() )
+                    {
+                        int index = atoi( field.c_str() );
+                        *fields[f] = index < 0 ? counts[f] + index : index - 1;
+                    }
+                    if ( slash == std::string::npos )
+                    {
+                        break;
+                    }
+                    start = slash + 1;
+                }
+
+                if ( key.x < 0 || key.x >= counts[0] || key.y >= counts[1] || key.z >= counts[2] )
+                {
+                    std::cerr << "Invalid face in mesh file: \"" << file << "\"" << std::endl;
+                    return false;
+                }
+                hasNormals = hasNormals && key.z >= 0;
+
+                auto found = vertexMap.find( key );
+                if ( found == vertexMap.end() )
+                {
+                    found = vertexMap.insert( std::make_pair( key, (GLuint)mesh.positions.size() ) ).first;
+                    mesh.positions.push_back( positions[key.x] );
+                    mesh.textureCoords.push_back( key.y >= 0 ? textureCoords[key.y] : glm::vec2( 0.0f ) );
+                    mesh.normals.push_back( key.z >= 0 ? normals[key.z] : glm::vec3( 0.0f ) );
+                }
+                face.push_back( found->second );
+            }
+
+            for ( size_t i = 2; i < face.size(); ++i )
+            {
+                mesh.indices.push_back( face[0] );
+                mesh.indices.push_back( face[i - 1] );
+                mesh.indices.push_back( face[i] );
+            }
+        }
+    }
+
+    if ( !hasNormals )
+    {
+        // Area-weighted face normals accumulated per vertex.
+        std::fill( mesh.normals.begin(), mesh.normals.end(), glm::vec3( 0.0f ) );
+        for ( size_t t = 0; t + 2 < mesh.indices.size(); t += 3 )
+        {
+            const glm::vec3& p0 = mesh.positions[mesh.indices[t + 0]];
+            const glm::vec3& p1 = mesh.positions[mesh.indices[t + 1]];
+            const glm::vec3& p2 = mesh.positions[mesh.indices[t + 2]];
+            glm::vec3 n = glm::cross( p1 - p0, p2 - p0 );
+            for ( int k = 0; k < 3; ++k )
+            {
+                mesh.normals[mesh.indices[t + k]] += n;
+            }
+        }
+        for ( glm::vec3& n : mesh.normals )
+        {
+            float length = glm::length( n );
+            n = length > 0.0f ? n / length : glm::vec3( 0, 1, 0 );
+        }
+    }
+
+    GenerateTangents( mesh );
+    return !mesh.indices.empty();
+}
+
+Mesh CreateMesh( const MeshData& input, VertexFormat format )
+{
+    using namespace glm;
+
+    // Generating tangents may split vertices, so upload the generated copy.
+    MeshData generated;
+    if ( input.tangents.size() != input.positions.size() )
+    {
+        generated = input;
+        GenerateTangents( generated );
+    }
+    const MeshData& data = generated.positions.empty() ? input : generated;
+    const std::vector<vec4>& tangents = data.tangents;
+
+    Mesh mesh;
+    mesh.format = format;
+    mesh.indexCount = (GLsizei)data.indices.size();
+
+    glGenVertexArrays( 1, &mesh.vao );
+    GetStateCache().BindVertexArray( mesh.vao );
+
+    size_t vertexCount = data.positions.size();
+
+    switch ( format )
+    {
+    case VERTEX_FORMAT_SEPARATE:
+        mesh.buffers.push_back( CreateBuffer( GL_ARRAY_BUFFER, vertexCount * sizeof(vec3), data.positions.data() ) );
+        glVertexAttribPointer( POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0) );
+        glEnableVertexAttribArray( POSITION_ATTRIBUTE );
+
+        mesh.buffers.push_back( CreateBuffer( GL_ARRAY_BUFFER, vertexCount * sizeof(vec3), data.normals.data() ) );
+        glVertexAttribPointer( NORMAL_ATTRIBUTE, 3, GL_FLOAT, GL_TRUE, 0, BUFFER_OFFSET(0) );
+        glEnableVertexAttribArray( NORMAL_ATTRIBUTE );
+
+        mesh.buffers.push_back( CreateBuffer( GL_ARRAY_BUFFER, vertexCount * sizeof(vec2), data.textureCoords.data() ) );
+        glVertexAttribPointer( TEXCOORD0_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0) );
+        glEnableVertexAttribArray( TEXCOORD0_ATTRIBUTE );
+
+        mesh.buffers.push_back( CreateBuffer( GL_ARRAY_BUFFER, vertexCount * sizeof(vec4), tangents.data() ) );
+        glVertexAttribPointer( TANGENT_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0) );
+        glEnableVertexAttribArray( TANGENT_ATTRIBUTE );
+        break;
+
+    case VERTEX_FORMAT_PACKED:
+        {
+            std::vector<PackedVertex> vertices( vertexCount );
+            for ( size_t i = 0; i < vertexCount; ++i )
+            {
+                vertices[i].position = data.positions[i];
+                vertices[i].normal = packSnorm3x10_1x2( vec4( data.normals[i], 0.0f ) );
+                vertices[i].textureCoord = packUnorm2x16( data.textureCoords[i] );
+                vertices[i].tangent = packSnorm3x10_1x2( tangents[i] );
+            }
+
+            mesh.buffers.push_back( CreateBuffer( GL_ARRAY_BUFFER, vertexCount * sizeof(PackedVertex), vertices.data() ) );
+            glVertexAttribPointer( POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), MEMBER_OFFSET(PackedVertex, position) );
+            glEnableVertexAttribArray( POSITION_ATTRIBUTE );
+            SetPackedAttributes<PackedVertex>();
+        }
+        break;
+
+    case VERTEX_FORMAT_PACKED_HALF:
+        {
+            std::vector<PackedHalfVertex> vertices( vertexCount );
+            for ( size_t i = 0; i < vertexCount; ++i )
+            {
+                for ( int c = 0; c < 3; ++c )
+                {
+                    vertices[i].position[c] = packHalf1x16( data.positions[i][c] );
+                }
+                vertices[i].position[3] = packHalf1x16( 1.0f );
+                vertices[i].normal = packSnorm3x10_1x2( vec4( data.normals[i], 0.0f ) );
+                vertices[i].textureCoord = packUnorm2x16( data.textureCoords[i] );
+                vertices[i].tangent = packSnorm3x10_1x2( tangents[i] );
+            }
+
+            mesh.buffers.push_back( CreateBuffer( GL_ARRAY_BUFFER, vertexCount * sizeof(PackedHalfVertex), vertices.data() ) );
+            glVertexAttribPointer( POSITION_ATTRIBUTE, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedHalfVertex), MEMBER_OFFSET(PackedHalfVertex, position) );
+            glEnableVertexAttribArray( POSITION_ATTRIBUTE );
+            SetPackedAttributes<PackedHalfVertex>();
+        }
+        break;
+
+    default:
+        assert( false );
+        break;
+    }
+
+    if ( GetIndexSize( format, vertexCount ) == sizeof(GLushort) )
+    {
+        std::vector<GLushort> indices( data.indices.begin(), data.indices.end() );
+        mesh.buffers.push_back( CreateBuffer( GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data() ) );
+        mesh.indexType = GL_UNSIGNED_SHORT;
+    }
+    else
+    {
+        mesh.buffers.push_back( CreateBuffer( GL_ELEMENT_ARRAY_BUFFER, data.indices.size() * sizeof(GLuint), data.indices.data() ) );
+        mesh.indexType = GL_UNSIGNED_INT;
+    }
+
+    GetStateCache().BindVertexArray( 0 );
+    GetStateCache().BindBuffer( GL_ARRAY_BUFFER, 0 );
+    GetStateCache().BindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+
+    return mesh;
+}
+
+void DestroyMesh( Mesh& mesh )
+{
+    GetStateCache().ForgetVertexArray( mesh.vao );
+    for ( GLuint buffer : mesh.buffers )
+    {
+        GetStateCache().ForgetBuffer( buffer );
+    }
+    glDeleteVertexArrays( 1, &mesh.vao );
+    glDeleteBuffers( (GLsizei)mesh.buffers.size(), mesh.buffers.data() );
+    mesh.vao = 0;
+    mesh.buffers.clear();
+    mesh.indexCount = 0;
+}
+
+int GetVertexSize( VertexFormat format )
+{
+    switch ( format )
+    {
+    case VERTEX_FORMAT_SEPARATE: return sizeof(glm::vec3) * 2 + sizeof(glm::vec2) + sizeof(glm::vec4);
+    case VERTEX_FORMAT_PACKED: return sizeof(PackedVertex);
+    case VERTEX_FORMAT_PACKED_HALF: return sizeof(PackedHalfVertex);
+    default: return 0;
+    }
+}
+
+int GetIndexSize( VertexFormat format, size_t vertexCount )
+{
+    // The separate layout is the original one and keeps its 32-bit indices.
+    if ( format == VERTEX_FORMAT_SEPARATE )
+    {
+        return sizeof(GLuint);
+    }
+    return ( vertexCount <= 0x10000 ) ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+const char* GetVertexFormatName( VertexFormat format )
+{
+    switch ( format )
+    {
+    case VERTEX_FORMAT_SEPARATE: return "separate";
+    case VERTEX_FORMAT_PACKED: return "packed";
+    case VERTEX_FORMAT_PACKED_HALF: return "packed-half";
+    default: return "unknown";
+    }
+}
+
+bool ParseVertexFormat( const std::string& name, VertexFormat& format )
+{
+    for ( int i = 0; i < VERTEX_FORMAT_COUNT; ++i )
+    {
+        if ( name == GetVertexFormatName( (VertexFormat)i ) )
+        {
+            format = (VertexFormat)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void PrintVertexFormatReport( const std::string& name, const MeshData& data )
+{
+    size_t vertexCount = data.positions.size();
+    size_t indexCount = data.indices.size();
+
+    std::cout << name << ": " << vertexCount << " vertices, " << indexCount / 3 << " triangles" << std::endl;
+    for ( int i = 0; i < VERTEX_FORMAT_COUNT; ++i )
+    {
+        VertexFormat format = (VertexFormat)i;
+        int indexSize = GetIndexSize( format, vertexCount );
+        size_t vertexBytes = vertexCount * GetVertexSize( format );
+        size_t indexBytes = indexCount * indexSize;
+
+        std::cout << "  " << GetVertexFormatName( format ) << ": " << GetVertexSize( format ) << " bytes/vertex, "
+                  << indexSize * 8 << "-bit indices, " << vertexBytes + indexBytes << " bytes total" << std::endl;
+    }
+}
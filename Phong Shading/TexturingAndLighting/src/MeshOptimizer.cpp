@@ -0,0 +1,362 @@
+#include <TextureAndLightingPCH.h>
+#include <MeshOptimizer.h>
+
+#include <algorithm>
+#include <math.h>
+
+namespace
+{
+    // Forsyth's scoring constants, tuned for a cache of 32 entries.
+    const int FORSYTH_CACHE_SIZE = 32;
+    const float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+    const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+    const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+    const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+
+    const int DEFAULT_CACHE_SIZE = 16;
+
+    float VertexScore( int cachePosition, int remainingTriangles )
+    {
+        if ( remainingTriangles == 0 )
+        {
+            return -1.0f;
+        }
+
+        float score = 0.0f;
+        if ( cachePosition >= 0 )
+        {
+            if ( cachePosition < 3 )
+            {
+                // The vertices of the last triangle get a fixed score so the
+                // next triangle does not simply reuse the same edge.
+                score = FORSYTH_LAST_TRIANGLE_SCORE;
+            }
+            else
+            {
+                const float scaler = 1.0f / ( FORSYTH_CACHE_SIZE - 3 );
+                score = powf( 1.0f - ( cachePosition - 3 ) * scaler, FORSYTH_CACHE_DECAY_POWER );
+            }
+        }
+
+        // Favor vertices with few remaining triangles to avoid leaving islands.
+        score += FORSYTH_VALENCE_BOOST_SCALE * powf( (float)remainingTriangles, -FORSYTH_VALENCE_BOOST_POWER );
+        return score;
+    }
+}
+
+VertexCacheStatistics AnalyzeVertexCache( const std::vector<GLuint>& indices, size_t vertexCount, int cacheSize )
+{
+    // Timestamp FIFO: a vertex is in the cache if it was inserted less than
+    // cacheSize insertions ago.
+    std::vector<size_t> insertedAt( vertexCount, 0 );
+    size_t timestamp = cacheSize + 1;
+    size_t transformed = 0;
+
+    for ( GLuint index : indices )
+    {
+        if ( timestamp - insertedAt[index] > (size_t)cacheSize )
+        {
+            insertedAt[index] = timestamp++;
+            ++transformed;
+        }
+    }
+
+    size_t usedVertices = 0;
+    for ( size_t i = 0; i < vertexCount; ++i )
+    {
+        usedVertices += insertedAt[i] != 0;
+    }
+
+    VertexCacheStatistics statistics;
+    statistics.transformedVertices = transformed;
+    statistics.acmr = indices.empty() ? 0.0f : transformed / float( indices.size() / 3 );
+    statistics.atvr = usedVertices == 0 ? 0.0f : transformed / float( usedVertices );
+    return statistics;
+}
+
+void OptimizeVertexCache( std::vector<GLuint>& indices, size_t vertexCount )
+{
+    size_t triangleCount = indices.size() / 3;
+    if ( triangleCount == 0 )
+    {
+        return;
+    }
+
+    // Vertex -> triangle adjacency in compressed form.
+    std::vector<int> triangleCounts( vertexCount, 0 );
+    for ( GLuint index : indices )
+    {
+        ++triangleCounts[index];
+    }
+
+    std::vector<int> adjacencyOffsets( vertexCount + 1, 0 );
+    for ( size_t v = 0; v < vertexCount; ++v )
+    {
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + triangleCounts[v];
+    }
+
+    std::vector<int> adjacency( indices.size() );
+    std::vector<int> fill( adjacencyOffsets.begin(), adjacencyOffsets.end() - 1 );
+    for ( size_t t = 0; t < triangleCount; ++t )
+    {
+        for ( int k = 0; k < 3; ++k )
+        {
+            adjacency[fill[indices[t * 3 + k]]++] = (int)t;
+        }
+    }
+
+    // remaining[v] counts the triangles of v not yet emitted; they are kept at
+    // the front of v's adjacency range.
+    std::vector<int> remaining( triangleCounts );
+    std::vector<int> cachePosition( vertexCount, -1 );
+    std::vector<float> vertexScores( vertexCount );
+    for ( size_t v = 0; v < vertexCount; ++v )
+    {
+        vertexScores[v] = VertexScore( -1, remaining[v] );
+    }
+
+    std::vector<float> triangleScores( triangleCount );
+    for ( size_t t = 0; t < triangleCount; ++t )
+    {
+        triangleScores[t] = vertexScores[indices[t * 3 + 0]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+    }
+
+    std::vector<bool> emitted( triangleCount, false );
+    std::vector<GLuint> result;
+    result.reserve( indices.size() );
+
+    std::vector<GLuint> cache;
+    std::vector<GLuint> newCache;
+    cache.reserve( FORSYTH_CACHE_SIZE + 3 );
+    newCache.reserve( FORSYTH_CACHE_SIZE + 3 );
+
+    size_t scanPosition = 0;
+    int bestTriangle = -1;
+
+    for ( size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount )
+    {
+        if ( bestTriangle < 0 )
+        {
+            // No candidate in the cache: take the next unemitted triangle in
+            // input order, which keeps this step linear overall.
+            while ( emitted[scanPosition] )
+            {
+                ++scanPosition;
+            }
+            bestTriangle = (int)scanPosition;
+        }
+
+        const GLuint* triangle = &indices[bestTriangle * 3];
+        result.insert( result.end(), triangle, triangle + 3 );
+        emitted[bestTriangle] = true;
+
+        // Remove the triangle from its vertices' remaining lists.
+        for ( int k = 0; k < 3; ++k )
+        {
+            GLuint v = triangle[k];
+            int* begin = &adjacency[adjacencyOffsets[v]];
+            int* end = begin + remaining[v];
+            int* found = std::find( begin, end, bestTriangle );
+            std::swap( *found, *( end - 1 ) );
+            --remaining[v];
+        }
+
+        // Move the triangle's vertices to the front of the LRU cache.
+        newCache.assign( triangle, triangle + 3 );
+        for ( GLuint v : cache )
+        {
+            if ( v != triangle[0] && v != triangle[1] && v != triangle[2] )
+            {
+                newCache.push_back( v );
+            }
+        }
+        cache.swap( newCache );
+
+        // Update the scores of every vertex that was or is in the cache and of
+        // their remaining triangles, and pick the best of those triangles.
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+        for ( size_t i = 0; i < cache.size(); ++i )
+        {
+            GLuint v = cache[i];
+            int position = ( i < (size_t)FORSYTH_CACHE_SIZE ) ? (int)i : -1;
+            cachePosition[v] = position;
+
+            float newScore = VertexScore( position, remaining[v] );
+            float delta = newScore - vertexScores[v];
+            vertexScores[v] = newScore;
+
+            for ( int a = 0; a < remaining[v]; ++a )
+            {
+                int t = adjacency[adjacencyOffsets[v] + a];
+                triangleScores[t] += delta;
+                if ( triangleScores[t] > bestScore )
+                {
+                    bestScore = triangleScores[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        if ( cache.size() > (size_t)FORSYTH_CACHE_SIZE )
+        {
+            cache.resize( FORSYTH_CACHE_SIZE );
+        }
+    }
+
+    indices.swap( result );
+}
+
+void OptimizeOverdraw( std::vector<GLuint>& indices, const std::vector<glm::vec3>& positions, int cacheSize )
+{
+    size_t triangleCount = indices.size() / 3;
+    if ( triangleCount == 0 )
+    {
+        return;
+    }
+
+    // Split into clusters where the simulated cache misses all three vertices
+    // of a triangle; reordering across these boundaries loses little reuse.
+    std::vector<size_t> insertedAt( positions.size(), 0 );
+    size_t timestamp = cacheSize + 1;
+    std::vector<size_t> clusterStarts;
+
+    for ( size_t t = 0; t < triangleCount; ++t )
+    {
+        int misses = 0;
+        for ( int k = 0; k < 3; ++k )
+        {
+            GLuint v = indices[t * 3 + k];
+            if ( timestamp - insertedAt[v] > (size_t)cacheSize )
+            {
+                insertedAt[v] = timestamp++;
+                ++misses;
+            }
+        }
+        if ( t == 0 || misses == 3 )
+        {
+            clusterStarts.push_back( t );
+        }
+    }
+    clusterStarts.push_back( triangleCount );
+
+    glm::vec3 meshCentroid( 0.0f );
+    for ( const glm::vec3& p : positions )
+    {
+        meshCentroid += p;
+    }
+    meshCentroid /= float( std::max<size_t>( positions.size(), 1 ) );
+
+    // Sort key: how far the cluster faces away from the mesh center. Clusters
+    // that face outward occlude the rest for most viewpoints, so draw them first.
+    struct Cluster
+    {
+        size_t begin;
+        size_t end;
+        float sortKey;
+    };
+    std::vector<Cluster> clusters;
+    for ( size_t c = 0; c + 1 < clusterStarts.size(); ++c )
+    {
+        glm::vec3 centroid( 0.0f );
+        glm::vec3 normal( 0.0f );
+        float areaSum = 0.0f;
+        for ( size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t )
+        {
+            const glm::vec3& p0 = positions[indices[t * 3 + 0]];
+            const glm::vec3& p1 = positions[indices[t * 3 + 1]];
+            const glm::vec3& p2 = positions[indices[t * 3 + 2]];
+            glm::vec3 areaNormal = glm::cross( p1 - p0, p2 - p0 );
+            float area = glm::length( areaNormal );
+            centroid += ( p0 + p1 + p2 ) * ( area / 3.0f );
+            normal += areaNormal;
+            areaSum += area;
+        }
+
+        // Area-weighted centroid and unit average normal, so the key is a
+        // distance and does not grow with the cluster's size.
+        float normalLength = glm::length( normal );
+        Cluster cluster = { clusterStarts[c], clusterStarts[c + 1], 0.0f };
+        if ( areaSum > 0.0f && normalLength > 0.0f )
+        {
+            centroid /= areaSum;
+            cluster.sortKey = glm::dot( centroid - meshCentroid, normal / normalLength );
+        }
+        clusters.push_back( cluster );
+    }
+
+    std::stable_sort( clusters.begin(), clusters.end(), []( const Cluster& a, const Cluster& b ) { return a.sortKey > b.sortKey; } );
+
+    std::vector<GLuint> result;
+    result.reserve( indices.size() );
+    for ( const Cluster& cluster : clusters )
+    {
+        result.insert( result.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3 );
+    }
+    indices.swap( result );
+}
+
+void OptimizeVertexFetch( MeshData& mesh )
+{
+    const GLuint unused = ~0u;
+    std::vector<GLuint> remap( mesh.positions.size(), unused );
+    GLuint nextVertex = 0;
+
+    for ( GLuint& index : mesh.indices )
+    {
+        if ( remap[index] == unused )
+        {
+            remap[index] = nextVertex++;
+        }
+        index = remap[index];
+    }
+
+    MeshData reordered;
+    reordered.positions.resize( nextVertex );
+    reordered.normals.resize( mesh.normals.empty() ? 0 : nextVertex );
+    reordered.textureCoords.resize( mesh.textureCoords.empty() ? 0 : nextVertex );
+    reordered.tangents.resize( mesh.tangents.empty() ? 0 : nextVertex );
+
+    for ( size_t v = 0; v < remap.size(); ++v )
+    {
+        if ( remap[v] == unused )
+        {
+            continue;
+        }
+        reordered.positions[remap[v]] = mesh.positions[v];
+        if ( !mesh.normals.empty() ) reordered.normals[remap[v]] = mesh.normals[v];
+        if ( !mesh.textureCoords.empty() ) reordered.textureCoords[remap[v]] = mesh.textureCoords[v];
+        if ( !mesh.tangents.empty() ) reordered.tangents[remap[v]] = mesh.tangents[v];
+    }
+
+    mesh.positions.swap( reordered.positions );
+    mesh.normals.swap( reordered.normals );
+    mesh.textureCoords.swap( reordered.textureCoords );
+    mesh.tangents.swap( reordered.tangents );
+}
+
+void OptimizeMesh( MeshData& mesh, bool optimizeOverdraw /* = true */ )
+{
+    OptimizeVertexCache( mesh.indices, mesh.positions.size() );
+    if ( optimizeOverdraw )
+    {
+        OptimizeOverdraw( mesh.indices, mesh.positions, DEFAULT_CACHE_SIZE );
+    }
+    OptimizeVertexFetch( mesh );
+}
+
+void PrintMeshOptimizationReport( const std::string& name, const MeshData& mesh )
+{
+    MeshData optimized = mesh;
+    OptimizeMesh( optimized );
+
+    std::cout << name << ": " << mesh.positions.size() << " vertices, " << mesh.indices.size() / 3 << " triangles" << std::endl;
+    for ( int cacheSize : { 16, 32 } )
+    {
+        VertexCacheStatistics before = AnalyzeVertexCache( mesh.indices, mesh.positions.size(), cacheSize );
+        VertexCacheStatistics after = AnalyzeVertexCache( optimized.indices, optimized.positions.size(), cacheSize );
+        std::cout << "  FIFO " << cacheSize << ": ACMR " << before.acmr << " -> " << after.acmr
+                  << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+    }
+    PrintVertexFormatReport( name, optimized );
+}
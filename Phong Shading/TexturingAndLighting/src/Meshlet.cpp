@@ -0,0 +1,278 @@
+#include <TextureAndLightingPCH.h>
+#include <Meshlet.h>
+
+#include <algorithm>
+#include <cfloat>
+
+namespace
+{
+    // Ritter's bounding sphere: start from the two points farthest apart
+    // along the x axis and grow the sphere to include every point.
+    void ComputeBoundingSphere( const std::vector<glm::vec3>& points, glm::vec3& center, float& radius )
+    {
+        size_t minX = 0, maxX = 0;
+        for ( size_t i = 1; i < points.size(); ++i )
+        {
+            if ( points[i].x < points[minX].x ) minX = i;
+            if ( points[i].x > points[maxX].x ) maxX = i;
+        }
+
+        center = ( points[minX] + points[maxX] ) * 0.5f;
+        radius = glm::length( points[maxX] - center );
+
+        for ( const glm::vec3& point : points )
+        {
+            float distance = glm::length( point - center );
+            if ( distance > radius )
+            {
+                float newRadius = ( radius + distance ) * 0.5f;
+                center += ( point - center ) * ( ( newRadius - radius ) / distance );
+                radius = newRadius;
+            }
+        }
+    }
+
+    void ComputeMeshlet( const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices, Meshlet& meshlet, const std::vector<GLuint>& vertices )
+    {
+        std::vector<glm::vec3> points;
+        for ( GLuint vertex : vertices )
+        {
+            points.push_back( positions[vertex] );
+        }
+        ComputeBoundingSphere( points, meshlet.center, meshlet.radius );
+
+        // A point and unit normal for every non-degenerate triangle.
+        std::vector<glm::vec3> corners, normals;
+        glm::vec3 axis( 0 );
+        for ( GLuint i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3 )
+        {
+            const glm::vec3& p0 = positions[indices[i + 0]];
+            glm::vec3 normal = glm::cross( positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0 );
+            float length = glm::length( normal );
+            if ( length > 0.0f )
+            {
+                corners.push_back( p0 );
+                normals.push_back( normal / length );
+                axis += normal / length;
+            }
+        }
+
+        meshlet.coneAxis = glm::vec3( 0, 0, 1 );
+        meshlet.coneApex = meshlet.center;
+        meshlet.coneCutoff = 2.0f;
+
+        float axisLength = glm::length( axis );
+        if ( normals.empty() || axisLength == 0.0f )
+        {
+            return;
+        }
+        axis /= axisLength;
+
+        float minDot = 1.0f;
+        for ( const glm::vec3& normal : normals )
+        {
+            minDot = std::min( minDot, glm::dot( axis, normal ) );
+        }
+
+        // Normals spread over (nearly) a hemisphere: every view sees some triangle.
+        if ( minDot <= 0.1f )
+        {
+            return;
+        }
+
+        // Move the apex back along the axis until every triangle's plane is
+        // in front of it; a camera inside the cone beyond the apex then sees
+        // all triangles from behind.
+        float maxT = 0.0f;
+        for ( size_t i = 0; i < normals.size(); ++i )
+        {
+            float t = glm::dot( meshlet.center - corners[i], normals[i] ) / glm::dot( axis, normals[i] );
+            maxT = std::max( maxT, t );
+        }
+
+        meshlet.coneAxis = axis;
+        meshlet.coneApex = meshlet.center - axis * maxT;
+        meshlet.coneCutoff = sqrt( 1.0f - minDot * minDot );
+    }
+}
+
+std::vector<Meshlet> BuildMeshlets( MeshData& mesh, int maxVertices, int maxTriangles )
+{
+    const std::vector<GLuint>& indices = mesh.indices;
+    size_t triangleCount = indices.size() / 3;
+    size_t vertexCount = mesh.positions.size();
+
+    // Triangles using each vertex.
+    std::vector<GLuint> adjacencyOffsets( vertexCount + 1, 0 );
+    for ( GLuint index : indices )
+    {
+        adjacencyOffsets[index + 1]++;
+    }
+    for ( size_t i = 0; i < vertexCount; ++i )
+    {
+        adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+    }
+    std::vector<GLuint> adjacency( indices.size() );
+    std::vector<GLuint> fill( adjacencyOffsets.begin(), adjacencyOffsets.end() - 1 );
+    for ( size_t i = 0; i < indices.size(); ++i )
+    {
+        adjacency[fill[indices[i]]++] = (GLuint)( i / 3 );
+    }
+
+    std::vector<glm::vec3> centroids( triangleCount );
+    std::vector<glm::vec3> normals( triangleCount );
+    for ( size_t t = 0; t < triangleCount; ++t )
+    {
+        const glm::vec3& p0 = mesh.positions[indices[t * 3 + 0]];
+        const glm::vec3& p1 = mesh.positions[indices[t * 3 + 1]];
+        const glm::vec3& p2 = mesh.positions[indices[t * 3 + 2]];
+        centroids[t] = ( p0 + p1 + p2 ) / 3.0f;
+        glm::vec3 normal = glm::cross( p1 - p0, p2 - p0 );
+        float length = glm::length( normal );
+        normals[t] = ( length > 0.0f ) ? normal / length : glm::vec3( 0 );
+    }
+
+    std::vector<bool> emitted( triangleCount, false );
+    std::vector<int> slot( vertexCount, -1 );       // Meshlet that last used each vertex.
+    std::vector<GLuint> ordered;
+    ordered.reserve( indices.size() );
+
+    std::vector<Meshlet> meshlets;
+    std::vector<GLuint> vertices;
+    size_t nextSeed = 0;
+
+    while ( ordered.size() < indices.size() )
+    {
+        while ( emitted[nextSeed] )
+        {
+            ++nextSeed;
+        }
+
+        Meshlet meshlet = {};
+        meshlet.firstIndex = (GLuint)ordered.size();
+        vertices.clear();
+        int id = (int)meshlets.size();
+        glm::vec3 centroidSum( 0 ), normalSum( 0 );
+
+        size_t triangle = nextSeed;
+        while ( true )
+        {
+            emitted[triangle] = true;
+            for ( int k = 0; k < 3; ++k )
+            {
+                GLuint vertex = indices[triangle * 3 + k];
+                ordered.push_back( vertex );
+                if ( slot[vertex] != id )
+                {
+                    slot[vertex] = id;
+                    vertices.push_back( vertex );
+                }
+            }
+            meshlet.indexCount += 3;
+            centroidSum += centroids[triangle];
+            normalSum += normals[triangle];
+
+            if ( (int)meshlet.indexCount / 3 >= maxTriangles )
+            {
+                break;
+            }
+
+            // Grow through triangles sharing a vertex with the meshlet. Prefer
+            // those adding the fewest vertices, then those closest to the
+            // meshlet's centroid and best aligned with its average normal.
+            glm::vec3 center = centroidSum / (float)( meshlet.indexCount / 3 );
+            glm::vec3 axis = ( glm::length( normalSum ) > 0.0f ) ? glm::normalize( normalSum ) : glm::vec3( 0 );
+            size_t best = triangleCount;
+            int bestExtra = 3;
+            float bestScore = FLT_MAX;
+            for ( GLuint vertex : vertices )
+            {
+                for ( GLuint a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; ++a )
+                {
+                    GLuint candidate = adjacency[a];
+                    if ( emitted[candidate] )
+                    {
+                        continue;
+                    }
+
+                    int extra = 0;
+                    for ( int k = 0; k < 3; ++k )
+                    {
+                        extra += ( slot[indices[candidate * 3 + k]] != id ) ? 1 : 0;
+                    }
+                    if ( (int)vertices.size() + extra > maxVertices )
+                    {
+                        continue;
+                    }
+
+                    float score = glm::length( centroids[candidate] - center ) * ( 2.0f - glm::dot( normals[candidate], axis ) );
+                    if ( extra < bestExtra || ( extra == bestExtra && score < bestScore ) )
+                    {
+                        best = candidate;
+                        bestExtra = extra;
+                        bestScore = score;
+                    }
+                }
+            }
+
+            if ( best == triangleCount )
+            {
+                break;
+            }
+            triangle = best;
+        }
+
+        ComputeMeshlet( mesh.positions, ordered, meshlet, vertices );
+        meshlets.push_back( meshlet );
+    }
+
+    mesh.indices.swap( ordered );
+    return meshlets;
+}
+
+void CullMeshlets( const std::vector<Meshlet>& meshlets, const glm::mat4& modelMatrix, const Frustum& frustum,
+                   const glm::vec3& cameraPosition, int indexSize, DrawRanges& ranges, MeshletCullStatistics& statistics )
+{
+    glm::mat3 rotationScale( modelMatrix );
+    float scale = glm::length( rotationScale[0] );
+
+    size_t firstRange = ranges.counts.size();
+    GLuint rangeEnd = 0;
+
+    for ( const Meshlet& meshlet : meshlets )
+    {
+        statistics.meshlets++;
+
+        glm::vec3 center = glm::vec3( modelMatrix * glm::vec4( meshlet.center, 1 ) );
+        if ( !IntersectsSphere( frustum, center, meshlet.radius * scale ) )
+        {
+            statistics.frustumCulled++;
+            continue;
+        }
+
+        if ( meshlet.coneCutoff <= 1.0f )
+        {
+            glm::vec3 apex = glm::vec3( modelMatrix * glm::vec4( meshlet.coneApex, 1 ) );
+            glm::vec3 axis = rotationScale * meshlet.coneAxis / scale;
+            if ( glm::dot( glm::normalize( apex - cameraPosition ), axis ) >= meshlet.coneCutoff )
+            {
+                statistics.backfaceCulled++;
+                continue;
+            }
+        }
+
+        statistics.trianglesSubmitted += meshlet.indexCount / 3;
+
+        // Extend the previous range when the meshlets are adjacent in the index buffer.
+        if ( ranges.counts.size() > firstRange && rangeEnd == meshlet.firstIndex )
+        {
+            ranges.counts.back() += meshlet.indexCount;
+        }
+        else
+        {
+            ranges.counts.push_back( meshlet.indexCount );
+            ranges.offsets.push_back( BUFFER_OFFSET( (size_t)meshlet.firstIndex * indexSize ) );
+        }
+        rangeEnd = meshlet.firstIndex + meshlet.indexCount;
+    }
+}
@@ -0,0 +1,44 @@
+#include <TextureAndLightingPCH.h>
+#include <Parallel.h>
+
+#include <algorithm>
+#include <thread>
+
+int GetWorkerCount()
+{
+    static const int workerCount = std::max( 1, (int)std::thread::hardware_concurrency() );
+    return workerCount;
+}
+
+void ParallelFor( int count, int minGrain, const std::function<void( int begin, int end )>& func )
+{
+    if ( count <= 0 )
+    {
+        return;
+    }
+
+    int grain = std::max( 1, minGrain );
+    int taskCount = std::min( GetWorkerCount(), ( count + grain - 1 ) / grain );
+    if ( taskCount <= 1 )
+    {
+        func( 0, count );
+        return;
+    }
+
+    int rangeSize = ( count + taskCount - 1 ) / taskCount;
+
+    std::vector<std::thread> threads;
+    threads.reserve( taskCount - 1 );
+    for ( int begin = rangeSize; begin < count; begin += rangeSize )
+    {
+        int end = std::min( count, begin + rangeSize );
+        threads.emplace_back( [&func, begin, end]() { func( begin, end ); } );
+    }
+
+    func( 0, std::min( count, rangeSize ) );
+
+    for ( std::thread& thread : threads )
+    {
+        thread.join();
+    }
+}
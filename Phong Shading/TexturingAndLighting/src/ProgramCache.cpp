@@ -0,0 +1,186 @@
+#include <TextureAndLightingPCH.h>
+#include <ProgramCache.h>
+#include <Hash.h>
+
+#include <chrono>
+#include <cstring>
+
+namespace
+{
+    // Bump when the blob layout changes.
+    const uint32_t PROGRAM_BLOB_VERSION = 1;
+
+    struct ProgramBlobHeader
+    {
+        uint32_t version;
+        uint32_t format;            // From glGetProgramBinary.
+        uint64_t binarySize;
+        double buildMs;             // Compile and link time of the stored program.
+    };
+
+    std::string GetString( GLenum name )
+    {
+        const GLubyte* value = glGetString( name );
+        return value ? std::string( (const char*)value ) : std::string();
+    }
+}
+
+ProgramCache::ProgramCache( const std::string& directory )
+    : m_Blobs( directory, ".program" )
+    , m_DriverKey( 0 )
+    , m_Supported( false )
+    , m_Statistics()
+{}
+
+void ProgramCache::SetDirectory( const std::string& directory )
+{
+    m_Blobs.SetDirectory( directory );
+
+    GLint formats = 0;
+    if ( GLEW_ARB_get_program_binary )
+    {
+        glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &formats );
+    }
+    m_Supported = formats > 0;
+
+    m_DriverKey = HashValue( PROGRAM_BLOB_VERSION );
+    m_DriverKey = HashString( GetString( GL_VENDOR ), m_DriverKey );
+    m_DriverKey = HashString( GetString( GL_RENDERER ), m_DriverKey );
+    m_DriverKey = HashString( GetString( GL_VERSION ), m_DriverKey );
+}
+
+const std::string& ProgramCache::GetDirectory() const
+{
+    return m_Blobs.GetDirectory();
+}
+
+bool ProgramCache::IsEnabled() const
+{
+    return m_Supported && m_Blobs.IsEnabled();
+}
+
+uint64_t ProgramCache::MakeKey( const std::vector<uint64_t>& shaderHashes ) const
+{
+    uint64_t key = m_DriverKey;
+    for ( uint64_t shaderHash : shaderHashes )
+    {
+        key = HashValue( shaderHash, key );
+    }
+    return key;
+}
+
+GLuint ProgramCache::Load( uint64_t key )
+{
+    if ( !IsEnabled() )
+    {
+        return 0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    MappedFile file;
+    ProgramBlobHeader header = {};
+    size_t payloadSize = 0;
+    if ( m_Blobs.Load( key, file ) )
+    {
+        payloadSize = BlobCache::GetPayloadSize( file );
+        if ( payloadSize >= sizeof(header) )
+        {
+            memcpy( &header, BlobCache::GetPayload( file ), sizeof(header) );
+        }
+    }
+    if ( header.version != PROGRAM_BLOB_VERSION || payloadSize != sizeof(header) + header.binarySize )
+    {
+        ++m_Statistics.misses;
+        return 0;
+    }
+
+    const unsigned char* binary = (const unsigned char*)BlobCache::GetPayload( file ) + sizeof(header);
+    GLuint program = glCreateProgram();
+    glProgramBinary( program, header.format, binary, (GLsizei)header.binarySize );
+
+    GLint linkStatus = GL_FALSE;
+    glGetProgramiv( program, GL_LINK_STATUS, &linkStatus );
+    if ( linkStatus != GL_TRUE )
+    {
+        // An unknown format raises GL_INVALID_ENUM; the caller rebuilds the
+        // program, so the error is not the caller's.
+        glDeleteProgram( program );
+        while ( glGetError() != GL_NO_ERROR )
+        {}
+        ++m_Statistics.rejected;
+        ++m_Statistics.misses;
+        return 0;
+    }
+
+    double loadMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    ++m_Statistics.hits;
+    m_Statistics.loadMs += loadMs;
+    m_Statistics.savedMs += header.buildMs - loadMs;
+    return program;
+}
+
+void ProgramCache::Store( uint64_t key, GLuint program, double buildMs )
+{
+    if ( !IsEnabled() || program == 0 )
+    {
+        return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv( program, GL_PROGRAM_BINARY_LENGTH, &length );
+    if ( length <= 0 )
+    {
+        return;
+    }
+
+    BlobCache::Writer writer;
+    if ( !m_Blobs.BeginStore( key, sizeof(ProgramBlobHeader) + length, writer ) )
+    {
+        return;
+    }
+
+    unsigned char* payload = (unsigned char*)writer.GetPayload();
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary( program, length, &written, &format, payload + sizeof(ProgramBlobHeader) );
+    if ( written != length )
+    {
+        // The writer discards the blob.
+        return;
+    }
+
+    ProgramBlobHeader header = {};
+    header.version = PROGRAM_BLOB_VERSION;
+    header.format = format;
+    header.binarySize = (uint64_t)length;
+    header.buildMs = buildMs;
+    memcpy( payload, &header, sizeof(header) );
+
+    if ( writer.Commit() )
+    {
+        ++m_Statistics.stores;
+    }
+}
+
+const ProgramCacheStatistics& ProgramCache::GetStatistics() const
+{
+    return m_Statistics;
+}
+
+void ProgramCache::PrintStatistics( std::ostream& out ) const
+{
+    if ( !IsEnabled() )
+    {
+        out << "Program cache: disabled" << ( m_Supported ? "" : " (no program binary formats)" ) << std::endl;
+        return;
+    }
+
+    out << "Program cache: " << m_Statistics.hits << " hits, " << m_Statistics.misses << " misses";
+    if ( m_Statistics.rejected > 0 )
+    {
+        out << " (" << m_Statistics.rejected << " rejected by the driver)";
+    }
+    out << ", " << m_Statistics.stores << " stored; loading took " << m_Statistics.loadMs << " ms and saved "
+        << m_Statistics.savedMs << " ms (" << GetDirectory() << ")" << std::endl;
+}
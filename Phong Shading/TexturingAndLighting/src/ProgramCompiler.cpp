@@ -0,0 +1,228 @@
+#include <TextureAndLightingPCH.h>
+#include <ProgramCompiler.h>
+
+#include <algorithm>
+#include <cstring>
+
+// GL_KHR_parallel_shader_compile is newer than GLEW 1.10.
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace
+{
+    typedef void (GLAPIENTRY * MaxShaderCompilerThreadsProc)( GLuint count );
+
+    bool HasExtension( const char* name )
+    {
+        GLint count = 0;
+        glGetIntegerv( GL_NUM_EXTENSIONS, &count );
+        for ( GLint i = 0; i < count; ++i )
+        {
+            const GLubyte* extension = glGetStringi( GL_EXTENSIONS, i );
+            if ( extension != NULL && strcmp( (const char*)extension, name ) == 0 )
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::string GetShaderLog( GLuint shader )
+    {
+        GLint logLength = 0;
+        glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &logLength );
+        std::vector<GLchar> infoLog( std::max( logLength, 1 ) );
+        glGetShaderInfoLog( shader, (GLsizei)infoLog.size(), NULL, infoLog.data() );
+        return infoLog.data();
+    }
+
+    std::string GetProgramLog( GLuint program )
+    {
+        GLint logLength = 0;
+        glGetProgramiv( program, GL_INFO_LOG_LENGTH, &logLength );
+        std::vector<GLchar> infoLog( std::max( logLength, 1 ) );
+        glGetProgramInfoLog( program, (GLsizei)infoLog.size(), NULL, infoLog.data() );
+        return infoLog.data();
+    }
+
+    void PrintLog( const std::string& log )
+    {
+#ifdef _WIN32
+        OutputDebugString( log.c_str() );
+#else
+        std::cerr << log << std::endl;
+#endif
+    }
+}
+
+ProgramCompiler::ProgramCompiler()
+    : m_Parallel( false )
+    , m_Statistics()
+{}
+
+void ProgramCompiler::Initialize()
+{
+    const char* names[] = { "glMaxShaderCompilerThreadsKHR", "glMaxShaderCompilerThreadsARB" };
+    const char* extensions[] = { "GL_KHR_parallel_shader_compile", "GL_ARB_parallel_shader_compile" };
+    for ( int i = 0; i < 2 && !m_Parallel; ++i )
+    {
+        if ( HasExtension( extensions[i] ) )
+        {
+            MaxShaderCompilerThreadsProc maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)glutGetProcAddress( names[i] );
+            if ( maxShaderCompilerThreads != NULL )
+            {
+                // As many threads as the driver likes.
+                maxShaderCompilerThreads( 0xFFFFFFFF );
+            }
+            m_Parallel = true;
+        }
+    }
+}
+
+bool ProgramCompiler::IsParallel() const
+{
+    return m_Parallel;
+}
+
+void ProgramCompiler::Submit( const std::vector<ShaderSource>& shaders, const CompletionFunction& done )
+{
+    Job job;
+    job.done = done;
+    job.start = std::chrono::steady_clock::now();
+
+    job.program = glCreateProgram();
+    for ( const ShaderSource& source : shaders )
+    {
+        std::vector<const GLchar*> strings;
+        for ( const std::string& text : source.strings )
+        {
+            strings.push_back( text.c_str() );
+        }
+
+        GLuint shader = glCreateShader( source.type );
+        glShaderSource( shader, (GLsizei)strings.size(), strings.data(), NULL );
+        glCompileShader( shader );
+        glAttachShader( job.program, shader );
+        job.shaders.push_back( shader );
+        job.names.push_back( source.name );
+    }
+
+    // Keep the binary available for the program cache.
+    if ( GLEW_ARB_get_program_binary )
+    {
+        glProgramParameteri( job.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+    }
+    glLinkProgram( job.program );
+
+    m_Jobs.push_back( job );
+    ++m_Statistics.submitted;
+}
+
+bool ProgramCompiler::IsComplete( const Job& job ) const
+{
+    GLint complete = GL_TRUE;
+    if ( m_Parallel )
+    {
+        glGetProgramiv( job.program, GL_COMPLETION_STATUS_KHR, &complete );
+    }
+    return complete == GL_TRUE;
+}
+
+void ProgramCompiler::Complete( Job& job )
+{
+    ProgramBuild build;
+    build.program = job.program;
+
+    GLint linkStatus = GL_FALSE;
+    glGetProgramiv( job.program, GL_LINK_STATUS, &linkStatus );
+    if ( linkStatus != GL_TRUE )
+    {
+        // Report the shaders that did not compile; if they all did, the
+        // link itself failed.
+        bool compiled = true;
+        for ( size_t i = 0; i < job.shaders.size(); ++i )
+        {
+            GLint compileStatus = GL_FALSE;
+            glGetShaderiv( job.shaders[i], GL_COMPILE_STATUS, &compileStatus );
+            if ( compileStatus != GL_TRUE )
+            {
+                PrintLog( job.names[i] + ":\n" + GetShaderLog( job.shaders[i] ) );
+                compiled = false;
+            }
+        }
+        if ( compiled )
+        {
+            std::string names;
+            for ( const std::string& name : job.names )
+            {
+                names += ( names.empty() ? "" : " + " ) + name;
+            }
+            PrintLog( "Linking " + names + ":\n" + GetProgramLog( job.program ) );
+        }
+
+        glDeleteProgram( job.program );
+        build.program = 0;
+        ++m_Statistics.failed;
+    }
+
+    for ( GLuint shader : job.shaders )
+    {
+        glDeleteShader( shader );
+    }
+
+    build.buildMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - job.start ).count();
+    ++m_Statistics.completed;
+    if ( job.done )
+    {
+        job.done( build );
+    }
+}
+
+void ProgramCompiler::Poll()
+{
+    // Take the finished jobs out first; a completion may submit more.
+    std::vector<Job> finished;
+    for ( size_t i = 0; i < m_Jobs.size(); )
+    {
+        bool complete = m_Parallel ? IsComplete( m_Jobs[i] ) : finished.empty();
+        if ( complete )
+        {
+            finished.push_back( m_Jobs[i] );
+            m_Jobs.erase( m_Jobs.begin() + i );
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    for ( Job& job : finished )
+    {
+        Complete( job );
+    }
+}
+
+void ProgramCompiler::Finish()
+{
+    while ( !m_Jobs.empty() )
+    {
+        std::vector<Job> jobs;
+        jobs.swap( m_Jobs );
+        for ( Job& job : jobs )
+        {
+            Complete( job );
+        }
+    }
+}
+
+size_t ProgramCompiler::GetPendingCount() const
+{
+    return m_Jobs.size();
+}
+
+const ProgramCompilerStatistics& ProgramCompiler::GetStatistics() const
+{
+    return m_Statistics;
+}
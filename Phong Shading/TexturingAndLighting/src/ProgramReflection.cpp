@@ -0,0 +1,254 @@
+#include <TextureAndLightingPCH.h>
+#include <ProgramReflection.h>
+
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+    struct NameTable
+    {
+        std::unordered_map<std::string, UniformName> ids;
+        std::vector<std::string> names;
+    };
+
+    NameTable& GetNameTable()
+    {
+        static NameTable table;
+        return table;
+    }
+
+    // Bytes of shadow storage needed for one element of a uniform type.
+    size_t GetUniformValueSize( GLenum type )
+    {
+        switch ( type )
+        {
+        case GL_FLOAT_VEC2: return 2 * sizeof(float);
+        case GL_FLOAT_VEC3: return 3 * sizeof(float);
+        case GL_FLOAT_VEC4: return 4 * sizeof(float);
+        case GL_FLOAT_MAT3: return 9 * sizeof(float);
+        case GL_FLOAT_MAT4: return 16 * sizeof(float);
+        default:            return 4;   // float, int, bool and samplers
+        }
+    }
+
+    // Name ids are small consecutive integers; spread them over the table.
+    inline uint32_t HashName( UniformName name )
+    {
+        return name * 2654435761u;
+    }
+}
+
+UniformStatistics ProgramReflection::s_Statistics = {};
+
+UniformName InternUniformName( const std::string& name )
+{
+    NameTable& table = GetNameTable();
+    auto id = table.ids.find( name );
+    if ( id != table.ids.end() )
+    {
+        return id->second;
+    }
+
+    UniformName newId = (UniformName)table.names.size();
+    table.ids[name] = newId;
+    table.names.push_back( name );
+    return newId;
+}
+
+const std::string& GetUniformNameString( UniformName name )
+{
+    return GetNameTable().names[name];
+}
+
+ProgramReflection::ProgramReflection()
+    : m_Program( 0 )
+{}
+
+void ProgramReflection::Reflect( GLuint program )
+{
+    m_Program = program;
+    m_Uniforms.clear();
+    m_Values.clear();
+
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv( program, GL_ACTIVE_UNIFORMS, &count );
+    glGetProgramiv( program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength );
+
+    std::vector<char> buffer( std::max( maxLength, 1 ) );
+    for ( GLint i = 0; i < count; ++i )
+    {
+        Uniform uniform;
+        GLsizei length = 0;
+        glGetActiveUniform( program, i, (GLsizei)buffer.size(), &length, &uniform.size, &uniform.type, buffer.data() );
+
+        // Arrays are reported as "name[0]"; keep the base name.
+        std::string name( buffer.data(), length );
+        if ( name.size() > 3 && name.compare( name.size() - 3, 3, "[0]" ) == 0 )
+        {
+            name.resize( name.size() - 3 );
+        }
+
+        uniform.location = glGetUniformLocation( program, buffer.data() );
+        if ( uniform.location < 0 )
+        {
+            continue;   // Uniform block members have no location.
+        }
+
+        uniform.name = InternUniformName( name );
+        uniform.valueOffset = (uint32_t)m_Values.size();
+        uniform.valueSet = false;
+        m_Values.resize( m_Values.size() + GetUniformValueSize( uniform.type ) );
+        m_Uniforms.push_back( uniform );
+    }
+
+    // Keep the table at most half full.
+    size_t slotCount = 4;
+    while ( slotCount < m_Uniforms.size() * 2 )
+    {
+        slotCount *= 2;
+    }
+    m_Slots.assign( slotCount, -1 );
+    for ( size_t i = 0; i < m_Uniforms.size(); ++i )
+    {
+        size_t slot = HashName( m_Uniforms[i].name ) & ( slotCount - 1 );
+        while ( m_Slots[slot] >= 0 )
+        {
+            slot = ( slot + 1 ) & ( slotCount - 1 );
+        }
+        m_Slots[slot] = (int)i;
+    }
+}
+
+GLuint ProgramReflection::GetProgram() const
+{
+    return m_Program;
+}
+
+size_t ProgramReflection::GetUniformCount() const
+{
+    return m_Uniforms.size();
+}
+
+int ProgramReflection::FindSlot( UniformName name ) const
+{
+    if ( m_Slots.empty() )
+    {
+        return -1;
+    }
+
+    size_t mask = m_Slots.size() - 1;
+    for ( size_t slot = HashName( name ) & mask; m_Slots[slot] >= 0; slot = ( slot + 1 ) & mask )
+    {
+        if ( m_Uniforms[m_Slots[slot]].name == name )
+        {
+            return m_Slots[slot];
+        }
+    }
+    return -1;
+}
+
+GLint ProgramReflection::GetLocation( UniformName name ) const
+{
+    int index = FindSlot( name );
+    return ( index >= 0 ) ? m_Uniforms[index].location : -1;
+}
+
+ProgramReflection::Uniform* ProgramReflection::Update( UniformName name, const void* value, size_t size )
+{
+    int index = FindSlot( name );
+    if ( index < 0 )
+    {
+        return NULL;
+    }
+
+    // A setter of the wrong type would overrun the shadow slot and fail in
+    // GL anyway; leave the uniform as it is.
+    Uniform& uniform = m_Uniforms[index];
+    if ( size != GetUniformValueSize( uniform.type ) )
+    {
+        assert( false );
+        return NULL;
+    }
+
+    unsigned char* shadow = &m_Values[uniform.valueOffset];
+    if ( uniform.valueSet && memcmp( shadow, value, size ) == 0 )
+    {
+        s_Statistics.skipped++;
+        return NULL;
+    }
+
+    memcpy( shadow, value, size );
+    uniform.valueSet = true;
+    s_Statistics.uploads++;
+    return &uniform;
+}
+
+void ProgramReflection::Set( UniformName name, int value )
+{
+    if ( Uniform* uniform = Update( name, &value, sizeof(value) ) )
+    {
+        glUniform1i( uniform->location, value );
+    }
+}
+
+void ProgramReflection::Set( UniformName name, float value )
+{
+    if ( Uniform* uniform = Update( name, &value, sizeof(value) ) )
+    {
+        glUniform1f( uniform->location, value );
+    }
+}
+
+void ProgramReflection::Set( UniformName name, const glm::vec4& value )
+{
+    if ( Uniform* uniform = Update( name, glm::value_ptr( value ), sizeof(value) ) )
+    {
+        glUniform4fv( uniform->location, 1, glm::value_ptr( value ) );
+    }
+}
+
+void ProgramReflection::Set( UniformName name, const glm::mat4& value )
+{
+    if ( Uniform* uniform = Update( name, glm::value_ptr( value ), sizeof(value) ) )
+    {
+        glUniformMatrix4fv( uniform->location, 1, GL_FALSE, glm::value_ptr( value ) );
+    }
+}
+
+const UniformStatistics& ProgramReflection::GetStatistics()
+{
+    return s_Statistics;
+}
+
+void ProgramReflection::ResetStatistics()
+{
+    s_Statistics = UniformStatistics();
+}
+
+bool ProgramReflection::BindUniformBlock( const char* name, GLuint binding ) const
+{
+    GLuint index = glGetUniformBlockIndex( m_Program, name );
+    if ( index == GL_INVALID_INDEX )
+    {
+        return false;
+    }
+
+    glUniformBlockBinding( m_Program, index, binding );
+    return true;
+}
+
+void ProgramReflection::Print( std::ostream& out ) const
+{
+    out << "Program " << m_Program << ": " << m_Uniforms.size() << " active uniforms" << std::endl;
+    for ( const Uniform& uniform : m_Uniforms )
+    {
+        out << "  " << uniform.location << " " << GetUniformNameString( uniform.name )
+            << " (type 0x" << std::hex << uniform.type << std::dec;
+        if ( uniform.size > 1 )
+        {
+            out << ", " << uniform.size << " elements";
+        }
+        out << ")" << std::endl;
+    }
+}
@@ -0,0 +1,293 @@
+#include <TextureAndLightingPCH.h>
+#include <RenderQueue.h>
+#include <StateCache.h>
+#include <TransformBatch.h>
+
+#include <chrono>
+#include <cstring>
+
+namespace
+{
+    const int PASS_BITS = 4;
+    const int PROGRAM_BITS = 6;
+    const int TEXTURE_SET_BITS = 8;
+    const int MATERIAL_BITS = 10;
+    const int MESH_BITS = 12;
+    const int DEPTH_BITS = 24;
+
+    // Fields within the state bits.
+    const int MESH_SHIFT = 0;
+    const int MATERIAL_SHIFT = MESH_SHIFT + MESH_BITS;
+    const int TEXTURE_SET_SHIFT = MATERIAL_SHIFT + MATERIAL_BITS;
+    const int PROGRAM_SHIFT = TEXTURE_SET_SHIFT + TEXTURE_SET_BITS;
+    const int STATE_BITS = PROGRAM_SHIFT + PROGRAM_BITS;
+
+    // Opaque keys put the state above the depth, transparent keys below it.
+    const int PASS_SHIFT = STATE_BITS + DEPTH_BITS;
+    const int OPAQUE_STATE_SHIFT = DEPTH_BITS;
+    const int TRANSPARENT_DEPTH_SHIFT = STATE_BITS;
+
+    static_assert( PASS_SHIFT + PASS_BITS == 64, "Sort key fields must fill 64 bits" );
+
+    // View distances past this all sort as the farthest.
+    const float MAX_SORT_DEPTH = 1024.0f;
+
+    inline uint64_t GetField( uint64_t key, int shift, int bits )
+    {
+        return ( key >> shift ) & ( ( 1ull << bits ) - 1 );
+    }
+
+    // The state bits of a key in either layout.
+    inline uint64_t GetState( uint64_t key )
+    {
+        int shift = ( GetField( key, PASS_SHIFT, PASS_BITS ) == RENDER_PASS_TRANSPARENT ) ? 0 : OPAQUE_STATE_SHIFT;
+        return GetField( key, shift, STATE_BITS );
+    }
+
+    // Pass and state: items with the same prefix share all state.
+    inline uint64_t GetStatePrefix( uint64_t key )
+    {
+        return ( ( key >> PASS_SHIFT ) << STATE_BITS ) | GetState( key );
+    }
+}
+
+RenderQueue::RenderQueue()
+    : m_Statistics()
+{
+    // Texture set 0 binds nothing.
+    m_TextureSets.push_back( std::vector<TextureBinding>() );
+}
+
+void RenderQueue::SetViewProjection( const glm::mat4& viewProjection )
+{
+    m_ViewProjection = viewProjection;
+}
+
+int RenderQueue::RegisterProgram( const ProgramBinding& binding )
+{
+    assert( m_Programs.size() < ( 1u << PROGRAM_BITS ) );
+    m_Programs.push_back( binding );
+    return (int)m_Programs.size() - 1;
+}
+
+int RenderQueue::RegisterTextureSet( const std::vector<TextureBinding>& textures )
+{
+    assert( m_TextureSets.size() < ( 1u << TEXTURE_SET_BITS ) );
+    m_TextureSets.push_back( textures );
+    return (int)m_TextureSets.size() - 1;
+}
+
+int RenderQueue::GetMeshId( GLuint vao )
+{
+    // There are only a handful of vertex arrays; a linear search is fine.
+    for ( size_t i = 0; i < m_Meshes.size(); ++i )
+    {
+        if ( m_Meshes[i] == vao )
+        {
+            return (int)i;
+        }
+    }
+
+    assert( m_Meshes.size() < ( 1u << MESH_BITS ) );
+    m_Meshes.push_back( vao );
+    return (int)m_Meshes.size() - 1;
+}
+
+uint64_t RenderQueue::MakeSortKey( RenderPass pass, int program, int textureSet, int material, int mesh, float depth )
+{
+    uint64_t maxDepth = ( 1ull << DEPTH_BITS ) - 1;
+    uint64_t quantizedDepth = (uint64_t)( std::min( std::max( depth / MAX_SORT_DEPTH, 0.0f ), 1.0f ) * maxDepth );
+    if ( pass == RENDER_PASS_TRANSPARENT )
+    {
+        quantizedDepth = maxDepth - quantizedDepth;
+    }
+
+    // Material -1 (none) wraps to the largest value and sorts last.
+    uint64_t state = ( (uint64_t)program << PROGRAM_SHIFT )
+                   | ( (uint64_t)textureSet << TEXTURE_SET_SHIFT )
+                   | ( ( (uint64_t)material & ( ( 1ull << MATERIAL_BITS ) - 1 ) ) << MATERIAL_SHIFT )
+                   | ( (uint64_t)mesh << MESH_SHIFT );
+
+    // Transparent draws blend in order, so their depth outranks the state.
+    uint64_t key = (uint64_t)pass << PASS_SHIFT;
+    if ( pass == RENDER_PASS_TRANSPARENT )
+    {
+        return key | ( quantizedDepth << TRANSPARENT_DEPTH_SHIFT ) | state;
+    }
+    return key | ( state << OPAQUE_STATE_SHIFT ) | quantizedDepth;
+}
+
+void RenderQueue::Submit( RenderPass pass, int program, int textureSet, const RenderItem& item, float depth )
+{
+    m_Keys.push_back( MakeSortKey( pass, program, textureSet, item.material, GetMeshId( item.vao ), depth ) );
+    m_Order.push_back( (uint32_t)m_Items.size() );
+    m_Items.push_back( item );
+}
+
+void RenderQueue::RadixSort( std::vector<uint64_t>& keys, std::vector<uint32_t>& values, std::vector<uint64_t>& scratchKeys, std::vector<uint32_t>& scratchValues )
+{
+    size_t count = keys.size();
+    scratchKeys.resize( count );
+    scratchValues.resize( count );
+
+    for ( int shift = 0; shift < 64; shift += 8 )
+    {
+        size_t offsets[256] = {};
+        for ( uint64_t key : keys )
+        {
+            ++offsets[( key >> shift ) & 0xFF];
+        }
+
+        // Most bytes (unused ids, the high depth bits) are the same for every
+        // key; skip those passes.
+        if ( offsets[( keys[0] >> shift ) & 0xFF] == count )
+        {
+            continue;
+        }
+
+        size_t sum = 0;
+        for ( size_t& offset : offsets )
+        {
+            size_t bucketCount = offset;
+            offset = sum;
+            sum += bucketCount;
+        }
+
+        for ( size_t i = 0; i < count; ++i )
+        {
+            size_t destination = offsets[( keys[i] >> shift ) & 0xFF]++;
+            scratchKeys[destination] = keys[i];
+            scratchValues[destination] = values[i];
+        }
+        keys.swap( scratchKeys );
+        values.swap( scratchValues );
+    }
+}
+
+void RenderQueue::Flush()
+{
+    m_Statistics = RenderQueueStatistics();
+    m_Statistics.items = m_Items.size();
+    if ( m_Items.empty() )
+    {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    RadixSort( m_Keys, m_Order, m_ScratchKeys, m_ScratchOrder );
+    m_Statistics.sortMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+
+    // All model-view-projections in one batch, before any callback needs them.
+    MultiplyMatrices( m_ViewProjection, &m_Items[0].model, sizeof(RenderItem), m_Items.size(), &m_Items[0].modelViewProjection, sizeof(RenderItem) );
+
+    StateCache& state = GetStateCache();
+    uint64_t previousKey = ~0ull;
+    for ( size_t begin = 0; begin < m_Keys.size(); )
+    {
+        uint64_t key = m_Keys[begin];
+        uint64_t stateBits = GetState( key );
+        uint64_t previousState = ( previousKey == ~0ull ) ? ~0ull : GetState( previousKey );
+        const ProgramBinding& program = m_Programs[GetField( stateBits, PROGRAM_SHIFT, PROGRAM_BITS )];
+
+        // Apply the state that differs from the previous batch. Transparent
+        // batches may switch back and forth, so compare field by field.
+        bool programChanged = previousKey == ~0ull || GetField( stateBits, PROGRAM_SHIFT, PROGRAM_BITS ) != GetField( previousState, PROGRAM_SHIFT, PROGRAM_BITS );
+        if ( programChanged )
+        {
+            state.UseProgram( program.program );
+            if ( program.bind )
+            {
+                program.bind();
+            }
+            ++m_Statistics.stateChanges;
+        }
+        if ( programChanged || GetField( stateBits, TEXTURE_SET_SHIFT, TEXTURE_SET_BITS ) != GetField( previousState, TEXTURE_SET_SHIFT, TEXTURE_SET_BITS ) )
+        {
+            for ( const TextureBinding& texture : m_TextureSets[GetField( stateBits, TEXTURE_SET_SHIFT, TEXTURE_SET_BITS )] )
+            {
+                state.BindTexture( texture.unit, texture.target, texture.texture );
+            }
+            ++m_Statistics.stateChanges;
+        }
+        if ( programChanged || GetField( stateBits, MATERIAL_SHIFT, MATERIAL_BITS ) != GetField( previousState, MATERIAL_SHIFT, MATERIAL_BITS ) )
+        {
+            if ( program.setMaterial )
+            {
+                program.setMaterial( m_Items[m_Order[begin]].material );
+            }
+            ++m_Statistics.stateChanges;
+        }
+        if ( GetField( stateBits, MESH_SHIFT, MESH_BITS ) != GetField( previousState, MESH_SHIFT, MESH_BITS ) )
+        {
+            ++m_Statistics.stateChanges;
+        }
+        previousKey = key;
+
+        // Transparent runs end wherever the state changes between
+        // depth-sorted neighbours.
+        size_t end = begin + 1;
+        while ( end < m_Keys.size() && GetStatePrefix( m_Keys[end] ) == GetStatePrefix( key ) )
+        {
+            ++end;
+        }
+
+        // Split the run where the transform changes.
+        for ( size_t first = begin; first < end; )
+        {
+            const RenderItem& item = m_Items[m_Order[first]];
+            size_t last = first + 1;
+            while ( last < end && memcmp( &m_Items[m_Order[last]].model, &item.model, sizeof(glm::mat4) ) == 0 )
+            {
+                ++last;
+            }
+
+            if ( program.setObject )
+            {
+                program.setObject( item );
+            }
+            DrawMulti( first, last );
+            first = last;
+        }
+        begin = end;
+    }
+
+    m_Items.clear();
+    m_Keys.clear();
+    m_Order.clear();
+}
+
+void RenderQueue::DrawMulti( size_t begin, size_t end )
+{
+    const RenderItem& item = m_Items[m_Order[begin]];
+    GetStateCache().BindVertexArray( item.vao );
+
+    if ( end - begin == 1 )
+    {
+        glDrawElements( GL_TRIANGLES, item.indexCount, item.indexType, item.indexOffset );
+    }
+    else
+    {
+        m_Counts.clear();
+        m_Offsets.clear();
+        for ( size_t i = begin; i < end; ++i )
+        {
+            m_Counts.push_back( m_Items[m_Order[i]].indexCount );
+            m_Offsets.push_back( m_Items[m_Order[i]].indexOffset );
+        }
+        glMultiDrawElements( GL_TRIANGLES, m_Counts.data(), item.indexType, m_Offsets.data(), (GLsizei)m_Counts.size() );
+        ++m_Statistics.multiDrawBatches;
+    }
+    ++m_Statistics.batches;
+}
+
+const RenderQueueStatistics& RenderQueue::GetStatistics() const
+{
+    return m_Statistics;
+}
+
+void RenderQueue::Destroy()
+{
+    m_Items.clear();
+    m_Keys.clear();
+    m_Order.clear();
+}
@@ -0,0 +1,319 @@
+#include <TextureAndLightingPCH.h>
+#include <SceneGraph.h>
+#include <Simd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+namespace
+{
+    glm::mat4 ComposeLocal( const glm::vec3& translation, const glm::quat& rotation, float scale )
+    {
+        glm::mat3 rotationScale = glm::mat3_cast( rotation ) * scale;
+        return glm::mat4( glm::vec4( rotationScale[0], 0.0f ),
+                          glm::vec4( rotationScale[1], 0.0f ),
+                          glm::vec4( rotationScale[2], 0.0f ),
+                          glm::vec4( translation, 1.0f ) );
+    }
+
+    // result = a * b. result must not alias a or b.
+    inline void MultiplyMatrices( const glm::mat4& a, const glm::mat4& b, glm::mat4& result )
+    {
+#if SIMD_SSE2
+        const float* pa = glm::value_ptr( a );
+        const float* pb = glm::value_ptr( b );
+        float* pr = glm::value_ptr( result );
+
+        __m128 a0 = _mm_loadu_ps( pa );
+        __m128 a1 = _mm_loadu_ps( pa + 4 );
+        __m128 a2 = _mm_loadu_ps( pa + 8 );
+        __m128 a3 = _mm_loadu_ps( pa + 12 );
+        for ( int column = 0; column < 4; ++column )
+        {
+            const float* c = pb + column * 4;
+            __m128 r = _mm_mul_ps( a0, _mm_set1_ps( c[0] ) );
+            r = _mm_add_ps( r, _mm_mul_ps( a1, _mm_set1_ps( c[1] ) ) );
+            r = _mm_add_ps( r, _mm_mul_ps( a2, _mm_set1_ps( c[2] ) ) );
+            r = _mm_add_ps( r, _mm_mul_ps( a3, _mm_set1_ps( c[3] ) ) );
+            _mm_storeu_ps( pr + column * 4, r );
+        }
+#else
+        result = a * b;
+#endif
+    }
+}
+
+SceneGraph::SceneGraph()
+    : m_Pass( 0 )
+    , m_FirstDirty( 0 )
+    , m_Statistics()
+{}
+
+SceneNode SceneGraph::CreateNode( SceneNode parent, const glm::vec3& translation, const glm::quat& rotation, float scale )
+{
+    assert( parent == SCENE_NODE_NONE || ( parent >= 0 && (size_t)parent < m_Parents.size() ) );
+
+    SceneNode node = (SceneNode)m_Parents.size();
+    m_Parents.push_back( parent );
+    m_Translations.push_back( translation );
+    m_Rotations.push_back( rotation );
+    m_Scales.push_back( scale );
+    m_Locals.push_back( glm::mat4() );
+    m_Worlds.push_back( glm::mat4() );
+    m_Dirty.push_back( 0 );
+    m_Updated.push_back( 0 );
+    MarkDirty( node );
+    return node;
+}
+
+void SceneGraph::MarkDirty( SceneNode node )
+{
+    m_Dirty[node] = 1;
+    m_FirstDirty = std::min( m_FirstDirty, (size_t)node );
+}
+
+void SceneGraph::SetTranslation( SceneNode node, const glm::vec3& translation )
+{
+    m_Translations[node] = translation;
+    MarkDirty( node );
+}
+
+void SceneGraph::SetRotation( SceneNode node, const glm::quat& rotation )
+{
+    m_Rotations[node] = rotation;
+    MarkDirty( node );
+}
+
+void SceneGraph::SetScale( SceneNode node, float scale )
+{
+    m_Scales[node] = scale;
+    MarkDirty( node );
+}
+
+SceneNode SceneGraph::GetParent( SceneNode node ) const
+{
+    return m_Parents[node];
+}
+
+size_t SceneGraph::GetNodeCount() const
+{
+    return m_Parents.size();
+}
+
+void SceneGraph::Update()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    size_t count = m_Parents.size();
+    m_Statistics = SceneGraphStatistics();
+    m_Statistics.nodes = count;
+
+    if ( m_FirstDirty < count )
+    {
+        ++m_Pass;
+        for ( size_t i = m_FirstDirty; i < count; ++i )
+        {
+            SceneNode parent = m_Parents[i];
+            if ( m_Dirty[i] )
+            {
+                m_Locals[i] = ComposeLocal( m_Translations[i], m_Rotations[i], m_Scales[i] );
+                m_Dirty[i] = 0;
+                ++m_Statistics.localsUpdated;
+            }
+            else if ( parent == SCENE_NODE_NONE || m_Updated[parent] != m_Pass )
+            {
+                continue;
+            }
+
+            // Parents come first, so the parent's world matrix is final.
+            if ( parent == SCENE_NODE_NONE )
+            {
+                m_Worlds[i] = m_Locals[i];
+            }
+            else
+            {
+                MultiplyMatrices( m_Worlds[parent], m_Locals[i], m_Worlds[i] );
+            }
+            m_Updated[i] = m_Pass;
+            ++m_Statistics.worldsUpdated;
+        }
+        m_FirstDirty = count;
+    }
+
+    m_Statistics.updateMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+const glm::mat4& SceneGraph::GetWorldMatrix( SceneNode node ) const
+{
+    return m_Worlds[node];
+}
+
+const glm::mat4* SceneGraph::GetWorldMatrices() const
+{
+    return m_Worlds.data();
+}
+
+const SceneGraphStatistics& SceneGraph::GetStatistics() const
+{
+    return m_Statistics;
+}
+
+void SceneGraph::Clear()
+{
+    m_Parents.clear();
+    m_Translations.clear();
+    m_Rotations.clear();
+    m_Scales.clear();
+    m_Locals.clear();
+    m_Worlds.clear();
+    m_Dirty.clear();
+    m_Updated.clear();
+    m_FirstDirty = 0;
+    m_Statistics = SceneGraphStatistics();
+}
+
+namespace
+{
+    // The benchmark's own copy of the hierarchy, evaluated the naive way.
+    struct ReferenceNode
+    {
+        SceneNode parent;
+        glm::vec3 translation;
+        glm::quat rotation;
+        float scale;
+    };
+
+    struct Orbit
+    {
+        SceneNode pivot;
+        float speed;        // Radians per frame.
+    };
+
+    SceneNode AddNode( SceneGraph& graph, std::vector<ReferenceNode>& reference, SceneNode parent, const glm::vec3& translation, const glm::quat& rotation, float scale )
+    {
+        ReferenceNode node = { parent, translation, rotation, scale };
+        reference.push_back( node );
+        return graph.CreateNode( parent, translation, rotation, scale );
+    }
+
+    // Every node's world matrix from its chain of ancestors.
+    void ComputeReference( const std::vector<ReferenceNode>& nodes, std::vector<glm::mat4>& worlds )
+    {
+        worlds.resize( nodes.size() );
+        for ( size_t i = 0; i < nodes.size(); ++i )
+        {
+            glm::mat4 world = ComposeLocal( nodes[i].translation, nodes[i].rotation, nodes[i].scale );
+            for ( SceneNode parent = nodes[i].parent; parent != SCENE_NODE_NONE; parent = nodes[parent].parent )
+            {
+                world = ComposeLocal( nodes[parent].translation, nodes[parent].rotation, nodes[parent].scale ) * world;
+            }
+            worlds[i] = world;
+        }
+    }
+
+    // Advance every stride-th orbit by one frame.
+    void AdvanceOrbits( SceneGraph& graph, std::vector<ReferenceNode>& reference, const std::vector<Orbit>& orbits, std::vector<float>& angles, size_t stride, size_t offset )
+    {
+        for ( size_t i = offset % stride; i < orbits.size(); i += stride )
+        {
+            angles[i] += orbits[i].speed;
+            glm::quat rotation = glm::angleAxis( angles[i], glm::vec3( 0, 1, 0 ) );
+            reference[orbits[i].pivot].rotation = rotation;
+            graph.SetRotation( orbits[i].pivot, rotation );
+        }
+    }
+}
+
+int BenchmarkSceneGraph( size_t nodeCount )
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    const float _2pi = 2.0f * 3.1415926535897932384626433832795f;
+    const int PLANETS = 5;
+    const int MOONS = 4;
+
+    std::mt19937 random( 1 );
+    std::uniform_real_distribution<float> unit( 0.0f, 1.0f );
+
+    // Star -> planet pivot -> planet -> moon pivot -> moon, 51 nodes per
+    // system and four levels deep.
+    SceneGraph graph;
+    std::vector<ReferenceNode> reference;
+    std::vector<Orbit> orbits;
+    while ( graph.GetNodeCount() < nodeCount )
+    {
+        glm::vec3 position( 1000.0f * unit( random ) - 500.0f, 100.0f * unit( random ) - 50.0f, 1000.0f * unit( random ) - 500.0f );
+        SceneNode star = AddNode( graph, reference, SCENE_NODE_NONE, position, glm::quat(), 2.0f + unit( random ) );
+        for ( int p = 0; p < PLANETS; ++p )
+        {
+            SceneNode planetPivot = AddNode( graph, reference, star, glm::vec3( 0 ), glm::angleAxis( _2pi * unit( random ), glm::vec3( 0, 1, 0 ) ), 1.0f );
+            Orbit planetOrbit = { planetPivot, 0.01f + 0.02f * unit( random ) };
+            orbits.push_back( planetOrbit );
+
+            SceneNode planet = AddNode( graph, reference, planetPivot, glm::vec3( 3.0f + 2.0f * p, 0, 0 ), glm::quat(), 0.2f + 0.3f * unit( random ) );
+            for ( int m = 0; m < MOONS; ++m )
+            {
+                SceneNode moonPivot = AddNode( graph, reference, planet, glm::vec3( 0 ), glm::angleAxis( _2pi * unit( random ), glm::vec3( 0, 1, 0 ) ), 1.0f );
+                Orbit moonOrbit = { moonPivot, 0.05f + 0.05f * unit( random ) };
+                orbits.push_back( moonOrbit );
+                AddNode( graph, reference, moonPivot, glm::vec3( 1.5f + 0.5f * m, 0, 0 ), glm::quat(), 0.1f );
+            }
+        }
+    }
+    std::vector<float> angles( orbits.size(), 0.0f );
+
+    std::cout << "Scene graph update (" << graph.GetNodeCount() << " nodes, " << orbits.size() << " orbits, "
+              << ( SIMD_SSE2 ? "SSE2" : "scalar" ) << ")" << std::endl;
+
+    const int frames = 100;
+    std::vector<glm::mat4> referenceWorlds;
+    bool matches = true;
+
+    // Recompute every chain from scratch, as DisplayGL did.
+    Clock::time_point start = Clock::now();
+    for ( int frame = 0; frame < frames; ++frame )
+    {
+        ComputeReference( reference, referenceWorlds );
+    }
+    double referenceMs = std::chrono::duration<double, std::milli>( Clock::now() - start ).count() / frames;
+    std::cout << "  from scratch: " << referenceMs << " ms" << std::endl;
+
+    // All orbits move, only 1 in 100 moves, nothing moves.
+    const size_t strides[] = { 1, 100, 0 };
+    for ( size_t stride : strides )
+    {
+        graph.Update();
+        size_t worldsUpdated = 0;
+        start = Clock::now();
+        for ( int frame = 0; frame < frames; ++frame )
+        {
+            if ( stride > 0 )
+            {
+                AdvanceOrbits( graph, reference, orbits, angles, stride, frame );
+            }
+            graph.Update();
+            worldsUpdated += graph.GetStatistics().worldsUpdated;
+        }
+        double updateMs = std::chrono::duration<double, std::milli>( Clock::now() - start ).count() / frames;
+
+        ComputeReference( reference, referenceWorlds );
+        float difference = 0.0f;
+        const glm::mat4* worlds = graph.GetWorldMatrices();
+        for ( size_t i = 0; i < referenceWorlds.size(); ++i )
+        {
+            for ( int column = 0; column < 4; ++column )
+            {
+                glm::vec4 delta = worlds[i][column] - referenceWorlds[i][column];
+                float magnitude = std::max( 1.0f, glm::length( referenceWorlds[i][column] ) );
+                difference = std::max( difference, glm::length( delta ) / magnitude );
+            }
+        }
+        matches = matches && difference < 1e-4f;
+
+        std::cout << "  " << ( stride == 1 ? "all orbits moving" : stride == 0 ? "idle" : "1% of orbits moving" ) << ": "
+                  << updateMs << " ms (" << referenceMs / std::max( updateMs, 1e-6 ) << "x), "
+                  << worldsUpdated / frames << " world matrices per update; max difference " << difference << std::endl;
+    }
+
+    return matches ? 0 : 1;
+}
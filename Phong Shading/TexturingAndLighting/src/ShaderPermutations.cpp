@@ -0,0 +1,222 @@
+#include <TextureAndLightingPCH.h>
+#include <ShaderPermutations.h>
+#include <ProgramCache.h>
+#include <ShaderPreprocessor.h>
+#include <StateCache.h>
+
+#include <iomanip>
+
+ShaderPermutations::ShaderPermutations()
+    : m_Compiler( NULL )
+    , m_Preprocessor( NULL )
+    , m_Cache( NULL )
+    , m_PendingCount( 0 )
+{}
+
+bool ShaderPermutations::Create( ProgramCompiler& compiler, ShaderPreprocessor& preprocessor, const std::string& vertexFile, const std::string& fragmentFile, const std::vector<ShaderFeature>& features, const SetupFunction& setup )
+{
+    Destroy();
+
+    m_Compiler = &compiler;
+    m_Preprocessor = &preprocessor;
+    m_VertexFile = vertexFile;
+    m_FragmentFile = fragmentFile;
+    m_Features = features;
+    m_Setup = setup;
+
+    m_Shifts.clear();
+    int shift = 0;
+    for ( const ShaderFeature& feature : m_Features )
+    {
+        m_Shifts.push_back( shift );
+        shift += feature.bits;
+    }
+    assert( shift <= 32 );
+
+    // Reads both files and their includes, so later variants find them in
+    // memory.
+    ShaderSource source;
+    uint64_t hash;
+    return preprocessor.Preprocess( GL_VERTEX_SHADER, vertexFile, "", source, hash ) &&
+           preprocessor.Preprocess( GL_FRAGMENT_SHADER, fragmentFile, "", source, hash );
+}
+
+void ShaderPermutations::SetSharedDefines( const std::string& defines )
+{
+    assert( m_Variants.empty() );
+    m_SharedDefines = defines;
+}
+
+void ShaderPermutations::SetProgramCache( ProgramCache* cache )
+{
+    m_Cache = cache;
+}
+
+ShaderKey ShaderPermutations::SetFeature( ShaderKey key, int feature, int value ) const
+{
+    ShaderKey mask = ( ( 1u << m_Features[feature].bits ) - 1 ) << m_Shifts[feature];
+    return ( key & ~mask ) | ( ( (ShaderKey)value << m_Shifts[feature] ) & mask );
+}
+
+int ShaderPermutations::GetFeature( ShaderKey key, int feature ) const
+{
+    return (int)( ( key >> m_Shifts[feature] ) & ( ( 1u << m_Features[feature].bits ) - 1 ) );
+}
+
+std::string ShaderPermutations::GetDefines( ShaderKey key ) const
+{
+    std::string defines = m_SharedDefines;
+    for ( int i = 0; i < (int)m_Features.size(); ++i )
+    {
+        defines += "#define " + m_Features[i].name + " " + std::to_string( GetFeature( key, i ) ) + "\n";
+    }
+    return defines;
+}
+
+// Reflect and set up a variant that has a program, or leave a failed one be.
+void ShaderPermutations::Finalize( ShaderVariant& variant, std::chrono::steady_clock::time_point start )
+{
+    if ( variant.program != 0 )
+    {
+        if ( GLEW_ARB_get_program_binary )
+        {
+            glGetProgramiv( variant.program, GL_PROGRAM_BINARY_LENGTH, &variant.binaryBytes );
+        }
+
+        variant.reflection.Reflect( variant.program );
+        StateCache& state = GetStateCache();
+        state.UseProgram( variant.program );
+        if ( m_Setup )
+        {
+            m_Setup( variant );
+        }
+    }
+
+    variant.compileMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    variant.ready = true;
+}
+
+const ShaderVariant& ShaderPermutations::GetVariant( ShaderKey key )
+{
+    std::unique_ptr<ShaderVariant>& slot = m_Variants[key];
+    if ( slot )
+    {
+        return *slot;
+    }
+
+    slot.reset( new ShaderVariant() );
+    ShaderVariant& variant = *slot;
+    variant.key = key;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::string defines = GetDefines( key );
+    std::vector<ShaderSource> shaders( 2 );
+    std::vector<uint64_t> hashes( 2 );
+    if ( !m_Preprocessor->Preprocess( GL_VERTEX_SHADER, m_VertexFile, defines, shaders[0], hashes[0] ) ||
+         !m_Preprocessor->Preprocess( GL_FRAGMENT_SHADER, m_FragmentFile, defines, shaders[1], hashes[1] ) )
+    {
+        Finalize( variant, start );
+        return variant;
+    }
+
+    uint64_t cacheKey = 0;
+    if ( m_Cache != NULL )
+    {
+        cacheKey = m_Cache->MakeKey( hashes );
+        variant.program = m_Cache->Load( cacheKey );
+        variant.cached = variant.program != 0;
+    }
+
+    if ( variant.cached )
+    {
+        Finalize( variant, start );
+        return variant;
+    }
+
+    // Name the variant in compile errors by its feature values.
+    std::string suffix = " (";
+    for ( int i = 0; i < (int)m_Features.size(); ++i )
+    {
+        suffix += ( i > 0 ? " " : "" ) + m_Features[i].name + "=" + std::to_string( GetFeature( key, i ) );
+    }
+    suffix += ")";
+    for ( ShaderSource& shader : shaders )
+    {
+        shader.name += suffix;
+    }
+
+    ++m_PendingCount;
+    ProgramCache* cache = m_Cache;
+    m_Compiler->Submit( shaders, [this, &variant, cache, cacheKey, start]( const ProgramBuild& build )
+    {
+        variant.program = build.program;
+        if ( cache != NULL )
+        {
+            cache->Store( cacheKey, build.program, build.buildMs );
+        }
+        Finalize( variant, start );
+        --m_PendingCount;
+    } );
+    return variant;
+}
+
+size_t ShaderPermutations::GetPendingCount() const
+{
+    return m_PendingCount;
+}
+
+size_t ShaderPermutations::GetVariantCount() const
+{
+    return m_Variants.size();
+}
+
+void ShaderPermutations::PrintReport( std::ostream& out ) const
+{
+    out << m_VertexFile << " + " << m_FragmentFile << ": " << m_Variants.size() - m_PendingCount << " variants compiled, "
+        << m_PendingCount << " compiling" << std::endl;
+    for ( const auto& entry : m_Variants )
+    {
+        const ShaderVariant& variant = *entry.second;
+        out << "  ";
+        for ( int i = 0; i < (int)m_Features.size(); ++i )
+        {
+            out << ( i > 0 ? " " : "" ) << m_Features[i].name << "=" << GetFeature( variant.key, i );
+        }
+        if ( !variant.ready )
+        {
+            out << ": compiling" << std::endl;
+            continue;
+        }
+        if ( variant.program == 0 )
+        {
+            out << ": FAILED" << std::endl;
+            continue;
+        }
+
+        out << ": " << std::fixed << std::setprecision( 2 ) << variant.compileMs << " ms" << ( variant.cached ? " (cached)" : "" )
+            << ", " << variant.binaryBytes << " bytes";
+        out.unsetf( std::ios_base::floatfield );
+        out << std::endl;
+    }
+}
+
+void ShaderPermutations::Destroy()
+{
+    // Builds still in flight write into the variants.
+    if ( m_PendingCount > 0 )
+    {
+        m_Compiler->Finish();
+    }
+
+    StateCache& state = GetStateCache();
+    for ( auto& entry : m_Variants )
+    {
+        if ( entry.second->program != 0 )
+        {
+            state.ForgetProgram( entry.second->program );
+            glDeleteProgram( entry.second->program );
+        }
+    }
+    m_Variants.clear();
+}
@@ -0,0 +1,215 @@
+#include <TextureAndLightingPCH.h>
+#include <ShaderPreprocessor.h>
+#include <MappedFile.h>
+#include <Hash.h>
+
+#include <algorithm>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace
+{
+    bool IsBlank( char c )
+    {
+        return c == ' ' || c == '\t';
+    }
+
+    // The name in an #include "name" line, or false if line is something else.
+    bool ParseInclude( const std::string& line, std::string& name )
+    {
+        size_t i = 0;
+        while ( i < line.size() && IsBlank( line[i] ) ) ++i;
+        if ( i == line.size() || line[i] != '#' )
+        {
+            return false;
+        }
+        ++i;
+        while ( i < line.size() && IsBlank( line[i] ) ) ++i;
+        if ( line.compare( i, 7, "include" ) != 0 )
+        {
+            return false;
+        }
+        i += 7;
+        while ( i < line.size() && IsBlank( line[i] ) ) ++i;
+        if ( i == line.size() || line[i] != '"' )
+        {
+            return false;
+        }
+        size_t end = line.find( '"', i + 1 );
+        if ( end == std::string::npos )
+        {
+            return false;
+        }
+        name = line.substr( i + 1, end - i - 1 );
+        return true;
+    }
+
+    std::string GetDirectory( const std::string& path )
+    {
+        size_t slash = path.find_last_of( "/\\" );
+        return ( slash == std::string::npos ) ? std::string() : path.substr( 0, slash + 1 );
+    }
+}
+
+ShaderPreprocessor::ShaderPreprocessor()
+    : m_Statistics()
+{}
+
+// The contents of path, read again only if the file changed since the last
+// request.
+const ShaderPreprocessor::SourceFile* ShaderPreprocessor::GetFile( const std::string& path )
+{
+    struct stat info;
+    if ( stat( path.c_str(), &info ) != 0 )
+    {
+        return NULL;
+    }
+
+    std::map<std::string, SourceFile>::iterator found = m_Files.find( path );
+    if ( found != m_Files.end() && found->second.size == (uint64_t)info.st_size && found->second.modified == (int64_t)info.st_mtime )
+    {
+        ++m_Statistics.reuses;
+        return &found->second;
+    }
+
+    // Copy the text out of the mapping so the file stays editable on Windows.
+    std::string text;
+    if ( info.st_size > 0 )
+    {
+        MappedFile mapped;
+        if ( !mapped.OpenRead( path ) )
+        {
+            return NULL;
+        }
+        text.assign( (const char*)mapped.GetData(), mapped.GetSize() );
+    }
+
+    SourceFile& file = m_Files[path];
+    file.size = (uint64_t)info.st_size;
+    file.modified = (int64_t)info.st_mtime;
+    file.text.swap( text );
+    file.hash = HashString( file.text );
+
+    ++m_Statistics.reads;
+    m_Statistics.bytesRead += file.text.size();
+    return &file;
+}
+
+// Append text from begin, the start of line firstLine of path, to the
+// expansion, pasting its includes. path is already in expansion.files.
+bool ShaderPreprocessor::Expand( const std::string& path, const std::string& text, size_t begin, int firstLine, Expansion& expansion )
+{
+    const int index = (int)( std::find( expansion.files.begin(), expansion.files.end(), path ) - expansion.files.begin() );
+
+    int lineNumber = firstLine;
+    for ( size_t lineStart = begin; lineStart < text.size(); ++lineNumber )
+    {
+        size_t lineEnd = text.find( '\n', lineStart );
+        lineEnd = ( lineEnd == std::string::npos ) ? text.size() : lineEnd + 1;
+        std::string line = text.substr( lineStart, lineEnd - lineStart );
+        lineStart = lineEnd;
+
+        std::string name;
+        if ( !ParseInclude( line, name ) )
+        {
+            expansion.text += line;
+            continue;
+        }
+
+        // Pasted once per shader; a repeat leaves a blank line.
+        std::string includePath = GetDirectory( path ) + name;
+        if ( std::find( expansion.files.begin(), expansion.files.end(), includePath ) != expansion.files.end() )
+        {
+            expansion.text += "\n";
+            continue;
+        }
+
+        const SourceFile* file = GetFile( includePath );
+        if ( file == NULL )
+        {
+            std::cerr << path << "(" << lineNumber << "): can not include \"" << includePath << "\"" << std::endl;
+            return false;
+        }
+
+        int includeIndex = (int)expansion.files.size();
+        expansion.files.push_back( includePath );
+        expansion.hash = HashValue( file->hash, expansion.hash );
+
+        expansion.text += "#line 1 " + std::to_string( includeIndex ) + "\n";
+        if ( !Expand( includePath, file->text, 0, 1, expansion ) )
+        {
+            return false;
+        }
+        if ( !expansion.text.empty() && expansion.text[expansion.text.size() - 1] != '\n' )
+        {
+            expansion.text += "\n";
+        }
+        expansion.text += "#line " + std::to_string( lineNumber + 1 ) + " " + std::to_string( index ) + "\n";
+    }
+    return true;
+}
+
+bool ShaderPreprocessor::Preprocess( GLenum type, const std::string& file, const std::string& defines, ShaderSource& shader, uint64_t& hash )
+{
+    const SourceFile* root = GetFile( file );
+    if ( root == NULL )
+    {
+        std::cerr << "Can not open shader file: \"" << file << "\"" << std::endl;
+        return false;
+    }
+
+    // Defines go after the #version line, which has to come first.
+    const std::string& text = root->text;
+    size_t versionEnd = 0;
+    int versionLines = 0;
+    if ( text.compare( 0, 8, "#version" ) == 0 )
+    {
+        versionEnd = text.find( '\n' );
+        versionEnd = ( versionEnd == std::string::npos ) ? text.size() : versionEnd + 1;
+        versionLines = 1;
+    }
+
+    Expansion expansion;
+    expansion.files.push_back( file );
+    expansion.hash = HashValue( root->hash );
+    if ( !Expand( file, text, versionEnd, versionLines + 1, expansion ) )
+    {
+        return false;
+    }
+
+    std::string head = text.substr( 0, versionEnd );
+    if ( !head.empty() && head[head.size() - 1] != '\n' )
+    {
+        head += '\n';
+    }
+
+    shader.type = type;
+    shader.name = file;
+    for ( size_t i = 1; i < expansion.files.size(); ++i )
+    {
+        shader.name += ( i == 1 ? " (" : ", " ) + std::to_string( i ) + ": " + expansion.files[i];
+    }
+    if ( expansion.files.size() > 1 )
+    {
+        shader.name += ")";
+    }
+
+    shader.strings.clear();
+    shader.strings.push_back( head );
+    shader.strings.push_back( defines + "#line " + std::to_string( versionLines + 1 ) + " 0\n" );
+    shader.strings.push_back( expansion.text );
+
+    hash = HashString( defines, expansion.hash );
+    return true;
+}
+
+const ShaderPreprocessorStatistics& ShaderPreprocessor::GetStatistics() const
+{
+    return m_Statistics;
+}
+
+void ShaderPreprocessor::PrintStatistics( std::ostream& out ) const
+{
+    out << "Shader sources: " << m_Statistics.reads << " files read (" << m_Statistics.bytesRead << " bytes), "
+        << m_Statistics.reuses << " reused from memory" << std::endl;
+}
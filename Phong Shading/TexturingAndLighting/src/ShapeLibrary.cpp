@@ -0,0 +1,539 @@
+#include <TextureAndLightingPCH.h>
+#include <ShapeLibrary.h>
+#include <StateCache.h>
+#include <Hash.h>
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+
+namespace
+{
+    struct ShapeVertex
+    {
+        glm::vec3 position;
+        glm::uint32 normal;     // packSnorm3x10_1x2
+    };
+
+    const size_t MIN_VERTEX_CAPACITY = 4096;
+    const size_t MIN_INDEX_CAPACITY = 16384;
+
+    GLuint AddVertex( MeshData& mesh, const glm::vec3& position, const glm::vec3& normal )
+    {
+        mesh.positions.push_back( position );
+        mesh.normals.push_back( normal );
+        return (GLuint)mesh.positions.size() - 1;
+    }
+
+    // Add a triangle wound counter-clockwise around its vertex normals.
+    // Degenerate triangles (cone apex, sphere poles) are dropped.
+    void AddTriangle( MeshData& mesh, GLuint a, GLuint b, GLuint c )
+    {
+        const std::vector<glm::vec3>& p = mesh.positions;
+        glm::vec3 faceNormal = glm::cross( p[b] - p[a], p[c] - p[a] );
+        if ( glm::dot( faceNormal, faceNormal ) == 0.0f )
+        {
+            return;
+        }
+
+        glm::vec3 vertexNormal = mesh.normals[a] + mesh.normals[b] + mesh.normals[c];
+        if ( glm::dot( faceNormal, vertexNormal ) < 0.0f )
+        {
+            std::swap( b, c );
+        }
+        mesh.indices.push_back( a );
+        mesh.indices.push_back( b );
+        mesh.indices.push_back( c );
+    }
+
+    // Add a flat convex polygon facing away from interior.
+    void AddFace( MeshData& mesh, const glm::vec3* corners, int count, const glm::vec3& interior )
+    {
+        glm::vec3 normal = glm::normalize( glm::cross( corners[1] - corners[0], corners[2] - corners[0] ) );
+        if ( glm::dot( normal, corners[0] - interior ) < 0.0f )
+        {
+            normal = -normal;
+        }
+
+        GLuint first = (GLuint)mesh.positions.size();
+        for ( int i = 0; i < count; ++i )
+        {
+            AddVertex( mesh, corners[i], normal );
+        }
+        for ( int i = 1; i + 1 < count; ++i )
+        {
+            AddTriangle( mesh, first, first + i, first + i + 1 );
+        }
+    }
+
+    void AddFace( MeshData& mesh, const double ( *vertices )[3], const int* face, int count, const glm::vec3& offset, float scale )
+    {
+        glm::vec3 corners[5];
+        for ( int i = 0; i < count; ++i )
+        {
+            corners[i] = offset + scale * glm::vec3( vertices[face[i]][0], vertices[face[i]][1], vertices[face[i]][2] );
+        }
+        AddFace( mesh, corners, count, offset );
+    }
+
+    // Add a (rows + 1) x (columns + 1) grid of vertices produced by
+    // vertex( row, column, position, normal ) and stitch it into quads.
+    template<typename VertexFunction>
+    void AddGrid( MeshData& mesh, int rows, int columns, VertexFunction vertex )
+    {
+        GLuint first = (GLuint)mesh.positions.size();
+        for ( int i = 0; i <= rows; ++i )
+        {
+            for ( int j = 0; j <= columns; ++j )
+            {
+                glm::vec3 position, normal;
+                vertex( i, j, position, normal );
+                AddVertex( mesh, position, normal );
+            }
+        }
+
+        for ( int i = 0; i < rows; ++i )
+        {
+            for ( int j = 0; j < columns; ++j )
+            {
+                GLuint i0 = first + i * ( columns + 1 ) + j;
+                GLuint i1 = i0 + columns + 1;
+                AddTriangle( mesh, i0, i0 + 1, i1 + 1 );
+                AddTriangle( mesh, i0, i1 + 1, i1 );
+            }
+        }
+    }
+
+    // Flat disk at height z facing along normalZ.
+    void AddDisk( MeshData& mesh, const std::vector<glm::vec2>& circle, float radius, float z, float normalZ )
+    {
+        glm::vec3 normal( 0, 0, normalZ );
+        GLuint center = AddVertex( mesh, glm::vec3( 0, 0, z ), normal );
+        for ( size_t j = 0; j < circle.size(); ++j )
+        {
+            AddVertex( mesh, glm::vec3( circle[j] * radius, z ), normal );
+        }
+        for ( GLuint j = 0; j + 1 < circle.size(); ++j )
+        {
+            AddTriangle( mesh, center, center + 1 + j, center + 2 + j );
+        }
+    }
+
+    // Vertex tables from freeglut_geometry.c.
+    const double X = 0.61803398875;
+    const double Z = 1.61803398875;
+
+    const double cube_r[8][3] = {
+        { -1, -1, -1 }, { 1, -1, -1 }, { 1, 1, -1 }, { -1, 1, -1 },
+        { -1, -1,  1 }, { 1, -1,  1 }, { 1, 1,  1 }, { -1, 1,  1 }
+    };
+    const int cube_v[6][4] = {
+        { 1, 2, 6, 5 }, { 2, 3, 7, 6 }, { 4, 5, 6, 7 }, { 0, 4, 7, 3 }, { 0, 1, 5, 4 }, { 0, 3, 2, 1 }
+    };
+
+    const double tet_r[4][3] = {
+        {             1.0,             0.0,             0.0 },
+        { -0.333333333333,  0.942809041582,             0.0 },
+        { -0.333333333333, -0.471404520791,  0.816496580928 },
+        { -0.333333333333, -0.471404520791, -0.816496580928 }
+    };
+    const int tet_i[4][3] = {
+        { 1, 3, 2 }, { 0, 2, 3 }, { 0, 3, 1 }, { 0, 1, 2 }
+    };
+
+    const double oct_r[6][3] = {
+        { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }
+    };
+    const int oct_v[8][3] = {
+        { 0, 2, 4 }, { 0, 5, 2 }, { 0, 4, 3 }, { 0, 3, 5 }, { 1, 4, 2 }, { 1, 2, 5 }, { 1, 3, 4 }, { 1, 5, 3 }
+    };
+
+    const double dod_r[20][3] = {
+        {  0,  Z,  X }, { -1,  1,  1 }, { -X,  0,  Z }, {  X,  0,  Z }, {  1,  1,  1 },
+        {  0,  Z, -X }, {  1,  1, -1 }, {  X,  0, -Z }, { -X,  0, -Z }, { -1,  1, -1 },
+        {  0, -Z,  X }, {  1, -1,  1 }, { -1, -1,  1 }, {  0, -Z, -X }, { -1, -1, -1 },
+        {  1, -1, -1 }, {  Z, -X,  0 }, {  Z,  X,  0 }, { -Z,  X,  0 }, { -Z, -X,  0 }
+    };
+    const int dod_v[12][5] = {
+        {  0,  1,  2,  3,  4 }, {  5,  6,  7,  8,  9 }, { 10, 11,  3,  2, 12 }, { 13, 14,  8,  7, 15 },
+        {  3, 11, 16, 17,  4 }, {  2,  1, 18, 19, 12 }, {  7,  6, 17, 16, 15 }, {  8, 14, 19, 18,  9 },
+        { 17,  6,  5,  0,  4 }, { 16, 11, 10, 13, 15 }, { 18,  1,  0,  5,  9 }, { 19, 14, 13, 10, 12 }
+    };
+
+    const double icos_r[12][3] = {
+        {  1.0,             0.0,             0.0            },
+        {  0.447213595500,  0.894427191000,  0.0            },
+        {  0.447213595500,  0.276393202252,  0.850650808354 },
+        {  0.447213595500, -0.723606797748,  0.525731112119 },
+        {  0.447213595500, -0.723606797748, -0.525731112119 },
+        {  0.447213595500,  0.276393202252, -0.850650808354 },
+        { -0.447213595500, -0.894427191000,  0.0            },
+        { -0.447213595500, -0.276393202252,  0.850650808354 },
+        { -0.447213595500,  0.723606797748,  0.525731112119 },
+        { -0.447213595500,  0.723606797748, -0.525731112119 },
+        { -0.447213595500, -0.276393202252, -0.850650808354 },
+        { -1.0,             0.0,             0.0            }
+    };
+    const int icos_v[20][3] = {
+        {  0,  1,  2 }, {  0,  2,  3 }, {  0,  3,  4 }, {  0,  4,  5 }, {  0,  5,  1 },
+        {  1,  8,  2 }, {  2,  7,  3 }, {  3,  6,  4 }, {  4, 10,  5 }, {  5,  9,  1 },
+        {  1,  9,  8 }, {  2,  8,  7 }, {  3,  7,  6 }, {  4,  6, 10 }, {  5, 10,  9 },
+        { 11,  9, 10 }, { 11,  8,  9 }, { 11,  7,  8 }, { 11,  6,  7 }, { 11, 10,  6 }
+    };
+
+    const double rdod_r[14][3] = {
+        {  0.0,             0.0,             1.0 },
+        {  0.707106781187,  0.000000000000,  0.5 },
+        {  0.000000000000,  0.707106781187,  0.5 },
+        { -0.707106781187,  0.000000000000,  0.5 },
+        {  0.000000000000, -0.707106781187,  0.5 },
+        {  0.707106781187,  0.707106781187,  0.0 },
+        { -0.707106781187,  0.707106781187,  0.0 },
+        { -0.707106781187, -0.707106781187,  0.0 },
+        {  0.707106781187, -0.707106781187,  0.0 },
+        {  0.707106781187,  0.000000000000, -0.5 },
+        {  0.000000000000,  0.707106781187, -0.5 },
+        { -0.707106781187,  0.000000000000, -0.5 },
+        {  0.000000000000, -0.707106781187, -0.5 },
+        {  0.0,             0.0,            -1.0 }
+    };
+    const int rdod_v[12][4] = {
+        { 0,  1,  5,  2 }, { 0,  2,  6,  3 }, { 0,  3,  7,  4 }, { 0,  4,  8,  1 },
+        { 5, 10,  6,  2 }, { 6, 11,  7,  3 }, { 7, 12,  8,  4 }, { 8,  9,  5,  1 },
+        { 5,  9, 13, 10 }, { 6, 10, 13, 11 }, { 7, 11, 13, 12 }, { 8, 12, 13,  9 }
+    };
+
+    template<size_t FaceCount, size_t CornerCount>
+    MeshData Polyhedron( const double ( *vertices )[3], const int ( &faces )[FaceCount][CornerCount], float scale = 1.0f )
+    {
+        MeshData mesh;
+        for ( size_t i = 0; i < FaceCount; ++i )
+        {
+            AddFace( mesh, vertices, faces[i], (int)CornerCount, glm::vec3( 0 ), scale );
+        }
+        return mesh;
+    }
+
+    void AddSierpinskiSponge( MeshData& mesh, int levels, const glm::vec3& offset, float scale )
+    {
+        if ( levels == 0 )
+        {
+            for ( int i = 0; i < 4; ++i )
+            {
+                AddFace( mesh, tet_r, tet_i[i], 3, offset, scale );
+            }
+        }
+        else if ( levels > 0 )
+        {
+            scale *= 0.5f;
+            for ( int i = 0; i < 4; ++i )
+            {
+                glm::vec3 localOffset = offset + scale * glm::vec3( tet_r[i][0], tet_r[i][1], tet_r[i][2] );
+                AddSierpinskiSponge( mesh, levels - 1, localOffset, scale );
+            }
+        }
+    }
+}
+
+ShapeLibrary::ShapeLibrary()
+    : m_vao( 0 )
+    , m_VertexBuffer( 0 )
+    , m_IndexBuffer( 0 )
+    , m_VertexCount( 0 )
+    , m_VertexCapacity( 0 )
+    , m_IndexCount( 0 )
+    , m_IndexCapacity( 0 )
+    , m_Statistics()
+{}
+
+void ShapeLibrary::DrawSphere( float radius, int slices, int stacks )
+{
+    Draw( GetKey( SHAPE_SPHERE, radius, (float)slices, (float)stacks ), [&]() { return GenerateSphere( radius, slices, stacks ); } );
+}
+
+void ShapeLibrary::DrawCone( float base, float height, int slices, int stacks )
+{
+    Draw( GetKey( SHAPE_CONE, base, height, (float)slices, (float)stacks ), [&]() { return GenerateCone( base, height, slices, stacks ); } );
+}
+
+void ShapeLibrary::DrawCylinder( float radius, float height, int slices, int stacks )
+{
+    Draw( GetKey( SHAPE_CYLINDER, radius, height, (float)slices, (float)stacks ), [&]() { return GenerateCylinder( radius, height, slices, stacks ); } );
+}
+
+void ShapeLibrary::DrawTorus( float innerRadius, float outerRadius, int sides, int rings )
+{
+    Draw( GetKey( SHAPE_TORUS, innerRadius, outerRadius, (float)sides, (float)rings ), [&]() { return GenerateTorus( innerRadius, outerRadius, sides, rings ); } );
+}
+
+void ShapeLibrary::DrawCube( float size )
+{
+    Draw( GetKey( SHAPE_CUBE, size ), [&]() { return Polyhedron( cube_r, cube_v, size * 0.5f ); } );
+}
+
+void ShapeLibrary::DrawTetrahedron()
+{
+    Draw( GetKey( SHAPE_TETRAHEDRON ), []() { return Polyhedron( tet_r, tet_i ); } );
+}
+
+void ShapeLibrary::DrawOctahedron()
+{
+    Draw( GetKey( SHAPE_OCTAHEDRON ), []() { return Polyhedron( oct_r, oct_v ); } );
+}
+
+void ShapeLibrary::DrawDodecahedron()
+{
+    Draw( GetKey( SHAPE_DODECAHEDRON ), []() { return Polyhedron( dod_r, dod_v ); } );
+}
+
+void ShapeLibrary::DrawIcosahedron()
+{
+    Draw( GetKey( SHAPE_ICOSAHEDRON ), []() { return Polyhedron( icos_r, icos_v ); } );
+}
+
+void ShapeLibrary::DrawRhombicDodecahedron()
+{
+    Draw( GetKey( SHAPE_RHOMBIC_DODECAHEDRON ), []() { return Polyhedron( rdod_r, rdod_v ); } );
+}
+
+void ShapeLibrary::DrawSierpinskiSponge( int levels, const glm::vec3& offset, float scale )
+{
+    Draw( GetKey( SHAPE_SIERPINSKI_SPONGE, (float)levels, offset.x, offset.y, offset.z, scale ), [&]()
+    {
+        MeshData mesh;
+        AddSierpinskiSponge( mesh, levels, offset, scale );
+        return mesh;
+    } );
+}
+
+const ShapeLibrary::Statistics& ShapeLibrary::GetStatistics() const
+{
+    return m_Statistics;
+}
+
+void ShapeLibrary::Destroy()
+{
+    GetStateCache().ForgetVertexArray( m_vao );
+    GetStateCache().ForgetBuffer( m_VertexBuffer );
+    GetStateCache().ForgetBuffer( m_IndexBuffer );
+    glDeleteVertexArrays( 1, &m_vao );
+    glDeleteBuffers( 1, &m_VertexBuffer );
+    glDeleteBuffers( 1, &m_IndexBuffer );
+    m_vao = m_VertexBuffer = m_IndexBuffer = 0;
+    m_VertexCount = m_VertexCapacity = m_IndexCount = m_IndexCapacity = 0;
+    m_Shapes.clear();
+    m_Statistics = Statistics();
+}
+
+uint64_t ShapeLibrary::GetKey( ShapeType type, float p0, float p1, float p2, float p3, float p4 ) const
+{
+    float parameters[] = { p0, p1, p2, p3, p4 };
+    return HashValue( parameters, HashValue( type ) );
+}
+
+template<typename Generator>
+void ShapeLibrary::Draw( uint64_t key, Generator generate )
+{
+    auto shape = m_Shapes.find( key );
+    if ( shape == m_Shapes.end() )
+    {
+        m_Statistics.cacheMisses++;
+        shape = m_Shapes.insert( std::make_pair( key, Append( generate() ) ) ).first;
+    }
+    m_Statistics.draws++;
+
+    const Range& range = shape->second;
+    GetStateCache().BindVertexArray( m_vao );
+    glDrawElements( GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, BUFFER_OFFSET( range.firstIndex * sizeof(GLuint) ) );
+}
+
+ShapeLibrary::Range ShapeLibrary::Append( const MeshData& data )
+{
+    Reserve( data.positions.size(), data.indices.size() );
+
+    std::vector<ShapeVertex> vertices( data.positions.size() );
+    for ( size_t i = 0; i < vertices.size(); ++i )
+    {
+        vertices[i].position = data.positions[i];
+        vertices[i].normal = glm::packSnorm3x10_1x2( glm::vec4( data.normals[i], 0.0f ) );
+    }
+
+    std::vector<GLuint> indices( data.indices );
+    for ( GLuint& index : indices )
+    {
+        index += (GLuint)m_VertexCount;
+    }
+
+    GetStateCache().BindBuffer( GL_ARRAY_BUFFER, m_VertexBuffer );
+    glBufferSubData( GL_ARRAY_BUFFER, m_VertexCount * sizeof(ShapeVertex), vertices.size() * sizeof(ShapeVertex), vertices.data() );
+    GetStateCache().BindBuffer( GL_ARRAY_BUFFER, 0 );
+
+    GetStateCache().BindVertexArray( m_vao );
+    glBufferSubData( GL_ELEMENT_ARRAY_BUFFER, m_IndexCount * sizeof(GLuint), indices.size() * sizeof(GLuint), indices.data() );
+
+    Range range;
+    range.indexCount = (GLsizei)indices.size();
+    range.firstIndex = m_IndexCount;
+
+    m_VertexCount += vertices.size();
+    m_IndexCount += indices.size();
+
+    m_Statistics.shapes++;
+    m_Statistics.vertexBytes = m_VertexCount * sizeof(ShapeVertex);
+    m_Statistics.indexBytes = m_IndexCount * sizeof(GLuint);
+
+    return range;
+}
+
+void ShapeLibrary::Reserve( size_t vertexCount, size_t indexCount )
+{
+    if ( m_vao == 0 )
+    {
+        glGenVertexArrays( 1, &m_vao );
+    }
+
+    bool grow = false;
+    GLuint buffers[2] = { m_VertexBuffer, m_IndexBuffer };
+    size_t capacities[2] = { m_VertexCapacity * sizeof(ShapeVertex), m_IndexCapacity * sizeof(GLuint) };
+    size_t used[2] = { m_VertexCount * sizeof(ShapeVertex), m_IndexCount * sizeof(GLuint) };
+
+    if ( m_VertexCount + vertexCount > m_VertexCapacity )
+    {
+        m_VertexCapacity = std::max( std::max( m_VertexCount + vertexCount, m_VertexCapacity * 2 ), MIN_VERTEX_CAPACITY );
+        grow = true;
+    }
+    if ( m_IndexCount + indexCount > m_IndexCapacity )
+    {
+        m_IndexCapacity = std::max( std::max( m_IndexCount + indexCount, m_IndexCapacity * 2 ), MIN_INDEX_CAPACITY );
+        grow = true;
+    }
+    if ( !grow )
+    {
+        return;
+    }
+
+    // Reallocate both buffers and copy the shapes generated so far on the GPU.
+    size_t newCapacities[2] = { m_VertexCapacity * sizeof(ShapeVertex), m_IndexCapacity * sizeof(GLuint) };
+    for ( int i = 0; i < 2; ++i )
+    {
+        if ( newCapacities[i] == capacities[i] )
+        {
+            continue;
+        }
+
+        GLuint buffer;
+        glGenBuffers( 1, &buffer );
+        GetStateCache().BindBuffer( GL_COPY_WRITE_BUFFER, buffer );
+        glBufferData( GL_COPY_WRITE_BUFFER, newCapacities[i], NULL, GL_STATIC_DRAW );
+        if ( used[i] > 0 )
+        {
+            GetStateCache().BindBuffer( GL_COPY_READ_BUFFER, buffers[i] );
+            glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used[i] );
+            GetStateCache().BindBuffer( GL_COPY_READ_BUFFER, 0 );
+        }
+        GetStateCache().BindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+        GetStateCache().ForgetBuffer( buffers[i] );
+        glDeleteBuffers( 1, &buffers[i] );
+        buffers[i] = buffer;
+    }
+    m_VertexBuffer = buffers[0];
+    m_IndexBuffer = buffers[1];
+    m_Statistics.arenaGrowths++;
+
+    GetStateCache().BindVertexArray( m_vao );
+    GetStateCache().BindBuffer( GL_ARRAY_BUFFER, m_VertexBuffer );
+    glVertexAttribPointer( POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(ShapeVertex), MEMBER_OFFSET(ShapeVertex, position) );
+    glEnableVertexAttribArray( POSITION_ATTRIBUTE );
+    glVertexAttribPointer( NORMAL_ATTRIBUTE, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(ShapeVertex), MEMBER_OFFSET(ShapeVertex, normal) );
+    glEnableVertexAttribArray( NORMAL_ATTRIBUTE );
+    GetStateCache().BindBuffer( GL_ELEMENT_ARRAY_BUFFER, m_IndexBuffer );
+    GetStateCache().BindVertexArray( 0 );
+    GetStateCache().BindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+const std::vector<glm::vec2>& ShapeLibrary::GetCircleTable( int n )
+{
+    auto table = m_CircleTables.find( n );
+    if ( table != m_CircleTables.end() )
+    {
+        return table->second;
+    }
+
+    const double _2pi = 2.0 * 3.1415926535897932384626433832795;
+    int size = abs( n );
+    double angle = _2pi / (double)( ( n == 0 ) ? 1 : n );
+
+    std::vector<glm::vec2> circle( size + 1 );
+    circle[0] = glm::vec2( 1, 0 );
+    for ( int i = 1; i < size; ++i )
+    {
+        circle[i] = glm::vec2( cos( angle * i ), sin( angle * i ) );
+    }
+    circle[size] = circle[0];
+
+    return m_CircleTables[n] = circle;
+}
+
+MeshData ShapeLibrary::GenerateSphere( float radius, int slices, int stacks )
+{
+    const std::vector<glm::vec2>& around = GetCircleTable( -slices );
+    const std::vector<glm::vec2>& down = GetCircleTable( stacks * 2 );
+
+    MeshData mesh;
+    AddGrid( mesh, stacks, slices, [&]( int i, int j, glm::vec3& position, glm::vec3& normal )
+    {
+        normal = glm::vec3( around[j] * down[i].y, down[i].x );
+        position = normal * radius;
+    } );
+    return mesh;
+}
+
+MeshData ShapeLibrary::GenerateCone( float base, float height, int slices, int stacks )
+{
+    const std::vector<glm::vec2>& circle = GetCircleTable( -slices );
+    stacks = std::max( stacks, 1 );
+
+    float slant = sqrt( height * height + base * base );
+    float cosn = height / slant;
+    float sinn = base / slant;
+
+    MeshData mesh;
+    AddDisk( mesh, circle, base, 0.0f, -1.0f );
+    AddGrid( mesh, stacks, slices, [&]( int i, int j, glm::vec3& position, glm::vec3& normal )
+    {
+        float t = (float)i / stacks;
+        position = glm::vec3( circle[j] * base * ( 1.0f - t ), height * t );
+        normal = glm::vec3( circle[j] * cosn, sinn );
+    } );
+    return mesh;
+}
+
+MeshData ShapeLibrary::GenerateCylinder( float radius, float height, int slices, int stacks )
+{
+    const std::vector<glm::vec2>& circle = GetCircleTable( -slices );
+    stacks = std::max( stacks, 1 );
+
+    MeshData mesh;
+    AddDisk( mesh, circle, radius, 0.0f, -1.0f );
+    AddDisk( mesh, circle, radius, height, 1.0f );
+    AddGrid( mesh, stacks, slices, [&]( int i, int j, glm::vec3& position, glm::vec3& normal )
+    {
+        position = glm::vec3( circle[j] * radius, height * i / stacks );
+        normal = glm::vec3( circle[j], 0.0f );
+    } );
+    return mesh;
+}
+
+MeshData ShapeLibrary::GenerateTorus( float innerRadius, float outerRadius, int sides, int rings )
+{
+    const std::vector<glm::vec2>& ring = GetCircleTable( std::max( rings, 1 ) );
+    const std::vector<glm::vec2>& side = GetCircleTable( -std::max( sides, 1 ) );
+
+    MeshData mesh;
+    AddGrid( mesh, std::max( rings, 1 ), std::max( sides, 1 ), [&]( int i, int j, glm::vec3& position, glm::vec3& normal )
+    {
+        normal = glm::vec3( ring[i] * side[j].x, side[j].y );
+        position = glm::vec3( ring[i] * ( outerRadius + side[j].x * innerRadius ), side[j].y * innerRadius );
+    } );
+    return mesh;
+}
@@ -0,0 +1,155 @@
+#include <TextureAndLightingPCH.h>
+#include <SphereLod.h>
+#include <MeshOptimizer.h>
+#include <Camera.h>
+
+#include <algorithm>
+#include <sstream>
+
+SphereLodChain::SphereLodChain()
+    : m_BaselineTriangleCount( 0 )
+{}
+
+void SphereLodChain::Build( VertexFormat format )
+{
+    struct Candidate
+    {
+        MeshData mesh;
+        std::string name;
+        float error;
+    };
+    std::vector<Candidate> candidates;
+
+    for ( int subdivisions = 0; subdivisions <= 5; ++subdivisions )
+    {
+        std::ostringstream name;
+        name << "geodesic " << subdivisions;
+        MeshData mesh = GeodesicSphere( 1, subdivisions );
+        Candidate candidate = { mesh, name.str(), ComputeGeometricError( mesh ) };
+        candidates.push_back( candidate );
+    }
+
+    for ( int slices = 8; slices <= 64; slices *= 2 )
+    {
+        std::ostringstream name;
+        name << "uv " << slices << "x" << slices;
+        MeshData mesh = SolidSphere( 1, slices, slices );
+        Candidate candidate = { mesh, name.str(), ComputeGeometricError( mesh ) };
+        candidates.push_back( candidate );
+    }
+
+    m_BaselineTriangleCount = SolidSphere( 1, 32, 32 ).indices.size() / 3;
+
+    std::sort( candidates.begin(), candidates.end(), []( const Candidate& a, const Candidate& b )
+    {
+        return a.mesh.indices.size() < b.mesh.indices.size();
+    } );
+
+    for ( Candidate& candidate : candidates )
+    {
+        // Keep a level only if it is more accurate than every cheaper one.
+        if ( !m_Levels.empty() && candidate.error >= m_Levels.back().geometricError )
+        {
+            continue;
+        }
+
+        OptimizeMesh( candidate.mesh );
+
+        Level level;
+        level.mesh = CreateMesh( candidate.mesh, format );
+        level.meshlets = BuildMeshlets( candidate.mesh );
+        level.name = candidate.name;
+        level.triangleCount = candidate.mesh.indices.size() / 3;
+        level.geometricError = candidate.error;
+        m_Levels.push_back( level );
+
+        std::cout << "Sphere LOD " << m_Levels.size() - 1 << ": " << level.name << ", "
+                  << level.triangleCount << " triangles, " << level.meshlets.size() << " meshlets, error "
+                  << level.geometricError << std::endl;
+    }
+}
+
+bool SphereLodChain::IsBuilt() const
+{
+    return !m_Levels.empty();
+}
+
+int SphereLodChain::GetLevelCount() const
+{
+    return (int)m_Levels.size();
+}
+
+const SphereLodChain::Level& SphereLodChain::GetLevel( int level ) const
+{
+    return m_Levels[level];
+}
+
+int SphereLodChain::SelectLevel( float pixelsPerUnit, int currentLevel, float pixelThreshold, float hysteresis ) const
+{
+    int finest = (int)m_Levels.size() - 1;
+    currentLevel = std::min( std::max( currentLevel, 0 ), finest );
+
+    // Cheapest level that meets the threshold.
+    int required = finest;
+    for ( int i = 0; i < finest; ++i )
+    {
+        if ( m_Levels[i].geometricError * pixelsPerUnit <= pixelThreshold )
+        {
+            required = i;
+            break;
+        }
+    }
+
+    if ( required >= currentLevel )
+    {
+        return required;
+    }
+
+    // Coarsen only if the coarser level is comfortably within the threshold.
+    float coarsenThreshold = pixelThreshold * ( 1.0f - hysteresis );
+    for ( int i = required; i < currentLevel; ++i )
+    {
+        if ( m_Levels[i].geometricError * pixelsPerUnit <= coarsenThreshold )
+        {
+            return i;
+        }
+    }
+    return currentLevel;
+}
+
+void SphereLodChain::CountDraw( int level, LodStatistics& statistics ) const
+{
+    statistics.objects++;
+    statistics.trianglesDrawn += m_Levels[level].triangleCount;
+    statistics.trianglesBaseline += m_BaselineTriangleCount;
+}
+
+float SphereLodChain::ComputeGeometricError( const MeshData& unitSphere )
+{
+    float maxError = 0.0f;
+    for ( size_t i = 0; i + 2 < unitSphere.indices.size(); i += 3 )
+    {
+        const glm::vec3& p0 = unitSphere.positions[unitSphere.indices[i + 0]];
+        const glm::vec3& p1 = unitSphere.positions[unitSphere.indices[i + 1]];
+        const glm::vec3& p2 = unitSphere.positions[unitSphere.indices[i + 2]];
+        glm::vec3 normal = glm::cross( p1 - p0, p2 - p0 );
+        float length = glm::length( normal );
+        if ( length <= 0.0f )
+        {
+            continue; // Degenerate triangles at the UV sphere poles.
+        }
+
+        // Distance from the triangle's plane to the sphere surface.
+        float planeDistance = fabs( glm::dot( normal / length, p0 ) );
+        maxError = std::max( maxError, 1.0f - planeDistance );
+    }
+    return maxError;
+}
+
+float GetPixelsPerUnit( Camera& camera, float scale, float distance )
+{
+    // projection[1][1] = cot(fov/2) maps view-space height to NDC; half the
+    // viewport height maps NDC to pixels.
+    float viewportHeight = camera.GetViewport().w;
+    return scale * camera.GetProjectionMatrix()[1][1] * 0.5f * viewportHeight / std::max( distance, 1e-4f );
+}
@@ -0,0 +1,410 @@
+#include <TextureAndLightingPCH.h>
+#include <StateCache.h>
+
+namespace
+{
+    // Shadow value of a binding that has not been set through the cache.
+    const GLuint UNKNOWN = 0xFFFFFFFF;
+    const int UNKNOWN_CAPABILITY = -1;
+
+    const GLenum s_BufferTargets[] = { GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER };
+    // The copy targets are their own binding queries.
+    const GLenum s_BufferBindings[] = { GL_ARRAY_BUFFER_BINDING, GL_ELEMENT_ARRAY_BUFFER_BINDING, GL_UNIFORM_BUFFER_BINDING, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GL_PIXEL_PACK_BUFFER_BINDING, GL_PIXEL_UNPACK_BUFFER_BINDING };
+
+    const GLenum s_TextureTargets[] = { GL_TEXTURE_1D, GL_TEXTURE_2D, GL_TEXTURE_3D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP };
+    const GLenum s_TextureBindings[] = { GL_TEXTURE_BINDING_1D, GL_TEXTURE_BINDING_2D, GL_TEXTURE_BINDING_3D, GL_TEXTURE_BINDING_2D_ARRAY, GL_TEXTURE_BINDING_CUBE_MAP };
+
+    const GLenum s_Capabilities[] = { GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_SCISSOR_TEST, GL_STENCIL_TEST, GL_POLYGON_OFFSET_FILL };
+
+    template<typename T, size_t N>
+    int Find( const T (&values)[N], T value )
+    {
+        for ( size_t i = 0; i < N; ++i )
+        {
+            if ( values[i] == value )
+            {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+}
+
+StateCache::StateCache()
+    : m_Validate( false )
+    , m_Statistics()
+{
+    Invalidate();
+}
+
+void StateCache::Invalidate()
+{
+    m_Program = UNKNOWN;
+    m_VertexArray = UNKNOWN;
+    m_ActiveUnit = UNKNOWN;
+    for ( GLuint& buffer : m_Buffers )
+    {
+        buffer = UNKNOWN;
+    }
+    for ( int unit = 0; unit < MAX_TEXTURE_UNITS; ++unit )
+    {
+        for ( GLuint& texture : m_Textures[unit] )
+        {
+            texture = UNKNOWN;
+        }
+        m_Samplers[unit] = UNKNOWN;
+    }
+    for ( int& capability : m_Capabilities )
+    {
+        capability = UNKNOWN_CAPABILITY;
+    }
+}
+
+int StateCache::GetBufferTarget( GLenum target )
+{
+    return Find( s_BufferTargets, target );
+}
+
+int StateCache::GetTextureTarget( GLenum target )
+{
+    return Find( s_TextureTargets, target );
+}
+
+int StateCache::GetCapability( GLenum capability )
+{
+    return Find( s_Capabilities, capability );
+}
+
+bool StateCache::Check( const char* what, GLint actual, GLint expected )
+{
+    if ( actual == expected )
+    {
+        return true;
+    }
+
+    ++m_Statistics.mismatches;
+    std::cerr << "StateCache: " << what << " is " << actual << ", shadow state says " << expected << std::endl;
+    return false;
+}
+
+bool StateCache::Elide( GLenum binding, GLuint expected )
+{
+    if ( m_Validate )
+    {
+        GLint actual = 0;
+        glGetIntegerv( binding, &actual );
+        if ( !Check( "binding", actual, (GLint)expected ) )
+        {
+            return false;
+        }
+    }
+
+    ++m_Statistics.elided;
+    return true;
+}
+
+bool StateCache::ElideUnitBinding( GLuint unit, GLenum binding, GLuint expected )
+{
+    if ( m_Validate )
+    {
+        // Query through the unit without disturbing the active unit.
+        GLint active = 0, actual = 0;
+        glGetIntegerv( GL_ACTIVE_TEXTURE, &active );
+        glActiveTexture( GL_TEXTURE0 + unit );
+        glGetIntegerv( binding, &actual );
+        glActiveTexture( active );
+        if ( !Check( "texture unit binding", actual, (GLint)expected ) )
+        {
+            return false;
+        }
+    }
+
+    ++m_Statistics.elided;
+    return true;
+}
+
+bool StateCache::ElideCapability( GLenum capability, bool expected )
+{
+    if ( m_Validate && !Check( "capability", glIsEnabled( capability ), expected ) )
+    {
+        return false;
+    }
+
+    ++m_Statistics.elided;
+    return true;
+}
+
+void StateCache::UseProgram( GLuint program )
+{
+    if ( m_Program == program && Elide( GL_CURRENT_PROGRAM, program ) )
+    {
+        return;
+    }
+
+    glUseProgram( program );
+    m_Program = program;
+    ++m_Statistics.issued;
+}
+
+void StateCache::BindVertexArray( GLuint vao )
+{
+    if ( m_VertexArray == vao && Elide( GL_VERTEX_ARRAY_BINDING, vao ) )
+    {
+        return;
+    }
+
+    glBindVertexArray( vao );
+    m_VertexArray = vao;
+    m_Buffers[BUFFER_ELEMENT_ARRAY] = UNKNOWN;
+    ++m_Statistics.issued;
+}
+
+void StateCache::BindBuffer( GLenum target, GLuint buffer )
+{
+    int index = GetBufferTarget( target );
+    if ( index >= 0 && m_Buffers[index] == buffer && Elide( s_BufferBindings[index], buffer ) )
+    {
+        return;
+    }
+
+    glBindBuffer( target, buffer );
+    if ( index >= 0 )
+    {
+        m_Buffers[index] = buffer;
+    }
+    ++m_Statistics.issued;
+}
+
+void StateCache::BindBufferRange( GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size )
+{
+    // Ranges change with every call; only the generic binding is shadowed.
+    glBindBufferRange( target, index, buffer, offset, size );
+    int targetIndex = GetBufferTarget( target );
+    if ( targetIndex >= 0 )
+    {
+        m_Buffers[targetIndex] = buffer;
+    }
+    ++m_Statistics.issued;
+}
+
+void StateCache::ActiveTexture( GLuint unit )
+{
+    if ( m_ActiveUnit == unit && Elide( GL_ACTIVE_TEXTURE, GL_TEXTURE0 + unit ) )
+    {
+        return;
+    }
+
+    glActiveTexture( GL_TEXTURE0 + unit );
+    m_ActiveUnit = unit;
+    ++m_Statistics.issued;
+}
+
+void StateCache::BindTexture( GLenum target, GLuint texture )
+{
+    if ( m_ActiveUnit == UNKNOWN )
+    {
+        GLint active = GL_TEXTURE0;
+        glGetIntegerv( GL_ACTIVE_TEXTURE, &active );
+        m_ActiveUnit = active - GL_TEXTURE0;
+    }
+    BindTexture( m_ActiveUnit, target, texture );
+}
+
+void StateCache::BindTexture( GLuint unit, GLenum target, GLuint texture )
+{
+    int index = GetTextureTarget( target );
+    if ( unit >= MAX_TEXTURE_UNITS || index < 0 )
+    {
+        ActiveTexture( unit );
+        glBindTexture( target, texture );
+        ++m_Statistics.issued;
+        return;
+    }
+
+    if ( m_Textures[unit][index] == texture && ElideUnitBinding( unit, s_TextureBindings[index], texture ) )
+    {
+        return;
+    }
+
+    ActiveTexture( unit );
+    glBindTexture( target, texture );
+    m_Textures[unit][index] = texture;
+    ++m_Statistics.issued;
+}
+
+void StateCache::BindSampler( GLuint unit, GLuint sampler )
+{
+    if ( unit < MAX_TEXTURE_UNITS && m_Samplers[unit] == sampler && ElideUnitBinding( unit, GL_SAMPLER_BINDING, sampler ) )
+    {
+        return;
+    }
+
+    glBindSampler( unit, sampler );
+    if ( unit < MAX_TEXTURE_UNITS )
+    {
+        m_Samplers[unit] = sampler;
+    }
+    ++m_Statistics.issued;
+}
+
+void StateCache::SetCapability( GLenum capability, bool enabled )
+{
+    int index = GetCapability( capability );
+    if ( index >= 0 && m_Capabilities[index] == (int)enabled && ElideCapability( capability, enabled ) )
+    {
+        return;
+    }
+
+    if ( enabled )
+    {
+        glEnable( capability );
+    }
+    else
+    {
+        glDisable( capability );
+    }
+    if ( index >= 0 )
+    {
+        m_Capabilities[index] = enabled;
+    }
+    ++m_Statistics.issued;
+}
+
+void StateCache::Enable( GLenum capability )
+{
+    SetCapability( capability, true );
+}
+
+void StateCache::Disable( GLenum capability )
+{
+    SetCapability( capability, false );
+}
+
+void StateCache::ForgetProgram( GLuint program )
+{
+    // A deleted program stays in use until another one is bound, so the
+    // shadow value is still right; it only must not match a reused name.
+    if ( m_Program == program )
+    {
+        m_Program = UNKNOWN;
+    }
+}
+
+void StateCache::ForgetVertexArray( GLuint vao )
+{
+    if ( m_VertexArray == vao )
+    {
+        m_VertexArray = 0;
+        m_Buffers[BUFFER_ELEMENT_ARRAY] = UNKNOWN;
+    }
+}
+
+void StateCache::ForgetBuffer( GLuint buffer )
+{
+    for ( GLuint& binding : m_Buffers )
+    {
+        if ( binding == buffer )
+        {
+            binding = 0;
+        }
+    }
+}
+
+void StateCache::ForgetTexture( GLuint texture )
+{
+    for ( int unit = 0; unit < MAX_TEXTURE_UNITS; ++unit )
+    {
+        for ( GLuint& binding : m_Textures[unit] )
+        {
+            if ( binding == texture )
+            {
+                binding = 0;
+            }
+        }
+    }
+}
+
+void StateCache::SetValidation( bool enabled )
+{
+    m_Validate = enabled;
+}
+
+bool StateCache::IsValidating() const
+{
+    return m_Validate;
+}
+
+bool StateCache::Validate()
+{
+    size_t mismatches = m_Statistics.mismatches;
+    GLint actual = 0;
+
+    if ( m_Program != UNKNOWN )
+    {
+        glGetIntegerv( GL_CURRENT_PROGRAM, &actual );
+        Check( "GL_CURRENT_PROGRAM", actual, m_Program );
+    }
+    if ( m_VertexArray != UNKNOWN )
+    {
+        glGetIntegerv( GL_VERTEX_ARRAY_BINDING, &actual );
+        Check( "GL_VERTEX_ARRAY_BINDING", actual, m_VertexArray );
+    }
+    for ( int i = 0; i < BUFFER_TARGET_COUNT; ++i )
+    {
+        if ( m_Buffers[i] != UNKNOWN )
+        {
+            glGetIntegerv( s_BufferBindings[i], &actual );
+            Check( "buffer binding", actual, m_Buffers[i] );
+        }
+    }
+    for ( int i = 0; i < CAPABILITY_COUNT; ++i )
+    {
+        if ( m_Capabilities[i] != UNKNOWN_CAPABILITY )
+        {
+            Check( "capability", glIsEnabled( s_Capabilities[i] ), m_Capabilities[i] );
+        }
+    }
+
+    GLint active = GL_TEXTURE0;
+    glGetIntegerv( GL_ACTIVE_TEXTURE, &active );
+    if ( m_ActiveUnit != UNKNOWN )
+    {
+        Check( "GL_ACTIVE_TEXTURE", active - GL_TEXTURE0, m_ActiveUnit );
+    }
+    for ( int unit = 0; unit < MAX_TEXTURE_UNITS; ++unit )
+    {
+        glActiveTexture( GL_TEXTURE0 + unit );
+        for ( int i = 0; i < TEXTURE_TARGET_COUNT; ++i )
+        {
+            if ( m_Textures[unit][i] != UNKNOWN )
+            {
+                glGetIntegerv( s_TextureBindings[i], &actual );
+                Check( "texture binding", actual, m_Textures[unit][i] );
+            }
+        }
+        if ( m_Samplers[unit] != UNKNOWN )
+        {
+            glGetIntegerv( GL_SAMPLER_BINDING, &actual );
+            Check( "GL_SAMPLER_BINDING", actual, m_Samplers[unit] );
+        }
+    }
+    glActiveTexture( active );
+
+    return m_Statistics.mismatches == mismatches;
+}
+
+const StateCacheStatistics& StateCache::GetStatistics() const
+{
+    return m_Statistics;
+}
+
+void StateCache::ResetStatistics()
+{
+    m_Statistics = StateCacheStatistics();
+}
+
+StateCache& GetStateCache()
+{
+    static StateCache cache;
+    return cache;
+}
@@ -0,0 +1,610 @@
+#include <TextureAndLightingPCH.h>
+#include <Teapot.h>
+#include <MeshOptimizer.h>
+#include <Parallel.h>
+#include <Simd.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+    // Newell's teapot, from freeglut_teapot_data.h. Rim, body, lid and bottom
+    // are mirrored in x and y; handle and spout across y only.
+    const int teapotPatchData[10][16] =
+    {
+        { 102, 103, 104, 105,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15 }, // rim
+        {  12,  13,  14,  15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27 }, // body
+        {  24,  25,  26,  27,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40 },
+        {  96,  96,  96,  96,  97,  98,  99, 100, 101, 101, 101, 101,   0,   1,   2,   3 }, // lid
+        {   0,   1,   2,   3, 106, 107, 108, 109, 110, 111, 112, 113, 114, 115, 116, 117 },
+        { 118, 118, 118, 118, 124, 122, 119, 121, 123, 126, 125, 120,  40,  39,  38,  37 }, // bottom
+        {  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51,  52,  53,  54,  55,  56 }, // handle
+        {  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  28,  65,  66,  67 },
+        {  68,  69,  70,  71,  72,  73,  74,  75,  76,  77,  78,  79,  80,  81,  82,  83 }, // spout
+        {  80,  81,  82,  83,  84,  85,  86,  87,  88,  89,  90,  91,  92,  93,  94,  95 }
+    };
+    const int TEAPOT_MIRRORED_PATCHES = 6;
+
+    const float teapotControlPoints[127][3] =
+    {
+        {0.2f, 0, 2.7f}, {0.2f, -0.112f, 2.7f}, {0.112f, -0.2f, 2.7f}, {0, -0.2f, 2.7f},
+        {1.3375f, 0, 2.53125f}, {1.3375f, -0.749f, 2.53125f}, {0.749f, -1.3375f, 2.53125f}, {0, -1.3375f, 2.53125f},
+        {1.4375f, 0, 2.53125f}, {1.4375f, -0.805f, 2.53125f}, {0.805f, -1.4375f, 2.53125f}, {0, -1.4375f, 2.53125f},
+        {1.5f, 0, 2.4f}, {1.5f, -0.84f, 2.4f}, {0.84f, -1.5f, 2.4f}, {0, -1.5f, 2.4f},
+        {1.75f, 0, 1.875f}, {1.75f, -0.98f, 1.875f}, {0.98f, -1.75f, 1.875f}, {0, -1.75f, 1.875f},
+        {2, 0, 1.35f}, {2, -1.12f, 1.35f}, {1.12f, -2, 1.35f}, {0, -2, 1.35f},
+        {2, 0, 0.9f}, {2, -1.12f, 0.9f}, {1.12f, -2, 0.9f}, {0, -2, 0.9f},
+        {-2, 0, 0.9f}, {2, 0, 0.45f}, {2, -1.12f, 0.45f}, {1.12f, -2, 0.45f},
+        {0, -2, 0.45f}, {1.5f, 0, 0.225f}, {1.5f, -0.84f, 0.225f}, {0.84f, -1.5f, 0.225f},
+        {0, -1.5f, 0.225f}, {1.5f, 0, 0.15f}, {1.5f, -0.84f, 0.15f}, {0.84f, -1.5f, 0.15f},
+        {0, -1.5f, 0.15f}, {-1.6f, 0, 2.025f}, {-1.6f, -0.3f, 2.025f}, {-1.5f, -0.3f, 2.25f},
+        {-1.5f, 0, 2.25f}, {-2.3f, 0, 2.025f}, {-2.3f, -0.3f, 2.025f}, {-2.5f, -0.3f, 2.25f},
+        {-2.5f, 0, 2.25f}, {-2.7f, 0, 2.025f}, {-2.7f, -0.3f, 2.025f}, {-3, -0.3f, 2.25f},
+        {-3, 0, 2.25f}, {-2.7f, 0, 1.8f}, {-2.7f, -0.3f, 1.8f}, {-3, -0.3f, 1.8f},
+        {-3, 0, 1.8f}, {-2.7f, 0, 1.575f}, {-2.7f, -0.3f, 1.575f}, {-3, -0.3f, 1.35f},
+        {-3, 0, 1.35f}, {-2.5f, 0, 1.125f}, {-2.5f, -0.3f, 1.125f}, {-2.65f, -0.3f, 0.9375f},
+        {-2.65f, 0, 0.9375f}, {-2, -0.3f, 0.9f}, {-1.9f, -0.3f, 0.6f}, {-1.9f, 0, 0.6f},
+        {1.7f, 0, 1.425f}, {1.7f, -0.66f, 1.425f}, {1.7f, -0.66f, 0.6f}, {1.7f, 0, 0.6f},
+        {2.6f, 0, 1.425f}, {2.6f, -0.66f, 1.425f}, {3.1f, -0.66f, 0.825f}, {3.1f, 0, 0.825f},
+        {2.3f, 0, 2.1f}, {2.3f, -0.25f, 2.1f}, {2.4f, -0.25f, 2.025f}, {2.4f, 0, 2.025f},
+        {2.7f, 0, 2.4f}, {2.7f, -0.25f, 2.4f}, {3.3f, -0.25f, 2.4f}, {3.3f, 0, 2.4f},
+        {2.8f, 0, 2.475f}, {2.8f, -0.25f, 2.475f}, {3.525f, -0.25f, 2.49375f}, {3.525f, 0, 2.49375f},
+        {2.9f, 0, 2.475f}, {2.9f, -0.15f, 2.475f}, {3.45f, -0.15f, 2.5125f}, {3.45f, 0, 2.5125f},
+        {2.8f, 0, 2.4f}, {2.8f, -0.15f, 2.4f}, {3.2f, -0.15f, 2.4f}, {3.2f, 0, 2.4f},
+        {0, 0, 3.15f}, {0.8f, 0, 3.15f}, {0.8f, -0.45f, 3.15f}, {0.45f, -0.8f, 3.15f},
+        {0, -0.8f, 3.15f}, {0, 0, 2.85f}, {1.4f, 0, 2.4f}, {1.4f, -0.784f, 2.4f},
+        {0.784f, -1.4f, 2.4f}, {0, -1.4f, 2.4f}, {0.4f, 0, 2.55f}, {0.4f, -0.224f, 2.55f},
+        {0.224f, -0.4f, 2.55f}, {0, -0.4f, 2.55f}, {1.3f, 0, 2.55f}, {1.3f, -0.728f, 2.55f},
+        {0.728f, -1.3f, 2.55f}, {0, -1.3f, 2.55f}, {1.3f, 0, 2.4f}, {1.3f, -0.728f, 2.4f},
+        {0.728f, -1.3f, 2.4f}, {0, -1.3f, 2.4f}, {0, 0, 0}, {1.425f, -0.798f, 0},
+        {1.5f, 0, 0.075f}, {1.425f, 0, 0}, {0.798f, -1.425f, 0}, {0, -1.5f, 0.075f},
+        {0, -1.425f, 0}, {1.5f, -0.84f, 0.075f}, {0.84f, -1.5f, 0.075f}
+    };
+
+    const int TEAPOT_DENSITIES[] = { 1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64 };
+
+    // Vertices that share a position are merged when their normals are
+    // within about 25 degrees; sharper creases keep separate normals.
+    const float WELD_DISTANCE = 1e-5f;
+    const float WELD_NORMAL_COS = 0.9f;
+
+    // fghTeapot's transform for glutSolidTeapot( 1 ): translate by -1.5 in z,
+    // scale by 0.5 and rotate 270 degrees about x.
+    glm::vec3 ToTeapotFrame( float x, float y, float z )
+    {
+        return glm::vec3( x, z - 1.5f, -y ) * 0.5f;
+    }
+
+    // Cubic Bernstein weights and their derivatives at t.
+    void BernsteinBasis( float t, float weights[4], float derivatives[4] )
+    {
+        float s = 1.0f - t;
+        weights[0] = s * s * s;
+        weights[1] = 3.0f * t * s * s;
+        weights[2] = 3.0f * t * t * s;
+        weights[3] = t * t * t;
+        derivatives[0] = -3.0f * s * s;
+        derivatives[1] = 3.0f * s * s - 6.0f * t * s;
+        derivatives[2] = 6.0f * t * s - 3.0f * t * t;
+        derivatives[3] = 3.0f * t * t;
+    }
+
+    struct BasisTable
+    {
+        std::vector<float> weights;         // 4 per sample
+        std::vector<float> derivatives;
+
+        explicit BasisTable( int segments )
+            : weights( ( segments + 1 ) * 4 )
+            , derivatives( ( segments + 1 ) * 4 )
+        {
+            for ( int i = 0; i <= segments; ++i )
+            {
+                BernsteinBasis( (float)i / segments, &weights[i * 4], &derivatives[i * 4] );
+            }
+        }
+    };
+
+    void EvaluatePatch( const BezierPatch& patch, float u, float v, glm::vec3& position, glm::vec3& normal )
+    {
+        float bu[4], du[4], bv[4], dv[4];
+        BernsteinBasis( u, bu, du );
+        BernsteinBasis( v, bv, dv );
+
+        glm::vec3 pu( 0 ), pv( 0 );
+        position = glm::vec3( 0 );
+        for ( int j = 0; j < 4; ++j )
+        {
+            for ( int k = 0; k < 4; ++k )
+            {
+                const glm::vec3& c = patch.points[j * 4 + k];
+                position += bv[j] * bu[k] * c;
+                pu += bv[j] * du[k] * c;
+                pv += dv[j] * bu[k] * c;
+            }
+        }
+        normal = glm::cross( pu, pv );
+    }
+
+    // Patches whose control points collapse to a point (the lid knob and the
+    // bottom centre) have no tangent plane at that edge. Take the normal from
+    // just inside the patch instead.
+    void FixDegenerateNormals( const BezierPatch* patches, int first, int last, int segments, glm::vec3* normals )
+    {
+        const float nudge = 1e-3f;
+        int gridSize = ( segments + 1 ) * ( segments + 1 );
+        for ( int p = first; p < last; ++p )
+        {
+            for ( int i = 0; i < gridSize; ++i )
+            {
+                glm::vec3& normal = normals[p * gridSize + i];
+                if ( normal != glm::vec3( 0 ) )
+                {
+                    continue;
+                }
+
+                float u = (float)( i % ( segments + 1 ) ) / segments;
+                float v = (float)( i / ( segments + 1 ) ) / segments;
+                glm::vec3 position;
+                EvaluatePatch( patches[p], u + ( 0.5f - u ) * nudge, v + ( 0.5f - v ) * nudge, position, normal );
+                normal = glm::normalize( normal );
+            }
+        }
+    }
+
+    void TessellateRangeScalar( const BezierPatch* patches, int first, int last, const BasisTable& basis, int segments,
+                                glm::vec3* positions, glm::vec3* normals )
+    {
+        int columns = segments + 1;
+        for ( int p = first; p < last; ++p )
+        {
+            const glm::vec3* c = patches[p].points;
+            size_t base = (size_t)p * columns * columns;
+            for ( int i = 0; i <= segments; ++i )
+            {
+                const float* bu = &basis.weights[i * 4];
+                const float* du = &basis.derivatives[i * 4];
+
+                // Collapse the u direction: one curve and its u derivative per row.
+                glm::vec3 rows[4], rowDerivatives[4];
+                for ( int j = 0; j < 4; ++j )
+                {
+                    rows[j] = bu[0] * c[j * 4] + bu[1] * c[j * 4 + 1] + bu[2] * c[j * 4 + 2] + bu[3] * c[j * 4 + 3];
+                    rowDerivatives[j] = du[0] * c[j * 4] + du[1] * c[j * 4 + 1] + du[2] * c[j * 4 + 2] + du[3] * c[j * 4 + 3];
+                }
+
+                for ( int j = 0; j <= segments; ++j )
+                {
+                    const float* bv = &basis.weights[j * 4];
+                    const float* dv = &basis.derivatives[j * 4];
+                    glm::vec3 position = bv[0] * rows[0] + bv[1] * rows[1] + bv[2] * rows[2] + bv[3] * rows[3];
+                    glm::vec3 pu = bv[0] * rowDerivatives[0] + bv[1] * rowDerivatives[1] + bv[2] * rowDerivatives[2] + bv[3] * rowDerivatives[3];
+                    glm::vec3 pv = dv[0] * rows[0] + dv[1] * rows[1] + dv[2] * rows[2] + dv[3] * rows[3];
+                    glm::vec3 normal = glm::cross( pu, pv );
+                    float length2 = glm::dot( normal, normal );
+
+                    size_t index = base + j * columns + i;
+                    positions[index] = position;
+                    normals[index] = ( length2 > 1e-12f ) ? normal / sqrtf( length2 ) : glm::vec3( 0 );
+                }
+            }
+        }
+    }
+
+#if SIMD_SSE2
+    inline __m128 LoadPoint( const glm::vec3& p )
+    {
+        return _mm_set_ps( 0.0f, p.z, p.y, p.x );
+    }
+
+    // Weighted sum of four points.
+    inline __m128 Combine( const __m128* points, size_t stride, const float* weights )
+    {
+        __m128 sum = _mm_mul_ps( points[0], _mm_set1_ps( weights[0] ) );
+        sum = _mm_add_ps( sum, _mm_mul_ps( points[stride], _mm_set1_ps( weights[1] ) ) );
+        sum = _mm_add_ps( sum, _mm_mul_ps( points[stride * 2], _mm_set1_ps( weights[2] ) ) );
+        return _mm_add_ps( sum, _mm_mul_ps( points[stride * 3], _mm_set1_ps( weights[3] ) ) );
+    }
+
+    inline __m128 Cross( __m128 a, __m128 b )
+    {
+        __m128 aYZX = _mm_shuffle_ps( a, a, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+        __m128 bYZX = _mm_shuffle_ps( b, b, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+        __m128 c = _mm_sub_ps( _mm_mul_ps( a, bYZX ), _mm_mul_ps( aYZX, b ) );
+        return _mm_shuffle_ps( c, c, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+    }
+
+    inline void StorePoint( glm::vec3& dst, __m128 p )
+    {
+        float values[4];
+        _mm_storeu_ps( values, p );
+        dst = glm::vec3( values[0], values[1], values[2] );
+    }
+
+    void TessellateRangeSse( const BezierPatch* patches, int first, int last, const BasisTable& basis, int segments,
+                             glm::vec3* positions, glm::vec3* normals )
+    {
+        int columns = segments + 1;
+        const __m128 epsilon = _mm_set1_ps( 1e-12f );
+        for ( int p = first; p < last; ++p )
+        {
+            __m128 c[16];
+            for ( int k = 0; k < 16; ++k )
+            {
+                c[k] = LoadPoint( patches[p].points[k] );
+            }
+
+            size_t base = (size_t)p * columns * columns;
+            for ( int i = 0; i <= segments; ++i )
+            {
+                const float* bu = &basis.weights[i * 4];
+                const float* du = &basis.derivatives[i * 4];
+
+                __m128 rows[4], rowDerivatives[4];
+                for ( int j = 0; j < 4; ++j )
+                {
+                    rows[j] = Combine( c + j * 4, 1, bu );
+                    rowDerivatives[j] = Combine( c + j * 4, 1, du );
+                }
+
+                for ( int j = 0; j <= segments; ++j )
+                {
+                    const float* bv = &basis.weights[j * 4];
+                    const float* dv = &basis.derivatives[j * 4];
+                    __m128 position = Combine( rows, 1, bv );
+                    __m128 pu = Combine( rowDerivatives, 1, bv );
+                    __m128 pv = Combine( rows, 1, dv );
+                    __m128 normal = Cross( pu, pv );
+
+                    __m128 squared = _mm_mul_ps( normal, normal );
+                    __m128 length2 = _mm_add_ps( _mm_add_ps( squared, _mm_shuffle_ps( squared, squared, _MM_SHUFFLE( 0, 3, 2, 1 ) ) ),
+                                                 _mm_shuffle_ps( squared, squared, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+                    length2 = _mm_shuffle_ps( length2, length2, _MM_SHUFFLE( 0, 0, 0, 0 ) );
+                    __m128 valid = _mm_cmpgt_ps( length2, epsilon );
+                    normal = _mm_and_ps( _mm_div_ps( normal, _mm_sqrt_ps( _mm_max_ps( length2, epsilon ) ) ), valid );
+
+                    size_t index = base + j * columns + i;
+                    StorePoint( positions[index], position );
+                    StorePoint( normals[index], normal );
+                }
+            }
+        }
+    }
+#endif
+
+    // Upper bound of the distance between a patch and its uniform
+    // tessellation with n segments is ( Muu + 2 Muv + Mvv ) / ( 8 n^2 ), where
+    // the M are bounds on the second derivatives (Filip et al.).
+    float GetFlatnessBound( const BezierPatch& patch )
+    {
+        const glm::vec3* c = patch.points;
+        float muu = 0.0f, mvv = 0.0f, muv = 0.0f;
+        for ( int j = 0; j < 4; ++j )
+        {
+            for ( int k = 0; k < 2; ++k )
+            {
+                muu = std::max( muu, glm::length( c[j * 4 + k + 2] - 2.0f * c[j * 4 + k + 1] + c[j * 4 + k] ) );
+                mvv = std::max( mvv, glm::length( c[( k + 2 ) * 4 + j] - 2.0f * c[( k + 1 ) * 4 + j] + c[k * 4 + j] ) );
+            }
+        }
+        for ( int j = 0; j < 3; ++j )
+        {
+            for ( int k = 0; k < 3; ++k )
+            {
+                muv = std::max( muv, glm::length( c[( j + 1 ) * 4 + k + 1] - c[( j + 1 ) * 4 + k] - c[j * 4 + k + 1] + c[j * 4 + k] ) );
+            }
+        }
+        return ( 6.0f * muu + 2.0f * 9.0f * muv + 6.0f * mvv ) / 8.0f;
+    }
+
+    // Merge vertices that are within WELD_DISTANCE of each other. Every
+    // vertex in a group takes the same position, so neighbouring patches
+    // meet without cracks; vertices with similar normals also share an
+    // averaged normal, and are merged outright when their UVs match too.
+    void WeldVertices( MeshData& mesh )
+    {
+        size_t count = mesh.positions.size();
+        std::vector<GLuint> order( count );
+        for ( size_t i = 0; i < count; ++i )
+        {
+            order[i] = (GLuint)i;
+        }
+        std::sort( order.begin(), order.end(), [&]( GLuint a, GLuint b ) { return mesh.positions[a].x < mesh.positions[b].x; } );
+
+        const GLuint unassigned = ~0u;
+        std::vector<GLuint> remap( count, unassigned );
+        std::vector<bool> grouped( count, false );
+        MeshData welded;
+
+        std::vector<GLuint> group;
+        std::vector<GLuint> normalGroup;
+        std::vector<glm::vec3> groupNormals;
+        for ( size_t a = 0; a < count; ++a )
+        {
+            GLuint first = order[a];
+            if ( grouped[first] )
+            {
+                continue;
+            }
+
+            group.assign( 1, first );
+            grouped[first] = true;
+            for ( size_t b = a + 1; b < count && mesh.positions[order[b]].x - mesh.positions[first].x <= WELD_DISTANCE; ++b )
+            {
+                GLuint other = order[b];
+                if ( !grouped[other] && glm::length( mesh.positions[other] - mesh.positions[first] ) <= WELD_DISTANCE )
+                {
+                    group.push_back( other );
+                    grouped[other] = true;
+                }
+            }
+
+            // Split the group by normal and average each part.
+            normalGroup.resize( group.size() );
+            groupNormals.clear();
+            for ( size_t i = 0; i < group.size(); ++i )
+            {
+                const glm::vec3& normal = mesh.normals[group[i]];
+                size_t g = 0;
+                while ( g < groupNormals.size() && glm::dot( glm::normalize( groupNormals[g] ), normal ) < WELD_NORMAL_COS )
+                {
+                    ++g;
+                }
+                if ( g == groupNormals.size() )
+                {
+                    groupNormals.push_back( glm::vec3( 0 ) );
+                }
+                groupNormals[g] += normal;
+                normalGroup[i] = (GLuint)g;
+            }
+
+            size_t firstWelded = welded.positions.size();
+            for ( size_t i = 0; i < group.size(); ++i )
+            {
+                GLuint vertex = group[i];
+                glm::vec3 normal = glm::normalize( groupNormals[normalGroup[i]] );
+                const glm::vec2& uv = mesh.textureCoords[vertex];
+
+                size_t match = firstWelded;
+                while ( match < welded.positions.size() && ( welded.normals[match] != normal || welded.textureCoords[match] != uv ) )
+                {
+                    ++match;
+                }
+                if ( match == welded.positions.size() )
+                {
+                    welded.positions.push_back( mesh.positions[first] );
+                    welded.normals.push_back( normal );
+                    welded.textureCoords.push_back( uv );
+                }
+                remap[vertex] = (GLuint)match;
+            }
+        }
+
+        // Drop the triangles that collapsed at degenerate patch edges.
+        for ( size_t i = 0; i + 2 < mesh.indices.size(); i += 3 )
+        {
+            GLuint a = remap[mesh.indices[i]], b = remap[mesh.indices[i + 1]], c = remap[mesh.indices[i + 2]];
+            glm::vec3 normal = glm::cross( welded.positions[b] - welded.positions[a], welded.positions[c] - welded.positions[a] );
+            if ( glm::dot( normal, normal ) > 0.0f )
+            {
+                welded.indices.push_back( a );
+                welded.indices.push_back( b );
+                welded.indices.push_back( c );
+            }
+        }
+
+        mesh = welded;
+    }
+}
+
+const std::vector<BezierPatch>& GetTeapotPatches()
+{
+    static std::vector<BezierPatch> patches;
+    if ( !patches.empty() )
+    {
+        return patches;
+    }
+
+    // The same four copies as fghTeapot: original, mirrored in y, in x and in
+    // both. Single mirrors reverse u to keep the winding.
+    const glm::vec2 mirrors[4] = { glm::vec2( 1, 1 ), glm::vec2( 1, -1 ), glm::vec2( -1, 1 ), glm::vec2( -1, -1 ) };
+    for ( int mirror = 0; mirror < 4; ++mirror )
+    {
+        for ( int i = 0; i < 10; ++i )
+        {
+            if ( mirror >= 2 && i >= TEAPOT_MIRRORED_PATCHES )
+            {
+                continue;
+            }
+
+            bool reverse = ( mirror == 1 || mirror == 2 );
+            BezierPatch patch;
+            for ( int j = 0; j < 4; ++j )
+            {
+                for ( int k = 0; k < 4; ++k )
+                {
+                    const float* c = teapotControlPoints[teapotPatchData[i][j * 4 + ( reverse ? 3 - k : k )]];
+                    patch.points[j * 4 + k] = ToTeapotFrame( c[0] * mirrors[mirror].x, c[1] * mirrors[mirror].y, c[2] );
+                }
+            }
+            patches.push_back( patch );
+        }
+    }
+    assert( patches.size() == TEAPOT_PATCH_COUNT );
+    return patches;
+}
+
+int ChooseTeapotSegments( float maxError )
+{
+    float bound = 0.0f;
+    for ( const BezierPatch& patch : GetTeapotPatches() )
+    {
+        bound = std::max( bound, GetFlatnessBound( patch ) );
+    }
+
+    float segments = sqrtf( bound / std::max( maxError, 1e-6f ) );
+    for ( int density : TEAPOT_DENSITIES )
+    {
+        if ( density >= segments )
+        {
+            return density;
+        }
+    }
+    return TEAPOT_MAX_SEGMENTS;
+}
+
+void TessellatePatches( const BezierPatch* patches, int patchCount, int segments, glm::vec3* positions, glm::vec3* normals )
+{
+    BasisTable basis( segments );
+
+    // Keep small tessellations on one thread.
+    int verticesPerPatch = ( segments + 1 ) * ( segments + 1 );
+    int minGrain = std::max( 1, 16384 / verticesPerPatch );
+
+    ParallelFor( patchCount, minGrain, [&]( int begin, int end )
+    {
+#if SIMD_SSE2
+        TessellateRangeSse( patches, begin, end, basis, segments, positions, normals );
+#else
+        TessellateRangeScalar( patches, begin, end, basis, segments, positions, normals );
+#endif
+        FixDegenerateNormals( patches, begin, end, segments, normals );
+    } );
+}
+
+void TessellatePatchesReference( const BezierPatch* patches, int patchCount, int segments, glm::vec3* positions, glm::vec3* normals )
+{
+    BasisTable basis( segments );
+    TessellateRangeScalar( patches, 0, patchCount, basis, segments, positions, normals );
+    FixDegenerateNormals( patches, 0, patchCount, segments, normals );
+}
+
+MeshData TessellateTeapot( int segments )
+{
+    segments = std::min( std::max( segments, 1 ), TEAPOT_MAX_SEGMENTS );
+
+    const std::vector<BezierPatch>& patches = GetTeapotPatches();
+    int columns = segments + 1;
+    size_t vertexCount = patches.size() * columns * columns;
+
+    MeshData mesh;
+    mesh.positions.resize( vertexCount );
+    mesh.normals.resize( vertexCount );
+    TessellatePatches( patches.data(), (int)patches.size(), segments, mesh.positions.data(), mesh.normals.data() );
+
+    mesh.textureCoords.resize( vertexCount );
+    for ( size_t p = 0; p < patches.size(); ++p )
+    {
+        GLuint base = (GLuint)( p * columns * columns );
+        for ( int j = 0; j <= segments; ++j )
+        {
+            for ( int i = 0; i <= segments; ++i )
+            {
+                mesh.textureCoords[base + j * columns + i] = glm::vec2( (float)i / segments, (float)j / segments );
+            }
+        }
+
+        for ( int j = 0; j < segments; ++j )
+        {
+            for ( int i = 0; i < segments; ++i )
+            {
+                GLuint i0 = base + j * columns + i;
+                GLuint i1 = i0 + columns;
+                GLuint quad[6] = { i0, i0 + 1, i1 + 1, i0, i1 + 1, i1 };
+                mesh.indices.insert( mesh.indices.end(), quad, quad + 6 );
+            }
+        }
+    }
+
+    WeldVertices( mesh );
+    GenerateTangents( mesh );
+    return mesh;
+}
+
+int BenchmarkTeapot()
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    const std::vector<BezierPatch>& patches = GetTeapotPatches();
+    const int patchCount = (int)patches.size();
+    bool matches = true;
+
+    std::cout << "Teapot tessellation (" << patchCount << " patches, " << GetWorkerCount() << " threads, "
+              << ( SIMD_SSE2 ? "SSE2" : "scalar" ) << ")" << std::endl;
+
+    const int densities[] = { 4, 8, 16, 32, 64 };
+    for ( int segments : densities )
+    {
+        int verticesPerPatch = ( segments + 1 ) * ( segments + 1 );
+        std::vector<glm::vec3> referencePositions( patchCount * verticesPerPatch ), referenceNormals( patchCount * verticesPerPatch );
+        std::vector<glm::vec3> positions( patchCount * verticesPerPatch ), normals( patchCount * verticesPerPatch );
+
+        // Enough iterations for roughly 20M vertices.
+        int iterations = std::max( 1, 20000000 / ( patchCount * verticesPerPatch ) );
+
+        Clock::time_point start = Clock::now();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            TessellatePatchesReference( patches.data(), patchCount, segments, referencePositions.data(), referenceNormals.data() );
+        }
+        double referenceSeconds = std::chrono::duration<double>( Clock::now() - start ).count();
+
+        start = Clock::now();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            TessellatePatches( patches.data(), patchCount, segments, positions.data(), normals.data() );
+        }
+        double seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+
+        int weldIterations = std::max( 1, iterations / 20 );
+        start = Clock::now();
+        size_t weldedVertices = 0;
+        for ( int i = 0; i < weldIterations; ++i )
+        {
+            weldedVertices = TessellateTeapot( segments ).positions.size();
+        }
+        double weldSeconds = std::chrono::duration<double>( Clock::now() - start ).count() / weldIterations;
+
+        float maxDifference = 0.0f;
+        for ( size_t i = 0; i < positions.size(); ++i )
+        {
+            maxDifference = std::max( maxDifference, glm::length( positions[i] - referencePositions[i] ) );
+            maxDifference = std::max( maxDifference, glm::length( normals[i] - referenceNormals[i] ) );
+        }
+        matches = matches && maxDifference < 1e-4f;
+
+        double patchesPerIteration = patchCount;
+        double verticesPerIteration = (double)patchCount * verticesPerPatch;
+        std::cout << "  " << segments << "x" << segments << ": reference "
+                  << patchesPerIteration * iterations / referenceSeconds / 1.0e6 << " Mpatches/s, "
+                  << verticesPerIteration * iterations / referenceSeconds / 1.0e6 << " Mvertices/s; tessellator "
+                  << patchesPerIteration * iterations / seconds / 1.0e6 << " Mpatches/s, "
+                  << verticesPerIteration * iterations / seconds / 1.0e6 << " Mvertices/s ("
+                  << referenceSeconds / seconds << "x); welded mesh " << weldedVertices << " vertices in "
+                  << weldSeconds * 1000.0 << " ms; max difference " << maxDifference << std::endl;
+    }
+
+    return matches ? 0 : 1;
+}
+
+const Mesh& TeapotCache::GetMesh( int segments, VertexFormat format )
+{
+    std::pair<int, int> key( segments, format );
+    auto mesh = m_Meshes.find( key );
+    if ( mesh == m_Meshes.end() )
+    {
+        MeshData data = TessellateTeapot( segments );
+        OptimizeMesh( data );
+        mesh = m_Meshes.insert( std::make_pair( key, CreateMesh( data, format ) ) ).first;
+    }
+    return mesh->second;
+}
+
+void TeapotCache::Destroy()
+{
+    for ( auto& mesh : m_Meshes )
+    {
+        DestroyMesh( mesh.second );
+    }
+    m_Meshes.clear();
+}
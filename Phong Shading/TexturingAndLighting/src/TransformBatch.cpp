@@ -0,0 +1,125 @@
+#include <TextureAndLightingPCH.h>
+#include <TransformBatch.h>
+#include <Camera.h>
+#include <UniformBlocks.h>
+#include <Simd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+
+void MultiplyMatrices( const glm::mat4& left, const void* models, size_t modelStride, size_t count, void* destination, size_t destinationStride )
+{
+    const unsigned char* source = (const unsigned char*)models;
+    unsigned char* target = (unsigned char*)destination;
+
+#if SIMD_SSE2
+    // The left matrix is loaded into registers once for the whole batch.
+    const float* pl = glm::value_ptr( left );
+    const __m128 l0 = _mm_loadu_ps( pl );
+    const __m128 l1 = _mm_loadu_ps( pl + 4 );
+    const __m128 l2 = _mm_loadu_ps( pl + 8 );
+    const __m128 l3 = _mm_loadu_ps( pl + 12 );
+    for ( size_t i = 0; i < count; ++i )
+    {
+        const float* model = (const float*)( source + i * modelStride );
+        float* result = (float*)( target + i * destinationStride );
+        for ( int column = 0; column < 4; ++column )
+        {
+            const float* c = model + column * 4;
+            __m128 r = _mm_mul_ps( l0, _mm_set1_ps( c[0] ) );
+            r = _mm_add_ps( r, _mm_mul_ps( l1, _mm_set1_ps( c[1] ) ) );
+            r = _mm_add_ps( r, _mm_mul_ps( l2, _mm_set1_ps( c[2] ) ) );
+            r = _mm_add_ps( r, _mm_mul_ps( l3, _mm_set1_ps( c[3] ) ) );
+            _mm_storeu_ps( result + column * 4, r );
+        }
+    }
+#else
+    for ( size_t i = 0; i < count; ++i )
+    {
+        glm::mat4 model;
+        memcpy( &model, source + i * modelStride, sizeof(glm::mat4) );
+        glm::mat4 product = left * model;
+        memcpy( target + i * destinationStride, &product, sizeof(glm::mat4) );
+    }
+#endif
+}
+
+int BenchmarkTransformBatch( size_t count )
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    const float _2pi = 2.0f * 3.1415926535897932384626433832795f;
+
+    Camera camera;
+    camera.SetProjectionRH( 30.0f, 16.0f / 9.0f, 0.1f, 200.0f );
+    camera.SetPosition( glm::vec3( 0, 10, 60 ) );
+    camera.SetEulerAngles( glm::vec3( -0.2f, 0.3f, 0.0f ) );
+
+    std::mt19937 random( 1 );
+    std::uniform_real_distribution<float> unit( 0.0f, 1.0f );
+    std::vector<glm::mat4> models( count );
+    for ( glm::mat4& model : models )
+    {
+        glm::vec3 position( 100.0f * unit( random ) - 50.0f, 10.0f * unit( random ), 100.0f * unit( random ) - 50.0f );
+        model = glm::translate( position ) * glm::rotate( _2pi * unit( random ), glm::vec3( 0, 1, 0 ) ) * glm::scale( glm::vec3( 0.1f + unit( random ) ) );
+    }
+
+    std::cout << "Model-view-projection (" << count << " objects, "
+              << ( SIMD_SSE2 ? "SSE2" : "glm::mat4" ) << ")" << std::endl;
+
+    // Enough iterations for roughly 20M matrices.
+    int iterations = (int)std::max<size_t>( 1, 20000000 / std::max<size_t>( count, 1 ) );
+    std::vector<ObjectUniforms> reference( count ), cached( count ), batch( count );
+
+    // What DisplayGL used to do for every object.
+    Clock::time_point start = Clock::now();
+    for ( int iteration = 0; iteration < iterations; ++iteration )
+    {
+        for ( size_t i = 0; i < count; ++i )
+        {
+            reference[i].modelViewProjection = camera.GetProjectionMatrix() * camera.GetViewMatrix() * models[i];
+        }
+    }
+    double referenceSeconds = std::chrono::duration<double>( Clock::now() - start ).count();
+
+    start = Clock::now();
+    for ( int iteration = 0; iteration < iterations; ++iteration )
+    {
+        const glm::mat4& viewProjection = camera.GetViewProjectionMatrix();
+        for ( size_t i = 0; i < count; ++i )
+        {
+            cached[i].modelViewProjection = viewProjection * models[i];
+        }
+    }
+    double cachedSeconds = std::chrono::duration<double>( Clock::now() - start ).count();
+
+    // Written straight into the object blocks, as they would be in the ring.
+    start = Clock::now();
+    for ( int iteration = 0; iteration < iterations; ++iteration )
+    {
+        MultiplyMatrices( camera.GetViewProjectionMatrix(), models.data(), sizeof(glm::mat4), count,
+                          &batch[0].modelViewProjection, sizeof(ObjectUniforms) );
+    }
+    double batchSeconds = std::chrono::duration<double>( Clock::now() - start ).count();
+
+    // The association differs from ( P * V ) * M, so allow for rounding.
+    float maxDifference = 0.0f;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        for ( int column = 0; column < 4; ++column )
+        {
+            glm::vec4 expected = reference[i].modelViewProjection[column];
+            float magnitude = std::max( 1.0f, glm::length( expected ) );
+            maxDifference = std::max( maxDifference, glm::length( batch[i].modelViewProjection[column] - expected ) / magnitude );
+            maxDifference = std::max( maxDifference, glm::length( cached[i].modelViewProjection[column] - expected ) / magnitude );
+        }
+    }
+
+    double matrices = (double)count * iterations;
+    std::cout << "  per object P * V * M: " << matrices / referenceSeconds / 1.0e6 << " M/s" << std::endl
+              << "  cached VP * M: " << matrices / cachedSeconds / 1.0e6 << " M/s (" << referenceSeconds / cachedSeconds << "x)" << std::endl
+              << "  batch: " << matrices / batchSeconds / 1.0e6 << " M/s (" << referenceSeconds / batchSeconds << "x); max difference " << maxDifference << std::endl;
+
+    return maxDifference < 1e-5f ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+#include <TextureAndLightingPCH.h>
+#include <UniformRing.h>
+#include <StateCache.h>
+
+#include <chrono>
+#include <cstring>
+
+UniformRing::UniformRing()
+    : m_Buffer( 0 )
+    , m_Mapped( NULL )
+    , m_RegionSize( 0 )
+    , m_Alignment( 256 )
+    , m_Frame( 0 )
+    , m_Offset( 0 )
+    , m_Statistics()
+{
+    for ( GLsync& fence : m_Fences )
+    {
+        fence = 0;
+    }
+}
+
+void UniformRing::Create( size_t regionSize )
+{
+    Destroy();
+
+    GLint alignment = 0;
+    glGetIntegerv( GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment );
+    m_Alignment = std::max( alignment, 16 );
+    m_RegionSize = ( regionSize + m_Alignment - 1 ) / m_Alignment * m_Alignment;
+
+    GLsizeiptr size = (GLsizeiptr)( m_RegionSize * UNIFORM_RING_FRAMES );
+
+    glGenBuffers( 1, &m_Buffer );
+    GetStateCache().BindBuffer( GL_UNIFORM_BUFFER, m_Buffer );
+    if ( GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage )
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage( GL_UNIFORM_BUFFER, size, NULL, flags );
+        m_Mapped = (unsigned char*)glMapBufferRange( GL_UNIFORM_BUFFER, 0, size, flags );
+    }
+    if ( m_Mapped == NULL )
+    {
+        glBufferData( GL_UNIFORM_BUFFER, size, NULL, GL_STREAM_DRAW );
+    }
+    GetStateCache().BindBuffer( GL_UNIFORM_BUFFER, 0 );
+
+    m_Frame = 0;
+    m_Offset = 0;
+}
+
+void UniformRing::Destroy()
+{
+    for ( GLsync& fence : m_Fences )
+    {
+        if ( fence != 0 )
+        {
+            glDeleteSync( fence );
+            fence = 0;
+        }
+    }
+
+    if ( m_Buffer != 0 )
+    {
+        if ( m_Mapped != NULL )
+        {
+            GetStateCache().BindBuffer( GL_UNIFORM_BUFFER, m_Buffer );
+            glUnmapBuffer( GL_UNIFORM_BUFFER );
+            GetStateCache().BindBuffer( GL_UNIFORM_BUFFER, 0 );
+        }
+        GetStateCache().ForgetBuffer( m_Buffer );
+        glDeleteBuffers( 1, &m_Buffer );
+    }
+
+    m_Buffer = 0;
+    m_Mapped = NULL;
+    m_RegionSize = 0;
+}
+
+bool UniformRing::IsCreated() const
+{
+    return m_Buffer != 0;
+}
+
+bool UniformRing::IsPersistent() const
+{
+    return m_Mapped != NULL;
+}
+
+void UniformRing::BeginFrame()
+{
+    m_Statistics = UniformRingStatistics();
+    m_Offset = 0;
+
+    GLsync& fence = m_Fences[m_Frame];
+    if ( fence == 0 )
+    {
+        return;
+    }
+
+    // Normally the GPU is at least a frame ahead of this region and the
+    // first check returns at once.
+    auto start = std::chrono::steady_clock::now();
+    GLbitfield flags = 0;
+    for ( ;; )
+    {
+        GLenum result = glClientWaitSync( fence, flags, 1000000 );
+        if ( result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED )
+        {
+            break;
+        }
+        flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    }
+    m_Statistics.fenceWaitMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+
+    glDeleteSync( fence );
+    fence = 0;
+}
+
+void UniformRing::EndFrame()
+{
+    if ( m_Buffer == 0 )
+    {
+        return;
+    }
+
+    m_Fences[m_Frame] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+    m_Frame = ( m_Frame + 1 ) % UNIFORM_RING_FRAMES;
+}
+
+bool UniformRing::Bind( GLuint binding, const void* data, size_t size )
+{
+    if ( m_Offset + size > m_RegionSize )
+    {
+        ++m_Statistics.overflows;
+        return false;
+    }
+
+    size_t offset = m_Frame * m_RegionSize + m_Offset;
+    if ( m_Mapped != NULL )
+    {
+        memcpy( m_Mapped + offset, data, size );
+    }
+    else
+    {
+        GetStateCache().BindBuffer( GL_UNIFORM_BUFFER, m_Buffer );
+        glBufferSubData( GL_UNIFORM_BUFFER, (GLintptr)offset, (GLsizeiptr)size, data );
+    }
+    GetStateCache().BindBufferRange( GL_UNIFORM_BUFFER, binding, m_Buffer, (GLintptr)offset, (GLsizeiptr)size );
+
+    m_Offset += ( size + m_Alignment - 1 ) / m_Alignment * m_Alignment;
+    ++m_Statistics.blocks;
+    m_Statistics.bytes = m_Offset;
+    return true;
+}
+
+const UniformRingStatistics& UniformRing::GetStatistics() const
+{
+    return m_Statistics;
+}
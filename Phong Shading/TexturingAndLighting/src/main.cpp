@@ -1,21 +1,38 @@
 ﻿#include <TextureAndLightingPCH.h>
 #include <math.h>
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <random>
 
 #include <Camera.h>
+#include <LutBaker.h>
+#include <BlobCache.h>
+#include <LutBuilder.h>
+#include <Material.h>
+#include <Mesh.h>
+#include <MeshOptimizer.h>
+#include <SphereLod.h>
+#include <ShapeLibrary.h>
+#include <Teapot.h>
+#include <ProgramReflection.h>
+#include <UniformBlocks.h>
+#include <UniformRing.h>
+#include <StateCache.h>
+#include <Instancing.h>
+#include <RenderQueue.h>
+#include <SceneGraph.h>
+#include <TransformBatch.h>
+#include <FixedTimestep.h>
+#include <FramePipeline.h>
+#include <ShaderPermutations.h>
+#include <ProgramCache.h>
+#include <ProgramCompiler.h>
+#include <ShaderPreprocessor.h>
+#include <Parallel.h>
 
 
-#define POSITION_ATTRIBUTE 0
-#define NORMAL_ATTRIBUTE 2
-#define DIFFUSE_ATTRIBUTE 3
-#define SPECULAR_ATTRIBUTE 4
-#define TEXCOORD0_ATTRIBUTE 8
-#define TEXCOORD1_ATTRIBUTE 9
-#define TEXCOORD2_ATTRIBUTE 10
-
-#define BUFFER_OFFSET(offset) ((void*)(offset))
-#define MEMBER_OFFSET(s,m) ((char*)NULL + (offsetof(s,m)))
-
 // the size will be changed after reshape()
 int g_iWindowWidth = 1280;
 int g_iWindowHeight = 720;
@@ -33,54 +50,247 @@ float g_fSunRotation = 0.0f;
 float g_fEarthRotation = 0.0f;
 float g_fMoonRotation = 0.0f;
 
-std::clock_t g_PreviousTicks;
-std::clock_t g_CurrentTicks;
+// The sun and the moon orbit through pivot nodes; see CreateSceneGraph().
+SceneGraph g_Scene;
+SceneNode g_SunOrbitNode = SCENE_NODE_NONE;
+SceneNode g_SunNode = SCENE_NODE_NONE;
+SceneNode g_EarthNode = SCENE_NODE_NONE;
+SceneNode g_MoonOrbitNode = SCENE_NODE_NONE;
+SceneNode g_MoonNode = SCENE_NODE_NONE;
+
+// Scale of the Earth's node: its diameter in thousands of kilometres.
+const float EARTH_SCALE = 12.756f;
+
+// Everything the build stage animates. It is simulated at a fixed rate and
+// the last two states are interpolated for rendering.
+struct SceneState
+{
+    glm::vec3 cameraPosition;
+    float sunRotation;
+    float earthRotation;
+    float moonRotation;
+};
+
+// What a step reads besides the state: the movement keys and the camera's
+// orientation, which the mouse changes directly.
+struct SimulationInput
+{
+    glm::vec3 move;
+    bool fast;
+    glm::quat cameraRotation;
+};
+
+const FixedTimestep::Duration SIMULATION_STEP( 1000000000 / 120 );
+const int MAX_SIMULATION_STEPS_PER_FRAME = 8;
+FixedTimestep g_SimulationClock( SIMULATION_STEP, MAX_SIMULATION_STEPS_PER_FRAME );
+SimulationStates<SceneState> g_SceneStates;
 
 Camera g_Camera;
 glm::vec3 g_InitialCameraPosition;
 glm::quat g_InitialCameraRotation;
 
-GLuint g_vaoSphere = 0;
-GLuint g_TexturedDiffuseShaderProgram = 0;
+VertexFormat g_VertexFormat = VERTEX_FORMAT_PACKED;
+
+// Sphere levels of detail and the level each object used last frame. The
+// levels and g_DrawRanges belong to the build stage.
+SphereLodChain g_SphereLod;
+enum SphereObject { SPHERE_SUN, SPHERE_EARTH, SPHERE_MOON, SPHERE_OBJECT_COUNT };
+int g_SphereLodLevels[SPHERE_OBJECT_COUNT] = {};
+float g_LodPixelError = 0.5f;
+const float LOD_HYSTERESIS = 0.25f;
+
+// Cull sphere meshlets against the frustum and by normal cone before drawing.
+bool g_MeshletCulling = true;
+DrawRanges g_DrawRanges;
+
+// Debug overlay drawn with the retained freeglut shapes.
+ShapeLibrary g_Shapes;
+bool g_ShowGizmos = false;
+
+// Draw the tessellated teapot in place of the Earth as a shading benchmark.
+TeapotCache g_Teapots;
+bool g_DrawTeapot = false;
+
+// Asteroid belt drawn with the instanced path as a stress scene. Set the body
+// count with --instances <n>; --bench-instances measures frame times. The
+// bodies belong to the build stage.
+InstanceRenderer g_Instances;
+std::vector<InstanceBody> g_Asteroids;
+size_t g_AsteroidCount = 10000;
+bool g_DrawAsteroids = false;
+
+// Frame time of the belt at increasing body counts (--bench-instances).
+struct InstanceBenchmark
+{
+    bool running;
+    int step;               // Index into INSTANCE_BENCHMARK_COUNTS.
+    int frame;              // Frames drawn at the current count.
+    double frameMs;         // Sums over the measured frames.
+    double buildMs;
+    std::chrono::steady_clock::time_point lastFrame;
+};
+InstanceBenchmark g_InstanceBenchmark = {};
+const size_t INSTANCE_BENCHMARK_COUNTS[] = { 1000, 10000, 100000, 1000000 };
+const int INSTANCE_BENCHMARK_WARMUP_FRAMES = 10;
+const int INSTANCE_BENCHMARK_FRAMES = 100;
+
 GLuint g_SimpleShaderProgram = 0;
+GLuint g_InstancedShaderProgram = 0;
 
-// Model, View, Projection matrix uniform variable in shader program.
-GLint g_uniformMVP = -1;
-GLint g_uniformModelMatrix = -1;
-GLint g_uniformEyePosW = -1;
-
-GLint g_uniformColor = -1;
-
-// Light uniform variables.
-GLint g_uniformLightPosW = -1;
-GLint g_uniformLightColor = -1;
-GLint g_uniformAmbient = -1;
-
-// Material properties.
-GLint g_uniformMaterialEmissive = -1;
-GLint g_uniformMaterialDiffuse = -1;
-GLint g_uniformMaterialSpecular = -1;
-GLint g_uniformMaterialShininess =-1;
-GLint g_uniformShaderType = -1;
-GLint g_uniformEnableEarthNormalMap = -1;
-GLint g_uniformEnableEarthBumpMap = -1;
-std::vector<GLint> g_uniformLuts(2, -1);
-GLint g_uniformNormalMap = -1;
-GLint g_uniformBumpMap = -1;
+// Active uniforms of the two programs, reflected once after linking.
+ProgramReflection g_SimpleProgram;
+ProgramReflection g_InstancedProgram;
+
+// Variants of texturedDiffuse.vert/frag, one per combination of the switches
+// below. All of them start compiling at startup and are drawn as they become
+// ready. 'V' prints the report.
+enum TexturedFeature
+{
+    TEXTURED_SHADING_MODEL,     // SHADING_MODEL, the index into shaderTypes.
+    TEXTURED_NORMAL_MAP,        // NORMAL_MAP
+    TEXTURED_BUMP_MAP,          // BUMP_MAP
+    TEXTURED_FEATURE_COUNT
+};
+ShaderPermutations g_TexturedVariants;
+
+// Simple shader uniforms.
+const UniformName UNIFORM_MVP = InternUniformName( "MVP" );
+const UniformName UNIFORM_COLOR = InternUniformName( "color" );
+
+// Textured shader samplers. Everything else it reads comes from the uniform
+// blocks in UniformBlocks.h.
+const UniformName UNIFORM_LUT_DIFFUSE_SAMPLER = InternUniformName( "lutDiffuseSampler" );
+const UniformName UNIFORM_LUT_SPECULAR_SAMPLER = InternUniformName( "lutSpecularSampler" );
+const UniformName UNIFORM_NORMAL_MAP_SAMPLER = InternUniformName( "normalMapSampler" );
+const UniformName UNIFORM_BUMP_MAP_SAMPLER = InternUniformName( "bumpMapSampler" );
+const UniformName UNIFORM_LUT_ARRAY_SAMPLER = InternUniformName( "lutArraySampler" );
+const UniformName UNIFORM_DIFFUSE_ARRAY_SAMPLER = InternUniformName( "diffuseArraySampler" );
+
+// Frame, material and object blocks of the textured shader.
+UniformRing g_UniformRing;
+const size_t UNIFORM_RING_REGION_SIZE = 256 * 1024;
+GLuint g_OverflowUniformBuffers[UNIFORM_BLOCK_MATERIAL_TABLE + 1] = {};   // Per binding, see BindUniformBlock().
+
+// Sorted submission of the scene's draws. The gizmos and the asteroid belt
+// are drawn directly.
+RenderQueue g_RenderQueue;
+int g_SimpleQueueProgram = 0;
+std::map<ShaderKey, int> g_TexturedQueuePrograms;     // Per texturedDiffuse variant; -1 if it failed.
+int g_EarthTextureSet = 0;
+int g_EarthNormalMappedTextureSet = 0;   // With the LUTs baked for the normal map's shininess.
+int g_MoonTextureSet = 0;
+
+// What the build stage reads from the GLUT thread, copied once per frame;
+// see CaptureFrameInput().
+struct FrameInput
+{
+    Camera camera;                  // Orientation and projection. The simulation owns the position.
+    SimulationInput simulation;
+    bool reset;                     // Restart the simulation from the camera's position.
+    bool meshletCulling;
+    bool drawTeapot;
+    bool drawAsteroids;
+    size_t asteroidCount;
+    float lodPixelError;
+    int shadingModel;
+    bool normalMapped;
+    bool bumpMapped;
+};
+
+// A render queue submission recorded by the build stage.
+struct QueuedDraw
+{
+    RenderPass pass;
+    int program;                    // -1 for the texturedDiffuse variant.
+    ShaderKey variant;
+    int textureSet;
+    RenderItem item;
+    float depth;
+};
+
+// Everything the GLUT thread needs to draw a frame; see BuildFrame().
+struct FramePacket
+{
+    glm::mat4 viewProjection;
+    glm::vec3 eyePosition;
+    glm::mat4 sunMatrix;
+    std::vector<QueuedDraw> draws;
+
+    // The teapot meshes are created on demand, so the GLUT thread submits the
+    // teapot itself when teapotSegments > 0.
+    int teapotSegments;
+    glm::mat4 earthMatrix;
+    float earthDistance;
+    int earthMaterial;
+    int earthTextureSet;
+    ShaderKey earthVariant;
+
+    bool drawAsteroids;
+    InstanceBatch asteroids;
+
+    int earthLodLevel;
+    LodStatistics lodStatistics;
+    bool meshletCulling;
+    MeshletCullStatistics meshletStatistics;
+    double updateMs;                // Simulation and scene graph.
+    double cullMs;                  // Culling, LOD selection and the draw lists.
+};
+
+// Frame N+1 is built on a worker while the GLUT thread submits frame N.
+// --serial-frames builds every frame inline instead.
+FramePipeline<FrameInput, FramePacket> g_FramePipeline;
+bool g_PipelineThreaded = true;
+bool g_ResetRequested = false;
 
 GLuint g_EarthTexture = 0;
 GLuint g_EarthNormalMap = 0;
 GLuint g_EarthBumpMap = 0;
 GLuint g_MoonTexture = 0;
+GLuint g_BodyTextureArray = 0;  // Earth and moon, for the instanced bodies.
+enum BodyTextureLayer { BODY_LAYER_EARTH, BODY_LAYER_MOON, BODY_LAYER_COUNT };
 std::vector<GLuint> g_LutTextures;
+std::vector<GLuint> g_NormalMapLutTextures;   // Baked at NORMAL_MAP_SHININESS_SCALE times the shininess.
+GLuint g_LutArrayTexture = 0;
+LutArrayLayout g_LutArrayLayout;
+
+// Baked LUTs keyed by their inputs. Set with --lut-cache <dir>; an empty
+// directory disables the cache.
+BlobCache g_LutCache( "", ".lut" );
+
+// Linked program binaries keyed by their sources and the driver. Set with
+// --program-cache <dir>; an empty directory disables the cache.
+ProgramCache g_ProgramCache;
 
-std::vector<std::string> shaderTypes = { "Phong", "Blinn Phong" , "LUT Blinn Phong"};
+// Every shader source goes through the preprocessor, which expands #include
+// and keeps the files and their hashes in memory.
+ShaderPreprocessor g_ShaderPreprocessor;
+
+// Compiles and links programs without waiting on each one; polled once per
+// frame. Until a texturedDiffuse variant is ready its draws use the fallback
+// variant, which startup waits for.
+ProgramCompiler g_ProgramCompiler;
+ShaderKey g_TexturedFallbackVariant = 0;
+
+std::vector<std::string> shaderTypes = { "Phong", "Blinn Phong" , "LUT Blinn Phong", "LUT Array Blinn Phong"};
 std::string normalMapHeadline, bumpMapHeadline;
 glm::vec4 materialDiffuseEarth(1);
 glm::vec4 lightColor(1);
 glm::vec4 materialSpecularEarth(2.0f, 2.0f, 2.0f, 1.0f);
 GLfloat masterialShininessEarth = 50.0f;
 
+// texturedDiffuse.frag multiplies the shininess by this when the normal map is
+// enabled; it gets the value as a define, see main().
+const float NORMAL_MAP_SHININESS_SCALE = 30.0f;
+
+// Registered materials. Material i owns LUT array layers 2*i (plain) and
+// 2*i+1 (normal mapped), see GetLutLayer().
+enum MaterialId
+{
+    MATERIAL_EARTH,
+    MATERIAL_MOON,
+};
+std::vector<Material> g_Materials;
+
 
 void IdleGL();
 void DisplayGL();
@@ -132,8 +342,8 @@ void InitGL( int argc, char* argv[] )
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f );
     glClearDepth(1.0f);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
+    GetStateCache().Enable(GL_DEPTH_TEST);
+    GetStateCache().Enable(GL_CULL_FACE);
 
     std::cout << "Initialize OpenGL Success!" << std::endl;
 }
@@ -166,94 +376,40 @@ void InitGLEW()
 #endif
 }
 
-// Loads a shader and returns the compiled shader object.
-// If the shader source file could not be opened or compiling the 
-// shader fails, then this function returns 0.
-GLuint LoadShader( GLenum shaderType, const std::string& shaderFile )
+// Build a program from a vertex and a fragment shader file, or restore it
+// from the program cache if neither the files, their includes nor the driver
+// has changed. done receives the program, or 0 if it did not build; it runs
+// at once on a cache hit and otherwise when g_ProgramCompiler completes the
+// build.
+void LoadShaderProgram( const std::string& vertexFile, const std::string& fragmentFile, const std::function<void( GLuint program )>& done )
 {
-    std::ifstream ifs;
-
-    // Load the shader.
-    ifs.open(shaderFile);
-
-    if ( !ifs )
+    std::vector<ShaderSource> shaders( 2 );
+    std::vector<uint64_t> hashes( 2 );
+    if ( !g_ShaderPreprocessor.Preprocess( GL_VERTEX_SHADER, vertexFile, "", shaders[0], hashes[0] ) ||
+         !g_ShaderPreprocessor.Preprocess( GL_FRAGMENT_SHADER, fragmentFile, "", shaders[1], hashes[1] ) )
     {
-        std::cerr << "Can not open shader file: \"" << shaderFile << "\"" << std::endl;
-        return 0;
+        done( 0 );
+        return;
     }
+    uint64_t key = g_ProgramCache.MakeKey( hashes );
 
-    std::string source( std::istreambuf_iterator<char>(ifs), (std::istreambuf_iterator<char>()) );
-    ifs.close();
-
-    // Create a shader object.
-    GLuint shader = glCreateShader( shaderType );
-
-    // Load the shader source for each shader object.
-    const GLchar* sources[] = { source.c_str() };
-    glShaderSource( shader, 1, sources, NULL );
-
-    // Compile the shader.
-    glCompileShader( shader );
-
-    // Check for errors
-    GLint compileStatus;
-    glGetShaderiv( shader, GL_COMPILE_STATUS, &compileStatus ); 
-    if ( compileStatus != GL_TRUE )
+    GLuint program = g_ProgramCache.Load( key );
+    if ( program != 0 )
     {
-        GLint logLength;
-        glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &logLength );
-        GLchar* infoLog = new GLchar[logLength];
-        glGetShaderInfoLog( shader, logLength, NULL, infoLog );
-
-#ifdef _WIN32
-        OutputDebugString(infoLog);
-#else
-        std::cerr << infoLog << std::endl;
-#endif
-        delete infoLog;
-        return 0;
+        std::cout << "Program cache hit: " << vertexFile << " + " << fragmentFile << std::endl;
+        done( program );
+        return;
     }
 
-    return shader;
-}
-
-// Create a shader program from a set of compiled shader objects.
-GLuint CreateShaderProgram( std::vector<GLuint> shaders )
-{
-    // Create a shader program.
-    GLuint program = glCreateProgram();
-
-    // Attach the appropriate shader objects.
-    for( GLuint shader: shaders )
-    {
-        glAttachShader( program, shader );
-    }
-
-    // Link the program
-    glLinkProgram(program);
-
-    // Check the link status.
-    GLint linkStatus;
-    glGetProgramiv(program, GL_LINK_STATUS, &linkStatus );
-    if ( linkStatus != GL_TRUE )
+    g_ProgramCompiler.Submit( shaders, [vertexFile, fragmentFile, key, done]( const ProgramBuild& build )
     {
-        GLint logLength;
-        glGetProgramiv( program, GL_INFO_LOG_LENGTH, &logLength );
-        GLchar* infoLog = new GLchar[logLength];
-
-        glGetProgramInfoLog( program, logLength, NULL, infoLog );
-
-#ifdef _WIN32
-        OutputDebugString(infoLog);
-#else
-        std::cerr << infoLog << std::endl;
-#endif
-
-        delete infoLog;
-        return 0;
-    }
-
-    return program;
+        if ( build.program != 0 && g_ProgramCache.IsEnabled() )
+        {
+            std::cout << "Program cache miss: " << vertexFile << " + " << fragmentFile << std::endl;
+            g_ProgramCache.Store( key, build.program, build.buildMs );
+        }
+        done( build.program );
+    } );
 }
 
 GLuint LoadTexture( const std::string& file )
@@ -268,6 +424,68 @@ GLuint LoadTexture( const std::string& file )
     return textureID;
 }
 
+// Bilinear resampling of an RGBA8 image.
+void ResampleImage( const unsigned char* source, int sourceWidth, int sourceHeight, unsigned char* destination, int width, int height )
+{
+    for ( int y = 0; y < height; ++y )
+    {
+        float sy = std::max( ( y + 0.5f ) * sourceHeight / height - 0.5f, 0.0f );
+        int y0 = std::min( (int)sy, sourceHeight - 1 );
+        int y1 = std::min( y0 + 1, sourceHeight - 1 );
+        float fy = sy - y0;
+        for ( int x = 0; x < width; ++x )
+        {
+            float sx = std::max( ( x + 0.5f ) * sourceWidth / width - 0.5f, 0.0f );
+            int x0 = std::min( (int)sx, sourceWidth - 1 );
+            int x1 = std::min( x0 + 1, sourceWidth - 1 );
+            float fx = sx - x0;
+            for ( int c = 0; c < 4; ++c )
+            {
+                float top = glm::mix( (float)source[( y0 * sourceWidth + x0 ) * 4 + c], (float)source[( y0 * sourceWidth + x1 ) * 4 + c], fx );
+                float bottom = glm::mix( (float)source[( y1 * sourceWidth + x0 ) * 4 + c], (float)source[( y1 * sourceWidth + x1 ) * 4 + c], fx );
+                destination[( y * width + x ) * 4 + c] = (unsigned char)( glm::mix( top, bottom, fy ) + 0.5f );
+            }
+        }
+    }
+}
+
+// Loads images into the layers of a 2D texture array, resampled to a common
+// size. Layers whose image cannot be loaded are left white.
+GLuint LoadTextureArray( const std::vector<std::string>& files, int width, int height )
+{
+    GLuint texture = 0;
+    glGenTextures( 1, &texture );
+    glBindTexture( GL_TEXTURE_2D_ARRAY, texture );
+    glTexImage3D( GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, (GLsizei)files.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+
+    std::vector<unsigned char> layer( width * height * 4 );
+    for ( size_t i = 0; i < files.size(); ++i )
+    {
+        int imageWidth = 0, imageHeight = 0, channels = 0;
+        unsigned char* image = SOIL_load_image( files[i].c_str(), &imageWidth, &imageHeight, &channels, SOIL_LOAD_RGBA );
+        if ( image == NULL )
+        {
+            std::cerr << "Can not load texture array layer: \"" << files[i] << "\"" << std::endl;
+            std::fill( layer.begin(), layer.end(), 255 );
+        }
+        else
+        {
+            ResampleImage( image, imageWidth, imageHeight, layer.data(), width, height );
+            SOIL_free_image_data( image );
+        }
+        glTexSubImage3D( GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)i, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, layer.data() );
+    }
+
+    glGenerateMipmap( GL_TEXTURE_2D_ARRAY );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+    glBindTexture( GL_TEXTURE_2D_ARRAY, 0 );
+
+    return texture;
+}
+
 std::vector<GLuint> LoadLookupTable(int width, int height,
 					   GLfloat specShineness,
 					   const glm::vec4& lightColor,
@@ -275,58 +493,60 @@ std::vector<GLuint> LoadLookupTable(int width, int height,
 					   const glm::vec4& materialSpecularEarth)
 {
 	std::vector<GLuint> lutTextures(2);
-	std::vector<GLubyte> dataDiffuse(width * height * 4);
-	std::vector<GLubyte> dataSpecular(width * 1 * 4);
-	GLuint uniformLut = 0;
-	
-	for (int y = 0, idx = 0; y < height; ++y) {
-		for (int x = 0; x < width; ++x, idx += 4) {
-			float vx = x / float(width);
-			float vy = y / float(height);
-			float nl = vx;
-			float nh = vy;
-			float spec = powf(nh, specShineness);
-			glm::vec4 resultDiffuse = nl*lightColor*materialDiffuseEarth*255.0f;
-			dataDiffuse[idx + 0] = round(std::min(255.0f, resultDiffuse.r));
-			dataDiffuse[idx + 1] = round(std::min(255.0f, resultDiffuse.g));
-			dataDiffuse[idx + 2] = round(std::min(255.0f, resultDiffuse.b));
-			dataDiffuse[idx + 3] = round(std::min(255.0f, spec*255.0f));
-		}
+	GLsizeiptr diffuseSize = width * height * 4;
+	GLsizeiptr specularSize = width * 1 * 4;
+
+	uint64_t key = GetLookupTableKey(width, height, specShineness, lightColor, materialDiffuseEarth, materialSpecularEarth);
+	MappedFile cachedTables;
+	BlobCache::Writer cacheWriter;
+	GLuint pbo = 0;
+	std::vector<GLubyte> clientPixels;
+	const GLubyte* diffusePixels = NULL;
+	const GLubyte* specularPixels = NULL;
+
+	if (g_LutCache.Load(key, cachedTables) && BlobCache::GetPayloadSize(cachedTables) == size_t(diffuseSize + specularSize)) {
+		// Cache hit: upload the mapped blob as-is.
+		diffusePixels = static_cast<const GLubyte*>(BlobCache::GetPayload(cachedTables));
+		specularPixels = diffusePixels + diffuseSize;
+		std::cout << "LUT cache hit: " << g_LutCache.GetDirectory() << std::endl;
 	}
-
-	for (int x = 0, idx = 0; x < width; ++x, idx += 4) {
-		float vx = x / float(width);
-		float spec = powf(vx, specShineness);
-		glm::vec4 resultSpecular = spec*lightColor*materialSpecularEarth*255.0f;
-		dataSpecular[idx + 0] = round(std::min(255.0f, resultSpecular.r));
-		dataSpecular[idx + 1] = round(std::min(255.0f, resultSpecular.g));
-		dataSpecular[idx + 2] = round(std::min(255.0f, resultSpecular.b));
-		dataSpecular[idx + 3] = round(std::min(255.0f, resultSpecular.a));
+	else if (g_LutCache.BeginStore(key, diffuseSize + specularSize, cacheWriter)) {
+		// Cache miss: bake into the mapped blob, upload from it and publish it afterwards.
+		GLubyte* data = static_cast<GLubyte*>(cacheWriter.GetPayload());
+		BakeLookupTable(width, height, specShineness, lightColor, materialDiffuseEarth, materialSpecularEarth,
+						data, data + diffuseSize);
+		diffusePixels = data;
+		specularPixels = data + diffuseSize;
+		std::cout << "LUT cache miss: " << g_LutCache.GetDirectory() << std::endl;
 	}
-
-	auto normalize = [=](std::vector<GLfloat>& data) {
-		for (int channel = 0; channel < 3; channel++) {
-			GLfloat max = data[channel], min = data[channel];
-			int idx = 0;
-			for (int y = 0; y < height; ++y) {
-				for (int x = 0; x < width; ++x, idx += 4) {
-					if (max < data[idx + channel]) {
-						max = data[idx + channel];
-					}
-					if (min > data[idx + channel]) {
-						min = data[idx + channel];
-					}
-				}
-			}
-			GLfloat interval = max - min;
-			idx = 0;
-			for (int y = 0; y < height; ++y) {
-				for (int x = 0; x < width; ++x, idx += 4) {
-					data[idx + channel] = (data[idx + channel] - min) / interval * 255.0f;
-				}
-			}
+	else {
+		// No cache: bake straight into a pixel unpack buffer so the tables are not
+		// staged through an intermediate copy before the upload.
+		glGenBuffers(1, &pbo);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, diffuseSize + specularSize, NULL, GL_STREAM_DRAW);
+		GLubyte* data = static_cast<GLubyte*>(glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY));
+		if (data) {
+			BakeLookupTable(width, height, specShineness, lightColor, materialDiffuseEarth, materialSpecularEarth,
+							data, data + diffuseSize);
 		}
-	};
+		// glUnmapBuffer fails if the buffer's contents were lost meanwhile.
+		if (data && glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE) {
+			diffusePixels = static_cast<const GLubyte*>(BUFFER_OFFSET(0));
+			specularPixels = static_cast<const GLubyte*>(BUFFER_OFFSET(diffuseSize));
+		}
+		else {
+			// The buffer could not be mapped or was lost: bake in client memory.
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glDeleteBuffers(1, &pbo);
+			pbo = 0;
+			clientPixels.resize(diffuseSize + specularSize);
+			BakeLookupTable(width, height, specShineness, lightColor, materialDiffuseEarth, materialSpecularEarth,
+							clientPixels.data(), clientPixels.data() + diffuseSize);
+			diffusePixels = clientPixels.data();
+			specularPixels = clientPixels.data() + diffuseSize;
+		}
+	}
 
 	glGenTextures(2, &lutTextures[0]);
 	glBindTexture(GL_TEXTURE_2D, lutTextures[0]);
@@ -334,167 +554,580 @@ std::vector<GLuint> LoadLookupTable(int width, int height,
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &dataDiffuse[0]);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, diffusePixels);
 
 	glBindTexture(GL_TEXTURE_2D, lutTextures[1]);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &dataSpecular[0]);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, specularPixels);
 	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (pbo) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glDeleteBuffers(1, &pbo);
+	}
+	cacheWriter.Commit();
 	return lutTextures;
 }
 
-GLuint SolidSphere( float radius, int slices, int stacks )
+// Register a material and return its id.
+int RegisterMaterial( const glm::vec4& emissive, const glm::vec4& diffuse, const glm::vec4& specular, float shininess )
 {
-    using namespace glm;
-    using namespace std;
+	Material material = { emissive, diffuse, specular, shininess };
+	g_Materials.push_back(material);
+	return (int)g_Materials.size() - 1;
+}
 
-    const float pi = 3.1415926535897932384626433832795f;
-    const float _2pi = 2.0f * pi;
+// Advance the scene by one fixed step of dt seconds.
+void StepScene( SceneState& state, const SimulationInput& input, float dt )
+{
+    float speed = 1.0f;
 
-    vector<vec3> positions;
-    vector<vec3> normals;
-    vector<vec2> textureCoords;
+    if ( input.fast )
+    {
+		speed = 2.0f;
+    }
+
+    state.cameraPosition += input.cameraRotation * input.move * speed * dt;
+
+    // Rate of rotation in (degrees) per second
+    const float fRotationRate1 = 30.0f*speed;
+    const float fRotationRate2 = 12.5f;
+    const float fRotationRate3 = 90.0f;
+
+    state.earthRotation += fRotationRate1 * dt;
+    state.earthRotation = fmod(state.earthRotation, 360.0f);
+
+    state.moonRotation = fRotationRate2;
+    //state.moonRotation = fmod(state.moonRotation, 360.0f);
+
+    state.sunRotation = fRotationRate3;
+    //state.sunRotation = fmod(state.sunRotation, 360.0f);
+}
+
+// Interpolate an angle in degrees the short way round, so a wrap from 359
+// to 0 does not spin back through the whole circle.
+float InterpolateAngle( float from, float to, float alpha )
+{
+    float delta = fmod( to - from + 540.0f, 360.0f ) - 180.0f;
+    return from + delta * alpha;
+}
+
+SceneState InterpolateScene( const SceneState& previous, const SceneState& current, float alpha )
+{
+    SceneState state;
+    state.cameraPosition = glm::mix( previous.cameraPosition, current.cameraPosition, alpha );
+    state.sunRotation = InterpolateAngle( previous.sunRotation, current.sunRotation, alpha );
+    state.earthRotation = InterpolateAngle( previous.earthRotation, current.earthRotation, alpha );
+    state.moonRotation = InterpolateAngle( previous.moonRotation, current.moonRotation, alpha );
+    return state;
+}
+
+void ApplySceneState( const SceneState& state, Camera& camera )
+{
+    camera.SetPosition( state.cameraPosition );
+    g_fSunRotation = state.sunRotation;
+    g_fEarthRotation = state.earthRotation;
+    g_fMoonRotation = state.moonRotation;
+}
 
-    for( int i = 0; i <= stacks; ++i )
+// Restart the simulation from cameraPosition with the bodies at rest.
+void ResetSimulation( const glm::vec3& cameraPosition )
+{
+    SceneState state = {};
+    state.cameraPosition = cameraPosition;
+    g_SceneStates.Reset( state );
+    g_SimulationClock.Reset();
+}
+
+// Simulate the given time at several frame rates, with no window and a
+// scripted input, and check that every run ends in the same state. Returns 0
+// if they all agree.
+int RunHeadlessSimulation( double seconds )
+{
+    const FixedTimestep::Duration total( (int64_t)( seconds * 1.0e9 ) );
+
+    SimulationInput input;
+    input.move = glm::vec3( 0.5f, 0.0f, -1.0f );
+    input.fast = false;
+    input.cameraRotation = glm::angleAxis( 0.3f, glm::vec3( 0, 1, 0 ) );
+
+    std::cout << "Headless simulation: " << seconds << " s at " << 1.0f / g_SimulationClock.GetStepSeconds() << " Hz" << std::endl;
+
+    // Frame lengths in ns; 0 means random lengths between 1 and 50 ms.
+    const int64_t frameLengths[] = { 1000000000 / 30, 1000000000 / 60, 1000000000 / 144, 0 };
+    SceneState first = {};
+    bool matches = true;
+    for ( size_t run = 0; run < sizeof(frameLengths) / sizeof(frameLengths[0]); ++run )
     {
-        // V texture coordinate.
-        float V = i / (float)stacks;
-        float phi = V * pi;
+        FixedTimestep clock( SIMULATION_STEP, MAX_SIMULATION_STEPS_PER_FRAME );
+        SimulationStates<SceneState> states;
+        SceneState initial = {};
+        initial.cameraPosition = glm::vec3( 0, 0, 60 );
+        states.Reset( initial );
 
-        for ( int j = 0; j <= slices; ++j )
-        {
-            // U texture coordinate.
-            float U = j / (float)slices;
-            float theta = U * _2pi;
+        std::mt19937 random( 1 );
+        std::uniform_int_distribution<int64_t> randomLength( 1000000, 50000000 );
 
-            float X = cos(theta) * sin(phi);
-            float Y = cos(phi);
-            float Z = sin(theta) * sin(phi);
+        size_t frames = 0;
+        for ( FixedTimestep::Duration remaining = total; remaining.count() > 0; ++frames )
+        {
+            FixedTimestep::Duration frame( frameLengths[run] > 0 ? frameLengths[run] : randomLength( random ) );
+            frame = std::min( frame, remaining );
+            remaining -= frame;
+
+            int steps = clock.Advance( frame );
+            for ( int i = 0; i < steps; ++i )
+            {
+                states.Step( [&]( SceneState& state ) { StepScene( state, input, clock.GetStepSeconds() ); } );
+            }
+        }
 
-            positions.push_back( vec3( X, Y, Z) * radius );
-            normals.push_back( vec3(X, Y, Z) );
-            textureCoords.push_back( vec2(U, V) );
+        const SceneState& state = states.GetCurrent();
+        if ( run == 0 )
+        {
+            first = state;
         }
+        bool same = memcmp( &state, &first, sizeof(SceneState) ) == 0 && clock.GetDroppedSteps() == 0;
+        matches = matches && same;
+
+        std::cout << "  " << ( frameLengths[run] > 0 ? std::to_string( 1000000000 / frameLengths[run] ) + " fps" : std::string( "jittered" ) )
+                  << ": " << frames << " frames, " << clock.GetStepCount() << " steps, camera ("
+                  << state.cameraPosition.x << ", " << state.cameraPosition.y << ", " << state.cameraPosition.z << "), earth "
+                  << state.earthRotation << " deg" << ( same ? "" : ", DIFFERS" ) << std::endl;
     }
+    return matches ? 0 : 1;
+}
 
-    // Now generate the index buffer
-    vector<GLuint> indicies;
+int GetLutLayer( int materialId, bool normalMapped )
+{
+	return materialId * 2 + (normalMapped ? 1 : 0);
+}
 
-    for( int i = 0; i < slices * stacks + slices; ++i )
-    {
-        indicies.push_back( i );
-        indicies.push_back( i + slices + 1  );
-        indicies.push_back( i + slices );
+// The material block for a registered material.
+MaterialUniforms GetMaterialUniforms( int materialId, bool normalMapped )
+{
+	const Material& material = g_Materials[materialId];
+	int lutLayer = GetLutLayer(materialId, normalMapped);
+
+	MaterialUniforms block = {};
+	block.emissive = material.emissive;
+	block.diffuse = material.diffuse;
+	block.specular = material.specular;
+	block.shininess = material.shininess;
+	block.lutLayer = lutLayer;
+	block.lutWarpExponent = g_LutArrayLayout.warpExponents[lutLayer];
+	return block;
+}
 
-        indicies.push_back( i + slices + 1  );
-        indicies.push_back( i );
-        indicies.push_back( i + 1 );
-    }
+// Bind a uniform block from the ring. Once this frame's region is full the
+// block is uploaded into a buffer of its own with glBufferSubData instead, so
+// the draw still sees its values at the cost of a synchronized upload.
+void BindUniformBlock( GLuint binding, const void* data, size_t size )
+{
+	if ( g_UniformRing.Bind( binding, data, size ) )
+	{
+		return;
+	}
 
-    GLuint vao;
-    glGenVertexArrays( 1, &vao );
-    glBindVertexArray( vao );
+	static bool reported = false;
+	if ( !reported )
+	{
+		std::cerr << "Uniform ring region full (" << UNIFORM_RING_REGION_SIZE << " bytes), falling back to glBufferSubData." << std::endl;
+		reported = true;
+	}
 
-    GLuint vbos[4];
-    glGenBuffers( 4, vbos );
+	StateCache& state = GetStateCache();
+	GLuint& buffer = g_OverflowUniformBuffers[binding];
+	if ( buffer == 0 )
+	{
+		glGenBuffers( 1, &buffer );
+	}
+	state.BindBuffer( GL_UNIFORM_BUFFER, buffer );
+	glBufferData( GL_UNIFORM_BUFFER, (GLsizeiptr)size, NULL, GL_STREAM_DRAW );
+	glBufferSubData( GL_UNIFORM_BUFFER, 0, (GLsizeiptr)size, data );
+	state.BindBufferRange( GL_UNIFORM_BUFFER, binding, buffer, 0, (GLsizeiptr)size );
+}
 
-    glBindBuffer( GL_ARRAY_BUFFER, vbos[0] );
-    glBufferData( GL_ARRAY_BUFFER, positions.size() * sizeof(vec3), positions.data(), GL_STATIC_DRAW );
-    glVertexAttribPointer( POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0) );
-    glEnableVertexAttribArray( POSITION_ATTRIBUTE );
+template<typename Block>
+void BindUniformBlock( GLuint binding, const Block& block )
+{
+	BindUniformBlock( binding, &block, sizeof(Block) );
+}
 
-    glBindBuffer( GL_ARRAY_BUFFER, vbos[1] );
-    glBufferData( GL_ARRAY_BUFFER, normals.size() * sizeof(vec3), normals.data(), GL_STATIC_DRAW );
-    glVertexAttribPointer( NORMAL_ATTRIBUTE, 3, GL_FLOAT, GL_TRUE, 0, BUFFER_OFFSET(0) );
-    glEnableVertexAttribArray( NORMAL_ATTRIBUTE );
+// Bind the object block for a draw with the textured shader.
+void BindObjectUniforms( const glm::mat4& modelMatrix, const glm::mat4& modelViewProjection )
+{
+	ObjectUniforms block;
+	block.modelViewProjection = modelViewProjection;
+	block.model = modelMatrix;
+	BindUniformBlock( UNIFORM_BLOCK_OBJECT, block );
+}
 
-    glBindBuffer( GL_ARRAY_BUFFER, vbos[2] );
-    glBufferData( GL_ARRAY_BUFFER, textureCoords.size() * sizeof(vec2), textureCoords.data(), GL_STATIC_DRAW );
-    glVertexAttribPointer( TEXCOORD0_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0) );
-    glEnableVertexAttribArray( TEXCOORD0_ATTRIBUTE );
+// The sun and the moon orbit the origin; the Earth spins in place.
+void CreateSceneGraph()
+{
+	g_SunOrbitNode = g_Scene.CreateNode( SCENE_NODE_NONE );
+	g_SunNode = g_Scene.CreateNode( g_SunOrbitNode, glm::vec3(90, 0, -50) );
+	g_EarthNode = g_Scene.CreateNode( SCENE_NODE_NONE, glm::vec3(0), glm::quat(), EARTH_SCALE );
+	g_MoonOrbitNode = g_Scene.CreateNode( SCENE_NODE_NONE );
+	g_MoonNode = g_Scene.CreateNode( g_MoonOrbitNode, glm::vec3(60, 0, 0), glm::quat(), 3.476f );
+}
 
-    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, vbos[3] );
-    glBufferData( GL_ELEMENT_ARRAY_BUFFER, indicies.size() * sizeof(GLuint), indicies.data(), GL_STATIC_DRAW );
+// Copy the animated angles into the scene graph and update it.
+void UpdateSceneGraph()
+{
+	g_Scene.SetRotation( g_SunOrbitNode, glm::angleAxis( glm::radians(g_fSunRotation), glm::vec3(0,-1,0) ) );
+	g_Scene.SetRotation( g_EarthNode, glm::angleAxis( glm::radians(g_fEarthRotation), glm::vec3(0,1,0) ) );
+	g_Scene.SetRotation( g_MoonOrbitNode, glm::angleAxis( glm::radians(g_fSunRotation), glm::vec3(0,1,0) ) );
+	g_Scene.Update();
+}
 
-    glBindVertexArray( 0 );
-    glBindBuffer( GL_ARRAY_BUFFER, 0 );
-    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+// Tell the render queue how to drive the simple program, and which textures
+// the Earth and the moon use. The textured variants are registered as they
+// are needed, see GetTexturedQueueProgram().
+void RegisterQueuePrograms()
+{
+	ProgramBinding simple = {};
+	simple.program = g_SimpleShaderProgram;
+	simple.setObject = []( const RenderItem& item )
+	{
+		g_SimpleProgram.Set( UNIFORM_MVP, item.modelViewProjection );
+		g_SimpleProgram.Set( UNIFORM_COLOR, item.color );
+	};
+	g_SimpleQueueProgram = g_RenderQueue.RegisterProgram( simple );
+
+	// Unit 0 is the diffuse map; the LUTs, the Earth's normal and bump maps
+	// and the LUT array follow.
+	std::vector<TextureBinding> textures;
+	textures.push_back( { 0, GL_TEXTURE_2D, g_EarthTexture } );
+	textures.push_back( { 1, GL_TEXTURE_2D, g_LutTextures[0] } );
+	textures.push_back( { 2, GL_TEXTURE_2D, g_LutTextures[1] } );
+	textures.push_back( { 3, GL_TEXTURE_2D, g_EarthNormalMap } );
+	textures.push_back( { 4, GL_TEXTURE_2D, g_EarthBumpMap } );
+	textures.push_back( { 5, GL_TEXTURE_2D_ARRAY, g_LutArrayTexture } );
+	g_EarthTextureSet = g_RenderQueue.RegisterTextureSet( textures );
+
+	// The normal mapped variants raise the shininess, so they read their own LUTs.
+	textures[1].texture = g_NormalMapLutTextures[0];
+	textures[2].texture = g_NormalMapLutTextures[1];
+	g_EarthNormalMappedTextureSet = g_RenderQueue.RegisterTextureSet( textures );
+	textures[1].texture = g_LutTextures[0];
+	textures[2].texture = g_LutTextures[1];
+
+	textures[0].texture = g_MoonTexture;
+	g_MoonTextureSet = g_RenderQueue.RegisterTextureSet( textures );
+}
 
-    return vao;
+// The texturedDiffuse variant for a draw. Only reads the feature layout, so
+// the build stage may call it.
+ShaderKey GetTexturedVariant( int shadingModel, bool normalMapped, bool bumpMapped )
+{
+	ShaderKey key = g_TexturedVariants.SetFeature( 0, TEXTURED_SHADING_MODEL, shadingModel );
+	key = g_TexturedVariants.SetFeature( key, TEXTURED_NORMAL_MAP, normalMapped ? 1 : 0 );
+	return g_TexturedVariants.SetFeature( key, TEXTURED_BUMP_MAP, bumpMapped ? 1 : 0 );
+}
+
+// The render queue program of a texturedDiffuse variant, registered the
+// first time it is drawn. While the variant compiles this is the fallback
+// variant's program. Queue materials of the textured programs are LUT layers,
+// see GetLutLayer(). -1 if the variant does not build.
+int GetTexturedQueueProgram( ShaderKey variant )
+{
+	std::map<ShaderKey, int>::const_iterator found = g_TexturedQueuePrograms.find( variant );
+	if ( found != g_TexturedQueuePrograms.end() )
+	{
+		return found->second;
+	}
+
+	const ShaderVariant& shader = g_TexturedVariants.GetVariant( variant );
+	if ( !shader.ready )
+	{
+		return ( variant != g_TexturedFallbackVariant ) ? GetTexturedQueueProgram( g_TexturedFallbackVariant ) : -1;
+	}
+
+	int program = -1;
+	if ( shader.program != 0 )
+	{
+		ProgramBinding textured = {};
+		textured.program = shader.program;
+		textured.setMaterial = []( int lutLayer )
+		{
+			BindUniformBlock( UNIFORM_BLOCK_MATERIAL, GetMaterialUniforms( lutLayer / 2, ( lutLayer & 1 ) != 0 ) );
+		};
+		textured.setObject = []( const RenderItem& item )
+		{
+			BindObjectUniforms( item.model, item.modelViewProjection );
+		};
+		program = g_RenderQueue.RegisterProgram( textured );
+	}
+	g_TexturedQueuePrograms[variant] = program;
+	return program;
+}
+
+// Build one compact LUT layer per registered material and normal map state, all
+// within maxError, and upload them as a single texture array.
+GLuint LoadLookupTableArray( const std::vector<Material>& materials, float maxError, LutArrayLayout& layout )
+{
+	std::vector<float> shininess;
+	for (const Material& material : materials) {
+		shininess.push_back(material.shininess);
+		shininess.push_back(material.shininess * NORMAL_MAP_SHININESS_SCALE);
+	}
+
+	layout = ChooseLutArrayLayout(shininess, maxError);
+
+	std::vector<GLubyte> data(GetLutArrayByteSize(layout));
+	BakeCompactLutArray(layout, shininess, &data[0]);
+
+	std::cout << "LUT array: " << shininess.size() << " layers of " << layout.width << "x" << layout.height << " "
+			  << GetLutFormatName(layout.format) << ", max error " << layout.maxError
+			  << " (" << data.size() << " bytes)" << std::endl;
+
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GetLutInternalFormat(layout.format), layout.width, layout.height, (GLsizei)shininess.size(), 0,
+				 GetLutPixelFormat(layout.format), GetLutPixelType(layout.format), &data[0]);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return texture;
 }
 
 int main( int argc, char* argv[] )
 {
-    g_PreviousTicks = std::clock();
+    // Benchmark the LUT baker against the reference loop without creating a window.
+    if ( argc > 1 && std::string( argv[1] ) == "--bench-lut" )
+    {
+        return BenchmarkLookupTable( 1024, 1024, masterialShininessEarth, lightColor, materialDiffuseEarth, materialSpecularEarth );
+    }
+
+    // Measure the CPU teapot tessellator without creating a window.
+    if ( argc > 1 && std::string( argv[1] ) == "--bench-teapot" )
+    {
+        return BenchmarkTeapot();
+    }
+
+    // Measure scene graph updates, 100k nodes unless a count is given,
+    // without creating a window.
+    if ( argc > 1 && std::string( argv[1] ) == "--bench-scene" )
+    {
+        return BenchmarkSceneGraph( argc > 2 ? (size_t)std::stoul( argv[2] ) : 100000 );
+    }
+
+    // Run the simulation without a window at several frame rates and
+    // check the results agree, 10 s unless a duration is given.
+    if ( argc > 1 && std::string( argv[1] ) == "--simulate" )
+    {
+        return RunHeadlessSimulation( argc > 2 ? std::stod( argv[2] ) : 10.0 );
+    }
+
+    // Measure batched model-view-projection products, 100k objects unless a
+    // count is given, without creating a window.
+    if ( argc > 1 && std::string( argv[1] ) == "--bench-mvp" )
+    {
+        return BenchmarkTransformBatch( argc > 2 ? (size_t)std::stoul( argv[2] ) : 100000 );
+    }
+
+    // Measure the batch frustum culls, 1M volumes unless a count is given,
+    // without creating a window.
+    if ( argc > 1 && std::string( argv[1] ) == "--bench-cull" )
+    {
+        return BenchmarkFrustumCulling( argc > 2 ? (size_t)std::stoul( argv[2] ) : 1000000 );
+    }
+
+    // Print vertex cache statistics for the sphere and an optional OBJ file
+    // before and after mesh optimization, without creating a window.
+    if ( argc > 1 && std::string( argv[1] ) == "--mesh-report" )
+    {
+        PrintMeshOptimizationReport( "Sphere 32x32", SolidSphere( 1, 32, 32 ) );
+        if ( argc > 2 )
+        {
+            MeshData mesh;
+            if ( !LoadObj( argv[2], mesh ) )
+            {
+                return 1;
+            }
+            PrintMeshOptimizationReport( argv[2], mesh );
+        }
+        return 0;
+    }
+
+    std::string lutCacheDirectory = "../data/cache";
+    std::string programCacheDirectory = "../data/cache";
+    float lutMaxError = 1.0f / 255.0f;
+    for ( int i = 1; i < argc; ++i )
+    {
+        // Options that take a value need one more argument.
+        bool hasValue = i + 1 < argc;
+        if ( hasValue && std::string( argv[i] ) == "--lut-cache" )
+        {
+            lutCacheDirectory = argv[++i];
+        }
+        else if ( hasValue && std::string( argv[i] ) == "--program-cache" )
+        {
+            programCacheDirectory = argv[++i];
+        }
+        else if ( hasValue && std::string( argv[i] ) == "--lut-error" )
+        {
+            lutMaxError = (float)atof( argv[++i] );
+        }
+        else if ( hasValue && std::string( argv[i] ) == "--lod-error" )
+        {
+            g_LodPixelError = (float)atof( argv[++i] );
+        }
+        else if ( hasValue && std::string( argv[i] ) == "--instances" )
+        {
+            g_AsteroidCount = (size_t)std::max( atoi( argv[++i] ), 0 );
+            g_DrawAsteroids = true;
+        }
+        else if ( std::string( argv[i] ) == "--bench-instances" )
+        {
+            g_InstanceBenchmark.running = true;
+            g_AsteroidCount = INSTANCE_BENCHMARK_COUNTS[0];
+            g_DrawAsteroids = true;
+        }
+        else if ( std::string( argv[i] ) == "--serial-frames" )
+        {
+            g_PipelineThreaded = false;
+        }
+        else if ( std::string( argv[i] ) == "--validate-gl-state" )
+        {
+            GetStateCache().SetValidation( true );
+        }
+        else if ( hasValue && std::string( argv[i] ) == "--vertex-format" )
+        {
+            if ( !ParseVertexFormat( argv[++i], g_VertexFormat ) )
+            {
+                std::cerr << "Unknown vertex format \"" << argv[i] << "\"; use separate, packed or packed-half." << std::endl;
+            }
+        }
+    }
+
     g_A = g_W = g_S = g_D = g_Q = g_E = 0;
 
     g_InitialCameraPosition = glm::vec3( 0, 0, 60 );
     g_Camera.SetPosition( g_InitialCameraPosition );
     g_Camera.SetRotation( g_InitialCameraRotation );
+    ResetSimulation( g_InitialCameraPosition );
 
     InitGL(argc, argv);
     InitGLEW();
+    g_ProgramCompiler.Initialize();
+
+    g_LutCache.SetDirectory( lutCacheDirectory );
+    g_ProgramCache.SetDirectory( programCacheDirectory );
 
     g_EarthTexture = LoadTexture( "../data/Textures/earth2k.jpg" );
 	g_EarthNormalMap = LoadTexture("../data/Textures/normal8k.dds");
 	g_EarthBumpMap = LoadTexture("../data/Textures/bump1k.jpg");
     g_MoonTexture = LoadTexture( "../data/Textures/moon.dds" );
+
+    std::vector<std::string> bodyTextures( BODY_LAYER_COUNT );
+    bodyTextures[BODY_LAYER_EARTH] = "../data/Textures/earth2k.jpg";
+    bodyTextures[BODY_LAYER_MOON] = "../data/Textures/moon.dds";
+    g_BodyTextureArray = LoadTextureArray( bodyTextures, 1024, 512 );
 	
 	//creat lookup table texture
 	int width = 1024, height = 1024;
 	g_LutTextures = LoadLookupTable(width, height, masterialShininessEarth, lightColor, materialDiffuseEarth, materialSpecularEarth);
+	g_NormalMapLutTextures = LoadLookupTable(width, height, masterialShininessEarth * NORMAL_MAP_SHININESS_SCALE, lightColor, materialDiffuseEarth, materialSpecularEarth);
 
-    GLuint vertexShader = LoadShader( GL_VERTEX_SHADER, "../data/shaders/simpleShader.vert" );
-    GLuint fragmentShader = LoadShader( GL_FRAGMENT_SHADER, "../data/shaders/simpleShader.frag" );
-
-    std::vector<GLuint> shaders;
-    shaders.push_back(vertexShader);
-    shaders.push_back(fragmentShader);
-
-    g_SimpleShaderProgram = CreateShaderProgram( shaders );
-    assert( g_SimpleShaderProgram );
+	const glm::vec4 black(0);
+	const glm::vec4 white(1);
+	RegisterMaterial(black, materialDiffuseEarth, materialSpecularEarth, masterialShininessEarth); // MATERIAL_EARTH
+	RegisterMaterial(black, white, white, 5.0f); // MATERIAL_MOON
+	g_LutArrayTexture = LoadLookupTableArray(g_Materials, lutMaxError, g_LutArrayLayout);
 
-    // Set the color uniform variable in the simple shader program to white.
-    g_uniformColor = glGetUniformLocation( g_SimpleShaderProgram, "color" );
+    // Everything the first frame needs is submitted before waiting for any
+    // of it, so the driver can compile the programs side by side.
+    auto compileStart = std::chrono::steady_clock::now();
 
-    vertexShader = LoadShader( GL_VERTEX_SHADER, "../data/shaders/texturedDiffuse.vert" );
-    fragmentShader = LoadShader( GL_FRAGMENT_SHADER, "../data/shaders/texturedDiffuse.frag" );
-
-    shaders.clear();
-
-    shaders.push_back(vertexShader);
-    shaders.push_back(fragmentShader);
-    g_TexturedDiffuseShaderProgram = CreateShaderProgram( shaders );
-    assert( g_TexturedDiffuseShaderProgram );
-
-    g_uniformMVP = glGetUniformLocation( g_TexturedDiffuseShaderProgram, "ModelViewProjectionMatrix" );
-    g_uniformModelMatrix = glGetUniformLocation( g_TexturedDiffuseShaderProgram, "ModelMatrix" );
-    g_uniformEyePosW = glGetUniformLocation( g_TexturedDiffuseShaderProgram, "EyePosW" );
+    LoadShaderProgram( "../data/shaders/simpleShader.vert", "../data/shaders/simpleShader.frag", []( GLuint program )
+    {
+        g_SimpleShaderProgram = program;
+        assert( g_SimpleShaderProgram );
+
+        g_SimpleProgram.Reflect( g_SimpleShaderProgram );
+        g_SimpleProgram.Print( std::cout );
+    } );
+
+    std::vector<ShaderFeature> texturedFeatures( TEXTURED_FEATURE_COUNT );
+    texturedFeatures[TEXTURED_SHADING_MODEL] = { "SHADING_MODEL", 2 };
+    texturedFeatures[TEXTURED_NORMAL_MAP] = { "NORMAL_MAP", 1 };
+    texturedFeatures[TEXTURED_BUMP_MAP] = { "BUMP_MAP", 1 };
+    bool texturedLoaded = g_TexturedVariants.Create( g_ProgramCompiler, g_ShaderPreprocessor, "../data/shaders/texturedDiffuse.vert", "../data/shaders/texturedDiffuse.frag", texturedFeatures,
+        []( ShaderVariant& variant )
+        {
+            ProgramReflection& reflection = variant.reflection;
+            reflection.BindUniformBlock( "Frame", UNIFORM_BLOCK_FRAME );
+            reflection.BindUniformBlock( "Material", UNIFORM_BLOCK_MATERIAL );
+            reflection.BindUniformBlock( "Object", UNIFORM_BLOCK_OBJECT );
+
+            // Texture units of the queue's texture sets, see RegisterQueuePrograms().
+            reflection.Set( UNIFORM_LUT_DIFFUSE_SAMPLER, 1 );
+            reflection.Set( UNIFORM_LUT_SPECULAR_SAMPLER, 2 );
+            reflection.Set( UNIFORM_NORMAL_MAP_SAMPLER, 3 );
+            reflection.Set( UNIFORM_BUMP_MAP_SAMPLER, 4 );
+            reflection.Set( UNIFORM_LUT_ARRAY_SAMPLER, 5 );
+        } );
+    assert( texturedLoaded );
+    g_TexturedVariants.SetSharedDefines( "#define NORMAL_MAP_SHININESS_SCALE " + std::to_string( NORMAL_MAP_SHININESS_SCALE ) + "\n" );
+    g_TexturedVariants.SetProgramCache( &g_ProgramCache );
+
+    // Plain Phong without maps stands in for the variants still compiling.
+    g_TexturedFallbackVariant = GetTexturedVariant( 0, false, false );
+    g_TexturedVariants.GetVariant( g_TexturedFallbackVariant );
+
+    LoadShaderProgram( "../data/shaders/instanced.vert", "../data/shaders/instanced.frag", []( GLuint program )
+    {
+        g_InstancedShaderProgram = program;
+        assert( g_InstancedShaderProgram );
+
+        g_InstancedProgram.Reflect( g_InstancedShaderProgram );
+        g_InstancedProgram.Print( std::cout );
+        g_InstancedProgram.BindUniformBlock( "Frame", UNIFORM_BLOCK_FRAME );
+        g_InstancedProgram.BindUniformBlock( "MaterialTable", UNIFORM_BLOCK_MATERIAL_TABLE );
+    } );
+
+    g_ProgramCompiler.Finish();
+    assert( g_TexturedVariants.GetVariant( g_TexturedFallbackVariant ).program );
+    std::cout << "Startup programs ready in " << std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - compileStart ).count()
+              << " ms (" << ( g_ProgramCompiler.IsParallel() ? "parallel" : "serial" ) << " shader compilation)" << std::endl;
+
+    // The remaining texturedDiffuse variants build in the background; the
+    // cache statistics at exit include them.
+    g_ShaderPreprocessor.PrintStatistics( std::cout );
+    g_ProgramCache.PrintStatistics( std::cout );
+    for ( int shadingModel = 0; shadingModel < (int)shaderTypes.size(); ++shadingModel )
+    {
+        for ( int maps = 0; maps < 4; ++maps )
+        {
+            g_TexturedVariants.GetVariant( GetTexturedVariant( shadingModel, ( maps & 1 ) != 0, ( maps & 2 ) != 0 ) );
+        }
+    }
 
-    // Light properties.
-    g_uniformLightPosW = glGetUniformLocation( g_TexturedDiffuseShaderProgram, "LightPosW" );
-    g_uniformLightColor = glGetUniformLocation( g_TexturedDiffuseShaderProgram, "LightColor" );
+    // SOIL and the LUT upload bind textures and buffers directly.
+    GetStateCache().Invalidate();
 
-    // Global ambient.
-    g_uniformAmbient = glGetUniformLocation( g_TexturedDiffuseShaderProgram, "Ambient" );
+    g_UniformRing.Create( UNIFORM_RING_REGION_SIZE );
+    std::cout << "Uniform ring: " << UNIFORM_RING_FRAMES << " x " << UNIFORM_RING_REGION_SIZE / 1024 << " KB, "
+              << ( g_UniformRing.IsPersistent() ? "persistently mapped" : "glBufferSubData" ) << std::endl;
 
-    // Material properties.
-    g_uniformMaterialEmissive = glGetUniformLocation( g_TexturedDiffuseShaderProgram, "MaterialEmissive" );
-    g_uniformMaterialDiffuse = glGetUniformLocation( g_TexturedDiffuseShaderProgram, "MaterialDiffuse" );
-    g_uniformMaterialSpecular = glGetUniformLocation( g_TexturedDiffuseShaderProgram, "MaterialSpecular" );
-    g_uniformMaterialShininess = glGetUniformLocation( g_TexturedDiffuseShaderProgram, "MaterialShininess" );
-	g_uniformShaderType = glGetUniformLocation( g_TexturedDiffuseShaderProgram, "shaderType" );
-	g_uniformLuts[0] = glGetUniformLocation(g_TexturedDiffuseShaderProgram, "lutDiffuseSampler");
-	g_uniformLuts[1] = glGetUniformLocation(g_TexturedDiffuseShaderProgram, "lutSpecularSampler");
-	g_uniformNormalMap = glGetUniformLocation(g_TexturedDiffuseShaderProgram, "normalMapSampler");
-	g_uniformBumpMap = glGetUniformLocation(g_TexturedDiffuseShaderProgram, "bumpMapSampler");
-	g_uniformEnableEarthNormalMap = glGetUniformLocation(g_TexturedDiffuseShaderProgram, "enableEarthNormalMap");
-	g_uniformEnableEarthBumpMap = glGetUniformLocation(g_TexturedDiffuseShaderProgram, "enableEarthBumpMap");
+    RegisterQueuePrograms();
+    CreateSceneGraph();
 
     glutMainLoop();
+    g_FramePipeline.Stop();
+    g_ProgramCompiler.Finish();
+    g_TexturedVariants.PrintReport( std::cout );
+    g_ShaderPreprocessor.PrintStatistics( std::cout );
+    g_ProgramCache.PrintStatistics( std::cout );
 }
 
 void ReshapeGL( int w, int h )
@@ -515,121 +1148,333 @@ void ReshapeGL( int w, int h )
     glutPostRedisplay();
 }
 
-void DisplayGL()
+// Skip an object outside the view, otherwise select the sphere level for it
+// from its projected size and record its draw in the packet. program -1
+// selects the texturedDiffuse variant. With meshlet culling on, every surviving range is its own item; they
+// share the transform, so the queue merges them into one glMultiDrawElements.
+// modelMatrix must be a rotation/translation followed by a uniform scale.
+void QueueSphere( const FrameInput& input, Camera& camera, FramePacket& packet, SphereObject object,
+                  const glm::mat4& modelMatrix, int program, ShaderKey variant, int textureSet, int material, const glm::vec4& color )
 {
-    int slices = 32;
-    int stacks = 32;
-	//for fps calculate
-	static int currentTicks = 0, previousTicks = 0;
-	static float fDeltaTime = 0.0f;
-	static int frameCount = 0;
-	static std::string fps = "0 fps";
+    const Frustum& frustum = camera.GetFrustum();
+    float scale = glm::length( glm::vec3( modelMatrix[0] ) );
+    if ( !IntersectsSphere( frustum, glm::vec3( modelMatrix[3] ), scale ) )
+    {
+        return;
+    }
+
+    float distance = glm::length( glm::vec3( modelMatrix[3] ) - camera.GetPosition() );
+    float pixelsPerUnit = GetPixelsPerUnit( camera, scale, distance );
+
+    int level = g_SphereLod.SelectLevel( pixelsPerUnit, g_SphereLodLevels[object], input.lodPixelError, LOD_HYSTERESIS );
+    g_SphereLodLevels[object] = level;
+    g_SphereLod.CountDraw( level, packet.lodStatistics );
+
+    const SphereLodChain::Level& lod = g_SphereLod.GetLevel( level );
+
+    QueuedDraw draw;
+    draw.pass = RENDER_PASS_OPAQUE;
+    draw.program = program;
+    draw.variant = variant;
+    draw.textureSet = textureSet;
+    draw.depth = distance;
 
-    int numIndicies = ( slices * stacks + slices ) * 6;
-    if ( g_vaoSphere == 0 )
+    RenderItem& item = draw.item;
+    item.vao = lod.mesh.vao;
+    item.indexType = lod.mesh.indexType;
+    item.indexCount = lod.mesh.indexCount;
+    item.indexOffset = BUFFER_OFFSET(0);
+    item.model = modelMatrix;
+    item.color = color;
+    item.material = material;
+
+    if ( !input.meshletCulling )
     {
-        g_vaoSphere = SolidSphere( 1, slices, stacks );
+        packet.draws.push_back( draw );
+        return;
     }
 
-    //const glm::vec4 white(1);
-    const glm::vec4 black(0);
-    const glm::vec4 ambient( 0.1f, 0.1f, 0.1f, 1.0f );
+    int indexSize = ( lod.mesh.indexType == GL_UNSIGNED_SHORT ) ? sizeof(GLushort) : sizeof(GLuint);
+    g_DrawRanges.counts.clear();
+    g_DrawRanges.offsets.clear();
+    CullMeshlets( lod.meshlets, modelMatrix, frustum, camera.GetPosition(), indexSize, g_DrawRanges, packet.meshletStatistics );
+    for ( size_t i = 0; i < g_DrawRanges.counts.size(); ++i )
+    {
+        item.indexCount = g_DrawRanges.counts[i];
+        item.indexOffset = g_DrawRanges.offsets[i];
+        packet.draws.push_back( draw );
+    }
+}
 
-    glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+// Draw the asteroid belt with one instanced draw per LOD level.
+void DrawAsteroids( const InstanceBatch& asteroids )
+{
+    g_Instances.Upload( asteroids );
 
-    // Draw the sun using a simple shader.
-    glBindVertexArray(g_vaoSphere);
+    std::vector<MaterialUniforms> materials( MAX_INSTANCE_MATERIALS, MaterialUniforms() );
+    for ( int i = 0; i < (int)g_Materials.size() && i < MAX_INSTANCE_MATERIALS; ++i )
+    {
+        materials[i] = GetMaterialUniforms( i, false );
+    }
+    BindUniformBlock( UNIFORM_BLOCK_MATERIAL_TABLE, materials.data(), materials.size() * sizeof(MaterialUniforms) );
 
-    glUseProgram( g_SimpleShaderProgram );
-    glm::mat4 modelMatrix = glm::rotate( glm::radians(g_fSunRotation), glm::vec3(0,-1,0) ) * glm::translate(glm::vec3(90,0,-50));
-    glm::mat4 mvp = g_Camera.GetProjectionMatrix() * g_Camera.GetViewMatrix() * modelMatrix;
-    GLuint uniformMVP = glGetUniformLocation( g_SimpleShaderProgram, "MVP" );
-    glUniformMatrix4fv( uniformMVP, 1, GL_FALSE, glm::value_ptr(mvp) );
-    glUniform4fv(g_uniformColor, 1, glm::value_ptr(lightColor) );
+    StateCache& state = GetStateCache();
+    state.BindTexture( 6, GL_TEXTURE_2D_ARRAY, g_BodyTextureArray );
+    state.UseProgram( g_InstancedShaderProgram );
+    g_InstancedProgram.Set( UNIFORM_DIFFUSE_ARRAY_SAMPLER, 6 );
 
-    glDrawElements( GL_TRIANGLES, numIndicies, GL_UNSIGNED_INT, BUFFER_OFFSET(0) );
-	
-	//Activate and bind textures to opengl for all shader usage
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, g_EarthTexture);
+    g_Instances.Draw( g_SphereLod );
+}
 
-	// Load the LUT
-	glActiveTexture(GL_TEXTURE0 + 1);
-	glBindTexture(GL_TEXTURE_2D, g_LutTextures[0]);
+// Copy the input and the switches the build stage reads.
+FrameInput CaptureFrameInput()
+{
+    FrameInput input;
+    input.camera = g_Camera;
+    input.simulation.move = glm::vec3( g_D - g_A, g_Q - g_E, g_S - g_W );
+    input.simulation.fast = g_bShift;
+    input.simulation.cameraRotation = g_Camera.GetRotation();
+    input.reset = g_ResetRequested;
+    input.meshletCulling = g_MeshletCulling;
+    input.drawTeapot = g_DrawTeapot;
+    input.drawAsteroids = g_DrawAsteroids;
+    input.asteroidCount = g_AsteroidCount;
+    input.lodPixelError = g_LodPixelError;
+    input.shadingModel = (int)shaderType;
+    input.normalMapped = enableEarthNormalMap != GL_FALSE;
+    input.bumpMapped = enableEarthBumpMap != GL_FALSE;
+
+    g_ResetRequested = false;
+    return input;
+}
 
-	glActiveTexture(GL_TEXTURE0 + 2);
-	glBindTexture(GL_TEXTURE_2D, g_LutTextures[1]);
+// The build stage, on the pipeline's worker: advance the simulation, update
+// the scene graph, cull, select levels of detail and record the draws. It
+// owns the simulation, the scene graph, the sphere LOD levels and the
+// asteroid bodies, and makes no GL calls.
+void BuildFrame( const FrameInput& input, FramePacket& packet )
+{
+    auto start = std::chrono::steady_clock::now();
 
-	glActiveTexture(GL_TEXTURE0 + 3);
-	glBindTexture(GL_TEXTURE_2D, g_EarthNormalMap);
+    if ( input.reset )
+    {
+        ResetSimulation( input.camera.GetPosition() );
+    }
 
-	glActiveTexture(GL_TEXTURE0 + 4);
-	glBindTexture(GL_TEXTURE_2D, g_EarthBumpMap);
+    int steps = g_SimulationClock.Advance();
+    float stepSeconds = g_SimulationClock.GetStepSeconds();
+    for ( int i = 0; i < steps; ++i )
+    {
+        g_SceneStates.Step( [&]( SceneState& state ) { StepScene( state, input.simulation, stepSeconds ); } );
+    }
 
-	//start using earth shader
-    glUseProgram( g_TexturedDiffuseShaderProgram );
+    Camera camera = input.camera;
+    ApplySceneState( InterpolateScene( g_SceneStates.GetPrevious(), g_SceneStates.GetCurrent(), g_SimulationClock.GetAlpha() ), camera );
+    UpdateSceneGraph();
+
+    auto updated = std::chrono::steady_clock::now();
+    packet.updateMs = std::chrono::duration<double, std::milli>( updated - start ).count();
+
+    packet.viewProjection = camera.GetViewProjectionMatrix();
+    packet.eyePosition = camera.GetPosition();
+    packet.sunMatrix = g_Scene.GetWorldMatrix( g_SunNode );
+    packet.draws.clear();
+    packet.lodStatistics = LodStatistics();
+    packet.meshletCulling = input.meshletCulling;
+    packet.meshletStatistics = MeshletCullStatistics();
+
+    // The sun uses the simple shader.
+    QueueSphere( input, camera, packet, SPHERE_SUN, packet.sunMatrix, g_SimpleQueueProgram, 0, 0, -1, lightColor );
+
+    packet.earthMatrix = g_Scene.GetWorldMatrix( g_EarthNode );
+    packet.earthDistance = glm::length( glm::vec3( packet.earthMatrix[3] ) - camera.GetPosition() );
+    packet.earthMaterial = GetLutLayer( MATERIAL_EARTH, input.normalMapped );
+    packet.earthTextureSet = input.normalMapped ? g_EarthNormalMappedTextureSet : g_EarthTextureSet;
+    packet.earthVariant = GetTexturedVariant( input.shadingModel, input.normalMapped, input.bumpMapped );
+    packet.teapotSegments = 0;
+    if ( input.drawTeapot )
+    {
+        // Tessellate densely enough to stay within the LOD pixel error.
+        float pixelsPerUnit = GetPixelsPerUnit( camera, EARTH_SCALE, packet.earthDistance );
+        packet.teapotSegments = ChooseTeapotSegments( input.lodPixelError / pixelsPerUnit );
+    }
+    else
+    {
+        QueueSphere( input, camera, packet, SPHERE_EARTH, packet.earthMatrix, -1, packet.earthVariant, packet.earthTextureSet, packet.earthMaterial, glm::vec4(1) );
+    }
+	/*
+    // The moon.
+    QueueSphere( input, camera, packet, SPHERE_MOON, g_Scene.GetWorldMatrix( g_MoonNode ), -1, GetTexturedVariant( input.shadingModel, false, false ),
+                 g_MoonTextureSet, GetLutLayer( MATERIAL_MOON, false ), glm::vec4(1) );
+	*/
+    packet.earthLodLevel = g_SphereLodLevels[SPHERE_EARTH];
 
-	glUniform1i(g_uniformLuts[0], 1); // location = 9 <- texture unit 1
-	glUniform1i(g_uniformLuts[1], 2);
-	glUniform1i(g_uniformNormalMap, 3);
-	glUniform1i(g_uniformBumpMap, 4);
+    packet.drawAsteroids = input.drawAsteroids;
+    if ( input.drawAsteroids )
+    {
+        if ( g_Asteroids.size() != input.asteroidCount )
+        {
+            g_Asteroids = CreateAsteroidBelt( input.asteroidCount, 25.0f, 45.0f, (int)g_Materials.size(), BODY_LAYER_COUNT, 1 );
+        }
+        BuildInstanceBatch( g_Asteroids, camera.GetFrustum(), camera, g_SphereLod, input.lodPixelError, packet.asteroids );
+    }
 
-    // Set the light position to the position of the Sun.
-    glUniform4fv( g_uniformLightPosW, 1, glm::value_ptr(modelMatrix[3]) );
-    glUniform4fv( g_uniformLightColor, 1, glm::value_ptr(lightColor) );
-    glUniform4fv( g_uniformAmbient, 1, glm::value_ptr(ambient) );
+    packet.cullMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - updated ).count();
+}
 
-	//switch between all shading types
-	glUniform1i(g_uniformShaderType, shaderType);
-	glUniform1i(g_uniformEnableEarthNormalMap, enableEarthNormalMap);
-	glUniform1i(g_uniformEnableEarthBumpMap, enableEarthBumpMap);
+// Called after every frame while --bench-instances runs. Waits for the GPU so
+// the interval between calls is the full frame time.
+void UpdateInstanceBenchmark()
+{
+    InstanceBenchmark& benchmark = g_InstanceBenchmark;
+    glFinish();
+    auto now = std::chrono::steady_clock::now();
 
-    
-	// Draw the Earth
-    modelMatrix = glm::rotate( glm::radians(g_fEarthRotation), glm::vec3(0,1,0) ) * glm::scale(glm::vec3(12.756f) );
-    glm::vec4 eyePosW = glm::vec4( g_Camera.GetPosition(), 1 );
+    if ( benchmark.step == 0 && benchmark.frame == 0 )
+    {
+        std::cout << "Instanced asteroid belt (" << GetWorkerCount() << " threads, " << INSTANCE_BENCHMARK_FRAMES << " frames per count)" << std::endl;
+    }
 
-    mvp = g_Camera.GetProjectionMatrix() * g_Camera.GetViewMatrix() * modelMatrix;
+    ++benchmark.frame;
+    if ( benchmark.frame > INSTANCE_BENCHMARK_WARMUP_FRAMES )
+    {
+        benchmark.frameMs += std::chrono::duration<double, std::milli>( now - benchmark.lastFrame ).count();
+        benchmark.buildMs += g_Instances.GetStatistics().buildMs;
+    }
+    benchmark.lastFrame = now;
 
-    glUniformMatrix4fv( g_uniformMVP, 1, GL_FALSE, glm::value_ptr(mvp) );
-    glUniformMatrix4fv( g_uniformModelMatrix, 1, GL_FALSE, glm::value_ptr(modelMatrix) );
-    glUniform4fv( g_uniformEyePosW, 1, glm::value_ptr( eyePosW ) );
+    if ( benchmark.frame < INSTANCE_BENCHMARK_WARMUP_FRAMES + INSTANCE_BENCHMARK_FRAMES )
+    {
+        return;
+    }
 
-    // Earth Diffuse, Emissive Material properties.
-    glUniform4fv( g_uniformMaterialEmissive, 1, glm::value_ptr(black) );
-    glUniform4fv( g_uniformMaterialDiffuse, 1, glm::value_ptr(materialDiffuseEarth) );
+    const InstanceStatistics& statistics = g_Instances.GetStatistics();
+    std::cout << "  " << g_AsteroidCount << " bodies: " << statistics.visible << " visible in " << statistics.draws << " draws, "
+              << statistics.triangles << " triangles; build " << benchmark.buildMs / INSTANCE_BENCHMARK_FRAMES << " ms, frame "
+              << benchmark.frameMs / INSTANCE_BENCHMARK_FRAMES << " ms" << std::endl;
 
-	// Earth Specular Color RGBA
-    glUniform4fv( g_uniformMaterialSpecular, 1, glm::value_ptr(materialSpecularEarth));
-    glUniform1f( g_uniformMaterialShininess, masterialShininessEarth );
+    benchmark.frame = 0;
+    benchmark.frameMs = 0;
+    benchmark.buildMs = 0;
+    if ( ++benchmark.step == (int)( sizeof(INSTANCE_BENCHMARK_COUNTS) / sizeof(INSTANCE_BENCHMARK_COUNTS[0]) ) )
+    {
+        benchmark.running = false;
+        glutLeaveMainLoop();
+        return;
+    }
+    g_AsteroidCount = INSTANCE_BENCHMARK_COUNTS[benchmark.step];
+}
 
-    glDrawElements( GL_TRIANGLES, numIndicies, GL_UNSIGNED_INT, BUFFER_OFFSET(0) );
-	/*
-    // Draw the moon.
-    glBindTexture( GL_TEXTURE_2D, g_MoonTexture );
+void DisplayGL()
+{
+	//for fps calculate
+	static std::chrono::steady_clock::time_point previousTime = std::chrono::steady_clock::now();
+	static float fDeltaTime = 0.0f;
+	static int frameCount = 0;
+	static std::string fps = "0 fps";
+
+    // Pick up the texturedDiffuse variants that finished compiling.
+    g_ProgramCompiler.Poll();
+
+    if ( !g_SphereLod.IsBuilt() )
+    {
+        g_SphereLod.Build( g_VertexFormat );
+        for ( int& level : g_SphereLodLevels )
+        {
+            level = g_SphereLod.GetLevelCount() - 1;
+        }
+        std::cout << "Using " << GetVertexFormatName( g_VertexFormat ) << " vertex format" << std::endl;
 
-    modelMatrix =  glm::rotate( glm::radians(g_fSunRotation), glm::vec3(0,1,0) ) * glm::translate(glm::vec3(60, 0, 0) ) * glm::scale(glm::vec3(3.476f));
-    mvp = g_Camera.GetProjectionMatrix() * g_Camera.GetViewMatrix() * modelMatrix;
+        // The build stage needs the LOD chain.
+        g_FramePipeline.Start( BuildFrame, g_PipelineThreaded );
+        std::cout << "Frame pipeline: " << ( g_PipelineThreaded ? "build on a worker thread" : "serial" ) << std::endl;
+    }
 
-    glUniformMatrix4fv( g_uniformMVP, 1, GL_FALSE, glm::value_ptr(mvp) );
-    glUniformMatrix4fv( g_uniformModelMatrix, 1, GL_FALSE, glm::value_ptr(modelMatrix) );
+    // This frame's packet; the worker starts on the next one.
+    const FramePacket& packet = g_FramePipeline.Acquire( CaptureFrameInput() );
 
-    glUniform4fv( g_uniformMaterialEmissive, 1, glm::value_ptr(black) );
-    glUniform4fv( g_uniformMaterialDiffuse, 1, glm::value_ptr(white) );
-    glUniform4fv( g_uniformMaterialSpecular, 1, glm::value_ptr(white) );
-    glUniform1f( g_uniformMaterialShininess, 5.0f );
+    ProgramReflection::ResetStatistics();
+    StateCache& state = GetStateCache();
+    state.ResetStatistics();
+    g_UniformRing.BeginFrame();
 
-    glDrawElements( GL_TRIANGLES, numIndicies, GL_UNSIGNED_INT, BUFFER_OFFSET(0) );
-	*/
-    glBindVertexArray(0);
-    glUseProgram(0);
-    glBindTexture( GL_TEXTURE_2D, 0 );
+    const glm::vec4 ambient( 0.1f, 0.1f, 0.1f, 1.0f );
+
+    glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+
+    const glm::mat4& viewProjection = packet.viewProjection;
+    g_RenderQueue.SetViewProjection( viewProjection );
+    const glm::mat4& sunMatrix = packet.sunMatrix;
+
+    // Light and camera.
+    FrameUniforms frame = {};
+    frame.eyePosW = glm::vec4( packet.eyePosition, 1 );
+    frame.lightPosW = sunMatrix[3];     // The light is at the Sun.
+    frame.lightColor = lightColor;
+    frame.ambient = ambient;
+    frame.lutScaleBias = GetLutScaleBias(GetLutArrayLayer(g_LutArrayLayout, 0));
+    frame.viewProjection = viewProjection;
+    BindUniformBlock( UNIFORM_BLOCK_FRAME, frame );
+
+    for ( const QueuedDraw& draw : packet.draws )
+    {
+        int program = ( draw.program >= 0 ) ? draw.program : GetTexturedQueueProgram( draw.variant );
+        if ( program >= 0 )
+        {
+            g_RenderQueue.Submit( draw.pass, program, draw.textureSet, draw.item, draw.depth );
+        }
+    }
+
+	// Draw the Earth as a teapot.
+    int teapotProgram = ( packet.teapotSegments > 0 ) ? GetTexturedQueueProgram( packet.earthVariant ) : -1;
+    if ( teapotProgram >= 0 )
+    {
+        const Mesh& teapot = g_Teapots.GetMesh( packet.teapotSegments, g_VertexFormat );
+        RenderItem item = {};
+        item.vao = teapot.vao;
+        item.indexType = teapot.indexType;
+        item.indexCount = teapot.indexCount;
+        item.indexOffset = BUFFER_OFFSET(0);
+        item.model = packet.earthMatrix;
+        item.material = packet.earthMaterial;
+        g_RenderQueue.Submit( RENDER_PASS_OPAQUE, teapotProgram, packet.earthTextureSet, item, packet.earthDistance );
+    }
+    g_RenderQueue.Flush();
+
+    if ( g_ShowGizmos )
+    {
+        // Mark the light and the moon's orbit.
+        state.UseProgram( g_SimpleShaderProgram );
+        glm::vec4 gizmoColor( 0.5f, 0.5f, 0.5f, 1.0f );
+        g_SimpleProgram.Set( UNIFORM_COLOR, gizmoColor );
+
+        glm::mat4 gizmoMVP = viewProjection * sunMatrix * glm::scale( glm::vec3(2.0f) );
+        g_SimpleProgram.Set( UNIFORM_MVP, gizmoMVP );
+        g_Shapes.DrawOctahedron();
+
+        gizmoMVP = viewProjection * glm::rotate( glm::radians(90.0f), glm::vec3(1,0,0) );
+        g_SimpleProgram.Set( UNIFORM_MVP, gizmoMVP );
+        g_Shapes.DrawTorus( 0.1f, 60.0f, 8, 128 );
+    }
+
+    if ( packet.drawAsteroids )
+    {
+        DrawAsteroids( packet.asteroids );
+    }
+
+    // The overlay text is drawn with the fixed function pipeline. The vertex
+    // array and textures stay bound for the next frame.
+    state.UseProgram(0);
+    g_UniformRing.EndFrame();
+    if ( state.IsValidating() )
+    {
+        state.Validate();
+    }
 
 	frameCount++;
-	currentTicks = std::clock();
-	float deltaTicks = (float)(currentTicks - previousTicks);
-	previousTicks = currentTicks;
-	fDeltaTime += deltaTicks / (float)CLOCKS_PER_SEC;
+	std::chrono::steady_clock::time_point currentTime = std::chrono::steady_clock::now();
+	fDeltaTime += std::chrono::duration<float>(currentTime - previousTime).count();
+	previousTime = currentTime;
 	
 	if (fDeltaTime > 2.0f) {
 		float fpsRate = frameCount/fDeltaTime;
@@ -639,42 +1484,70 @@ void DisplayGL()
 	}
 
 	drawStrokeText(const_cast<char*>(fps.c_str()), 0, g_iWindowHeight*0.9, 0);
-	drawStrokeText(const_cast<char*>((shaderTypes[shaderType]+normalMapHeadline+ bumpMapHeadline).c_str()), 0, g_iWindowHeight*0.1, 0);
-		
-    glutSwapBuffers();
-}
-
-void IdleGL()
-{
-    g_CurrentTicks = std::clock();
-    float deltaTicks = (float)( g_CurrentTicks - g_PreviousTicks );
-    g_PreviousTicks = g_CurrentTicks;
-
-    float fDeltaTime = deltaTicks / (float)CLOCKS_PER_SEC;
 
-    float speed = 1.0f;
-
-    if ( g_bShift )
-    {
-		speed = 2.0f;
-    }
+	std::string lod = (packet.teapotSegments > 0 ? "Teapot " + std::to_string(packet.teapotSegments) + "x" + std::to_string(packet.teapotSegments) + ", sphere LOD " : "LOD ") +
+		std::to_string(packet.earthLodLevel) + ": " +
+		std::to_string(packet.lodStatistics.trianglesDrawn) + " tris, " + std::to_string(GetTrianglesSaved(packet.lodStatistics)) + " saved";
+	drawStrokeText(const_cast<char*>(lod.c_str()), 0, g_iWindowHeight*0.8, 0);
+
+	if (packet.meshletCulling) {
+		const MeshletCullStatistics& meshletStatistics = packet.meshletStatistics;
+		std::string meshlets = "Meshlets: " + std::to_string(meshletStatistics.meshlets) + ", " +
+			std::to_string(meshletStatistics.frustumCulled) + " frustum culled, " +
+			std::to_string(meshletStatistics.backfaceCulled) + " backface culled, " +
+			std::to_string(meshletStatistics.trianglesSubmitted) + " tris";
+		drawStrokeText(const_cast<char*>(meshlets.c_str()), 0, g_iWindowHeight*0.7, 0);
+	}
 
-    g_Camera.Translate( glm::vec3( g_D - g_A, g_Q - g_E, g_S - g_W) * speed * fDeltaTime );
+	const UniformStatistics& uniforms = ProgramReflection::GetStatistics();
+	const UniformRingStatistics& ring = g_UniformRing.GetStatistics();
+	std::string uniformText = "Uniforms: " + std::to_string(uniforms.uploads) + " uploaded, " + std::to_string(uniforms.skipped) + " skipped, " +
+		std::to_string(ring.blocks) + " blocks (" + std::to_string(ring.bytes) + " bytes)";
+	drawStrokeText(const_cast<char*>(uniformText.c_str()), 0, g_iWindowHeight*0.6, 0);
 
-    // Rate of rotation in (degrees) per second
-    const float fRotationRate1 = 30.0f*speed;
-    const float fRotationRate2 = 12.5f;
-    const float fRotationRate3 = 90.0f;
+	const StateCacheStatistics& stateStatistics = state.GetStatistics();
+	std::string stateText = "GL state: " + std::to_string(stateStatistics.issued) + " issued, " + std::to_string(stateStatistics.elided) + " elided";
+	if (state.IsValidating()) {
+		stateText += ", " + std::to_string(stateStatistics.mismatches) + " mismatches";
+	}
+	drawStrokeText(const_cast<char*>(stateText.c_str()), 0, g_iWindowHeight*0.5, 0);
 
-    g_fEarthRotation += fRotationRate1 * fDeltaTime;
-    g_fEarthRotation = fmod(g_fEarthRotation, 360.0f);
+	if (packet.drawAsteroids) {
+		const InstanceStatistics& instances = g_Instances.GetStatistics();
+		std::string instanceText = "Instances: " + std::to_string(instances.visible) + "/" + std::to_string(instances.instances) + " visible, " +
+			std::to_string(instances.draws) + " draws, " + std::to_string(instances.triangles) + " tris, build " + std::to_string(instances.buildMs) + " ms";
+		drawStrokeText(const_cast<char*>(instanceText.c_str()), 0, g_iWindowHeight*0.4, 0);
+	}
 
-    g_fMoonRotation = fRotationRate2;
-    //g_fMoonRotation = fmod(g_fMoonRotation, 360.0f);
+	const RenderQueueStatistics& queue = g_RenderQueue.GetStatistics();
+	std::string queueText = "Queue: " + std::to_string(queue.items) + " items, " + std::to_string(queue.batches) + " batches (" +
+		std::to_string(queue.multiDrawBatches) + " multi-draw), " +
+		std::to_string(queue.stateChanges) + " state changes, sort " + std::to_string(queue.sortMs) + " ms";
+	drawStrokeText(const_cast<char*>(queueText.c_str()), 0, g_iWindowHeight*0.3, 0);
+
+	// The GLUT thread's time includes the previous frame's overlay and swap.
+	const FramePipelineStatistics& pipeline = g_FramePipeline.GetStatistics();
+	std::string pipelineText = "Frame: update " + std::to_string(packet.updateMs) + " ms, cull " + std::to_string(packet.cullMs) + " ms " +
+		(pipeline.threaded ? "on worker" : "inline") + "; GL thread " + std::to_string(pipeline.submitMs) + " ms, waited " + std::to_string(pipeline.waitMs) + " ms";
+	drawStrokeText(const_cast<char*>(pipelineText.c_str()), 0, g_iWindowHeight*0.2, 0);
+	std::string shaderText = shaderTypes[shaderType] + normalMapHeadline + bumpMapHeadline + ", " + std::to_string(g_TexturedVariants.GetVariantCount() - g_TexturedVariants.GetPendingCount()) + " variants";
+	if ( g_TexturedVariants.GetPendingCount() > 0 )
+	{
+		shaderText += ", " + std::to_string(g_TexturedVariants.GetPendingCount()) + " compiling";
+	}
+	drawStrokeText(const_cast<char*>(shaderText.c_str()), 0, g_iWindowHeight*0.1, 0);
+		
+    glutSwapBuffers();
 
-    g_fSunRotation = fRotationRate3;
-    //g_fSunRotation = fmod(g_fSunRotation, 360.0f);
+    if ( g_InstanceBenchmark.running )
+    {
+        UpdateInstanceBenchmark();
+    }
+}
 
+// The simulation advances in the build stage; see BuildFrame().
+void IdleGL()
+{
     glutPostRedisplay();
 }
 
@@ -710,25 +1583,43 @@ void KeyboardGL( unsigned char c, int x, int y )
     case 'R':
         g_Camera.SetPosition( g_InitialCameraPosition );
         g_Camera.SetRotation( g_InitialCameraRotation );
-        g_fEarthRotation = 0.0f;
-        g_fSunRotation = 0.0f;
-        g_fMoonRotation = 0.0f;
+        g_ResetRequested = true;
         break;
 	case 'T':
 	case 't':
 		++shaderType %= shaderTypes.size();
-		normalMapHeadline = (enableEarthNormalMap && shaderType!=2) ? " (Normal Map)" : "";
+		normalMapHeadline = (enableEarthNormalMap) ? " (Normal Map)" : "";
 		break;
 	case 'N' :
 	case 'n' :
 		enableEarthNormalMap = !enableEarthNormalMap;
-		normalMapHeadline = (enableEarthNormalMap && shaderType!=2) ? " (Normal Map)" : "";
+		normalMapHeadline = (enableEarthNormalMap) ? " (Normal Map)" : "";
 		break;
 	case 'B':
 	case 'b':
 		enableEarthBumpMap = !enableEarthBumpMap;
 		bumpMapHeadline = (enableEarthBumpMap) ? " (bump Map)" : "";
 		break;
+	case 'G':
+	case 'g':
+		g_ShowGizmos = !g_ShowGizmos;
+		break;
+	case 'C':
+	case 'c':
+		g_MeshletCulling = !g_MeshletCulling;
+		break;
+	case 'P':
+	case 'p':
+		g_DrawTeapot = !g_DrawTeapot;
+		break;
+	case 'I':
+	case 'i':
+		g_DrawAsteroids = !g_DrawAsteroids;
+		break;
+	case 'V':
+	case 'v':
+		g_TexturedVariants.PrintReport(std::cout);
+		break;
     case 27:
         glutLeaveMainLoop();
         break;